@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "synthetic_design.hpp"
+
+namespace {
+
+std::string module_name(int level, int index) {
+  if (level == 0) {
+    return "top";
+  }
+  return "mod_l" + std::to_string(level) + "_" + std::to_string(index);
+}
+
+std::string primitive_name(int index) {
+  return "PRIM_" + std::to_string(index);
+}
+
+// Write the ports, parameters and connections of a cell, plus the nets they
+// connect to, to pad the output out like real yosys json
+void write_bloat(FILE *f, int bloat, int &next_bit) {
+  fprintf(f, "\"parameters\": {");
+  for (int i = 0; i < bloat; i++) {
+    fprintf(f, "%s\"P%d\": \"00000000000000000000000000010110\"",
+            i ? ", " : "", i);
+  }
+  fprintf(f, "}, \"attributes\": {\"src\": \"synthetic.v:%d.5-%d.20\"}, ",
+          next_bit, next_bit);
+  fprintf(f, "\"port_directions\": {");
+  for (int i = 0; i < bloat; i++) {
+    fprintf(f, "%s\"A%d\": \"%s\"", i ? ", " : "", i,
+            i ? "input" : "output");
+  }
+  fprintf(f, "}, \"connections\": {");
+  for (int i = 0; i < bloat; i++) {
+    fprintf(f, "%s\"A%d\": [ %d, %d ]", i ? ", " : "", i, next_bit,
+            next_bit + 1);
+    next_bit += 2;
+  }
+  fprintf(f, "}");
+}
+
+} // namespace
+
+bool write_synthetic_design(const std::string &path,
+                            const SyntheticDesignOptions &options) {
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  std::mt19937 rng(options.seed);
+
+  fprintf(f, "{\n  \"creator\": \"yostat synthetic design generator\",\n");
+  fprintf(f, "  \"modules\": {\n");
+
+  // Device primitives are blackboxes with a few ports
+  for (int p = 0; p < options.primitive_types; p++) {
+    fprintf(f,
+            "    \"%s\": {\n      \"attributes\": {\"blackbox\": "
+            "\"00000000000000000000000000000001\"},\n      \"ports\": {\"A\": "
+            "{\"direction\": \"input\", \"bits\": [ 2 ]}, \"Z\": "
+            "{\"direction\": \"output\", \"bits\": [ 3 ]}},\n      "
+            "\"cells\": {}\n    },\n",
+            primitive_name(p).c_str());
+  }
+
+  // Pick the submodules of each module up front, so that the choice doesn't
+  // depend on the primitive mix
+  std::vector<int> candidates(options.width);
+  int changed = 0;
+  for (int level = 0; level <= options.depth; level++) {
+    const int modules_at_level = level == 0 ? 1 : options.width;
+    for (int m = 0; m < modules_at_level; m++) {
+      std::vector<int> submodules;
+      if (level < options.depth) {
+        for (int i = 0; i < options.width; i++) {
+          candidates[i] = i;
+        }
+        std::shuffle(candidates.begin(), candidates.end(), rng);
+        submodules.assign(candidates.begin(),
+                          candidates.begin() +
+                              std::min(options.fanout, options.width));
+      }
+
+      const bool last = level == options.depth && m == modules_at_level - 1;
+      fprintf(f, "    \"%s\": {\n", module_name(level, m).c_str());
+      fprintf(f, "      \"attributes\": {%s},\n",
+              level == 0 ? "\"top\": \"00000000000000000000000000000001\""
+                         : "");
+      fprintf(f, "      \"cells\": {\n");
+
+      int next_bit = 2;
+      int cell = 0;
+      auto begin_cell = [&](const std::string &type) {
+        fprintf(f,
+                "%s        \"$cell%d\": {\"hide_name\": 1, \"type\": \"%s\", ",
+                cell ? ",\n" : "", cell, type.c_str());
+        cell++;
+      };
+      // Each module draws its cells from its own generator, so that changing
+      // one module leaves the json of every other module alone
+      std::mt19937 cell_rng(options.seed * 1000003u + level * options.width +
+                            m);
+      std::uniform_int_distribution<int> primitive(0,
+                                                   options.primitive_types - 1);
+      int num_cells = options.cells_per_module;
+      if (changed < options.changed_modules) {
+        num_cells++;
+        changed++;
+      }
+      for (int c = 0; c < num_cells && options.primitive_types; c++) {
+        begin_cell(primitive_name(primitive(cell_rng)));
+        write_bloat(f, options.bloat, next_bit);
+        fprintf(f, "}");
+      }
+      for (int sub : submodules) {
+        for (int r = 0; r < options.replication; r++) {
+          begin_cell(module_name(level + 1, sub));
+          write_bloat(f, options.bloat, next_bit);
+          fprintf(f, "}");
+        }
+      }
+      fprintf(f, "\n      },\n");
+
+      // One net per connected bit pair
+      fprintf(f, "      \"netnames\": {\n");
+      for (int bit = 2; bit < next_bit; bit += 2) {
+        fprintf(f,
+                "%s        \"net_%d\": {\"hide_name\": 1, \"bits\": [ %d, %d "
+                "], \"attributes\": {}}",
+                bit > 2 ? ",\n" : "", bit, bit, bit + 1);
+      }
+      fprintf(f, "\n      }\n    }%s\n", last ? "" : ",");
+    }
+  }
+
+  fprintf(f, "  }\n}\n");
+  return fclose(f) == 0;
+}
+
+const char *synthetic_design_usage =
+    "  --depth N                Levels of hierarchy below the top module\n"
+    "  --width N                Distinct modules per level\n"
+    "  --fanout N               Distinct submodules per module\n"
+    "  --replication N          Instances of each submodule\n"
+    "  --primitive-types N      Number of primitive types\n"
+    "  --cells N                Primitive cells per module\n"
+    "  --bloat N                Ports, parameters and nets per cell\n"
+    "  --changed-modules N      Modules given an extra cell\n"
+    "  --seed N                 Random seed\n";
+
+bool set_synthetic_design_option(const std::string &name,
+                                 const std::string &value,
+                                 SyntheticDesignOptions &options) {
+  const int n = atoi(value.c_str());
+  if (name == "--depth") {
+    options.depth = n;
+  } else if (name == "--width") {
+    options.width = n;
+  } else if (name == "--fanout") {
+    options.fanout = n;
+  } else if (name == "--replication") {
+    options.replication = n;
+  } else if (name == "--primitive-types") {
+    options.primitive_types = n;
+  } else if (name == "--cells") {
+    options.cells_per_module = n;
+  } else if (name == "--bloat") {
+    options.bloat = n;
+  } else if (name == "--changed-modules") {
+    options.changed_modules = n;
+  } else if (name == "--seed") {
+    options.seed = n;
+  } else {
+    return false;
+  }
+  return true;
+}
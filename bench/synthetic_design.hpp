@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+// Shape of a generated yosys design.
+// The top module instantiates modules from the first level of hierarchy, which
+// instantiate modules from the next level, and so on. The flattened design
+// has (fanout * replication) ^ depth leaf instances.
+struct SyntheticDesignOptions {
+  // Number of levels of hierarchy below the top module
+  int depth = 4;
+  // Number of distinct modules at each level of the hierarchy
+  int width = 8;
+  // Number of distinct submodules that each module instantiates
+  int fanout = 4;
+  // Number of instances of each submodule
+  int replication = 4;
+  // Number of primitive types in the device
+  int primitive_types = 16;
+  // Number of primitive cells instantiated directly by each module
+  int cells_per_module = 64;
+  // Number of ports, parameters and nets written per cell, which yostat
+  // ignores but has to get through. Real yosys output is mostly this.
+  int bloat = 4;
+  // Number of modules that get one extra primitive cell, to simulate a small
+  // change to an existing design
+  int changed_modules = 0;
+  // Seed for the choice of submodules and primitives
+  unsigned seed = 1;
+};
+
+// Write a synthetic yosys json design. Returns false if the file can't be
+// written.
+bool write_synthetic_design(const std::string &path,
+                            const SyntheticDesignOptions &options);
+
+// Apply a design shape command line option, e.g. ("--depth", "4"). Returns
+// false if name isn't one of the shape options.
+bool set_synthetic_design_option(const std::string &name,
+                                 const std::string &value,
+                                 SyntheticDesignOptions &options);
+
+// Help text describing the design shape options
+extern const char *synthetic_design_usage;
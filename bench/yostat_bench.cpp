@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <yostat/cache.hpp>
+#include <yostat/cost.hpp>
+#include <yostat/parse.hpp>
+#include <yostat/stats.hpp>
+#include <yostat/tree_diff.hpp>
+
+#include "synthetic_design.hpp"
+
+// Times each stage of loading and displaying a design, on either a generated
+// design or an existing json file. Everything runs headless, so the results
+// can be collected for every commit.
+
+namespace {
+
+struct BenchResult {
+  std::string name;
+  // Fastest run, in milliseconds
+  double ms;
+  // Largest increase in peak RSS over the RSS at the start of a run, in KiB
+  long peak_kib;
+  // Heap allocations made by one run
+  uint64_t allocations;
+  // Number of things processed in one run (bytes, modules, nodes...)
+  size_t items;
+  std::string item_name;
+};
+
+// Generate every node of a design's tree
+size_t expand_all(Design &d) {
+  size_t nodes = 0;
+  std::vector<Module *> pending = {d.top};
+  while (!pending.empty()) {
+    Module *m = pending.back();
+    pending.pop_back();
+    nodes++;
+    expand_module(d.nodes, m);
+    for (unsigned i = 0; i < m->num_children; i++) {
+      pending.emplace_back(d.nodes.child(m, i));
+    }
+  }
+  return nodes;
+}
+
+// Discards diff notifications
+class NullDiffListener : public TreeDiffListener {
+public:
+  void items_added(Module *, const std::vector<Module *> &) override {}
+  void items_deleted(Module *, const std::vector<Module *> &) override {}
+  void items_changed(const std::vector<Module *> &) override {}
+};
+
+class Bench {
+public:
+  explicit Bench(int repeat) : _repeat(repeat) {}
+
+  // Run setup then body repeat times, timing only the body. The body returns
+  // the number of items it processed.
+  void run(const std::string &name, const std::string &item_name,
+           std::function<void()> setup, std::function<size_t()> body,
+           std::function<void()> teardown = nullptr) {
+    BenchResult result = {name, 0, 0, 0, 0, item_name};
+    for (int i = 0; i < _repeat; i++) {
+      if (setup) {
+        setup();
+      }
+      reset_peak_rss();
+      const long rss_before = current_rss_kib();
+      const uint64_t allocations_before = allocation_count();
+      const auto start = std::chrono::steady_clock::now();
+      result.items = body();
+      const double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      const long peak = peak_rss_kib();
+      result.allocations = allocation_count() - allocations_before;
+      if (teardown) {
+        teardown();
+      }
+      result.ms = i == 0 ? ms : std::min(result.ms, ms);
+      if (rss_before >= 0 && peak >= 0) {
+        result.peak_kib = std::max(result.peak_kib, peak - rss_before);
+      }
+    }
+    fprintf(stderr, "  %s: %.3f ms\n", name.c_str(), result.ms);
+    _results.emplace_back(result);
+  }
+
+  void print(bool csv) const {
+    if (csv) {
+      printf("benchmark,ms,peak_kib,allocations,items,item_name\n");
+      for (auto &r : _results) {
+        printf("%s,%.3f,%ld,%llu,%zu,%s\n", r.name.c_str(), r.ms, r.peak_kib,
+               (unsigned long long)r.allocations, r.items,
+               r.item_name.c_str());
+      }
+      return;
+    }
+    printf("%-24s %12s %16s %12s %14s\n", "Benchmark", "Time (ms)",
+           "Peak +RSS (KiB)", "Allocations", "Items");
+    for (auto &r : _results) {
+      printf("%-24s %12.3f %16ld %12llu %14zu %s\n", r.name.c_str(), r.ms,
+             r.peak_kib, (unsigned long long)r.allocations, r.items,
+             r.item_name.c_str());
+    }
+  }
+
+private:
+  int _repeat;
+  std::vector<BenchResult> _results;
+};
+
+void usage() {
+  fprintf(stderr,
+          "Usage: yostat-bench [options]\n"
+          "Options:\n"
+          "  -i, --input FILE         Benchmark an existing json file rather "
+          "than a generated one\n"
+          "  -r, --repeat N           Run each benchmark N times and report "
+          "the fastest (default 3)\n"
+          "      --dir DIR            Where to write generated designs "
+          "(default /tmp)\n"
+          "      --keep               Don't delete generated designs\n"
+          "      --csv                Write results as csv\n"
+          "  -h, --help               Show this message\n"
+          "Generated design shape:\n");
+  fprintf(stderr, "%s", synthetic_design_usage);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  SyntheticDesignOptions shape;
+  std::string input_file;
+  std::string dir = "/tmp";
+  int repeat = 3;
+  bool keep = false;
+  bool csv = false;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing value for %s\n", arg.c_str());
+        exit(EXIT_FAILURE);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return EXIT_SUCCESS;
+    } else if (arg == "-i" || arg == "--input") {
+      input_file = value();
+    } else if (arg == "-r" || arg == "--repeat") {
+      repeat = std::max(1, atoi(value().c_str()));
+    } else if (arg == "--dir") {
+      dir = value();
+    } else if (arg == "--keep") {
+      keep = true;
+    } else if (arg == "--csv") {
+      csv = true;
+    } else if (!set_synthetic_design_option(arg, value(), shape)) {
+      fprintf(stderr, "Unknown option '%s'\n", arg.c_str());
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  Bench bench(repeat);
+
+  // Generate the design, plus a slightly changed copy of it to reload
+  std::vector<std::string> generated;
+  std::string changed_file;
+  if (input_file.empty()) {
+    const std::string prefix =
+        dir + "/yostat_bench_" + std::to_string(getpid());
+    input_file = prefix + ".json";
+    changed_file = prefix + "_changed.json";
+    SyntheticDesignOptions changed_shape = shape;
+    changed_shape.changed_modules = std::max(1, shape.changed_modules);
+    fprintf(stderr, "Generating %s\n", input_file.c_str());
+    if (!write_synthetic_design(input_file, shape) ||
+        !write_synthetic_design(changed_file, changed_shape)) {
+      fprintf(stderr, "Failed to write generated designs to %s\n",
+              dir.c_str());
+      return EXIT_FAILURE;
+    }
+    generated = {input_file, changed_file, cache_path(input_file)};
+  }
+
+  std::ifstream input(input_file, std::ios::binary | std::ios::ate);
+  const size_t input_size = input.tellg();
+  input.close();
+
+  // Parsing, with one thread and with the default thread count
+  std::map<std::string, YosysModule> modules;
+  bool parsed = true;
+  for (unsigned threads : {1u, 0u}) {
+    LoadOptions options;
+    options.threads = threads;
+    bench.run(threads == 1 ? "parse (1 thread)" : "parse (all cores)",
+              "bytes", [&]() { modules.clear(); },
+              [&]() {
+                parsed = read_json_modules(input_file, options, modules);
+                return input_size;
+              });
+    if (!parsed) {
+      fprintf(stderr, "Failed to parse '%s'\n", input_file.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Finding primitives and summarizing every module
+  std::unique_ptr<Design> design;
+  bench.run(
+      "aggregate", "modules", [&]() { design.reset(); },
+      [&]() {
+        design.reset(build_design(modules));
+        return modules.size();
+      });
+
+  // Generating the entire display tree
+  size_t num_nodes = 0;
+  bench.run(
+      "tree build", "nodes", [&]() { design.reset(build_design(modules)); },
+      [&]() { return num_nodes = expand_all(*design); });
+
+  // Looking up every column of every node, as the view does when painting
+  bench.run("column lookup", "lookups", nullptr, [&]() {
+    volatile long total = 0;
+    const int num_columns = design->primitives.size();
+    std::vector<Module *> pending = {design->top};
+    size_t lookups = 0;
+    while (!pending.empty()) {
+      Module *m = pending.back();
+      pending.pop_back();
+      for (int col = 0; col < num_columns; col++) {
+        total += m->get_primitive_count(col);
+      }
+      lookups += num_columns;
+      for (unsigned i = 0; i < m->num_children; i++) {
+        pending.emplace_back(design->nodes.child(m, i));
+      }
+    }
+    return lookups;
+  });
+
+  // Switching to a cost model that costs and limits every primitive
+  CostModel cost_model;
+  for (size_t i = 0; i < design->primitives.size(); i++) {
+    cost_model.costs[design->primitives[i]] = i + 1;
+    cost_model.capacities[design->primitives[i]] = 1000000;
+  }
+  bench.run("cost model", "modules", nullptr, [&]() {
+    CostColumns costs(*design, cost_model);
+    volatile double total = costs.cost(design->top);
+    (void)total;
+    return design->summaries.size();
+  });
+
+  // Reloading the same design, and one with a small change, on top of a fully
+  // expanded tree
+  std::map<std::string, YosysModule> changed_modules;
+  if (!changed_file.empty() &&
+      !read_json_modules(changed_file, LoadOptions(), changed_modules)) {
+    fprintf(stderr, "Failed to parse '%s'\n", changed_file.c_str());
+    return EXIT_FAILURE;
+  }
+  std::unique_ptr<Design> reloaded;
+  NullDiffListener listener;
+  for (bool changed : {false, true}) {
+    if (changed && changed_modules.empty()) {
+      continue;
+    }
+    bench.run(
+        changed ? "diff (changed)" : "diff (unchanged)", "nodes",
+        [&]() {
+          design.reset(build_design(modules));
+          expand_all(*design);
+          reloaded.reset(build_design(changed ? changed_modules : modules));
+        },
+        [&]() {
+          return update_design(*design, *reloaded, listener).visited;
+        });
+  }
+
+  // Loading the changed design from scratch, and after loading the original
+  // with an IngestState so that only the changed modules are parsed again
+  if (!changed_file.empty()) {
+    for (bool incremental : {false, true}) {
+      LoadOptions options;
+      options.cache = false;
+      bench.run(
+          incremental ? "reload (incremental)" : "reload (full)", "bytes",
+          [&]() {
+            if (incremental) {
+              options.previous = std::make_shared<IngestState>();
+              delete read_json(input_file, options);
+            }
+          },
+          [&]() {
+            reloaded.reset(read_json(changed_file, options));
+            return input_size;
+          },
+          [&]() { reloaded.reset(); });
+    }
+  }
+
+  // Saving and loading the binary cache
+  CacheKey key;
+  const bool had_cache = std::ifstream(cache_path(input_file)).good();
+  if (cache_key(input_file, key)) {
+    design.reset(build_design(modules));
+    bench.run("cache write", "modules", nullptr, [&]() {
+      write_cache(input_file, key, *design);
+      return design->summaries.size();
+    });
+    bench.run(
+        "cache read", "modules", nullptr,
+        [&]() {
+          reloaded.reset(read_cache(input_file, key));
+          return reloaded ? reloaded->summaries.size() : 0;
+        },
+        [&]() { reloaded.reset(); });
+    if (generated.empty() && !had_cache) {
+      // Don't leave a cache next to the user's file that they didn't ask for
+      std::remove(cache_path(input_file).c_str());
+    }
+  }
+
+  bench.print(csv);
+
+  if (!keep) {
+    for (auto &path : generated) {
+      std::remove(path.c_str());
+    }
+  }
+  return EXIT_SUCCESS;
+}
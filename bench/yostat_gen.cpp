@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "synthetic_design.hpp"
+
+// Writes a synthetic yosys json design, for benchmarking or for trying out
+// yostat on designs of a particular shape.
+
+static void usage() {
+  fprintf(stderr, "Usage: yostat-gen [options] [output json file]\n"
+                  "Options:\n");
+  fprintf(stderr, "%s", synthetic_design_usage);
+}
+
+int main(int argc, char **argv) {
+  SyntheticDesignOptions options;
+  std::string output_file;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return EXIT_SUCCESS;
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      if (i + 1 >= argc ||
+          !set_synthetic_design_option(arg, argv[i + 1], options)) {
+        usage();
+        return EXIT_FAILURE;
+      }
+      i++;
+    } else if (output_file.empty()) {
+      output_file = arg;
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (output_file.empty()) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  if (!write_synthetic_design(output_file, options)) {
+    fprintf(stderr, "Failed to write '%s'\n", output_file.c_str());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
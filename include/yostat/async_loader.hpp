@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <yostat/parse.hpp>
+
+// Runs read_json on a background thread.
+// Only one load is in flight at a time: starting a new load cancels the one
+// before it. Callbacks are invoked on the worker thread, so it is up to the
+// caller to hand the results back to whichever thread needs them.
+class AsyncLoader {
+public:
+  // Progress callback, with the number of bytes parsed and the total size
+  using ProgressFn = std::function<void(size_t, size_t)>;
+  // Completion callback, with the loaded design (nullptr on failure) and the
+  // generation of the load that produced it. Not invoked for cancelled loads.
+  using DoneFn = std::function<void(Design *, uint64_t)>;
+
+  AsyncLoader() = default;
+  AsyncLoader(const AsyncLoader &) = delete;
+  AsyncLoader &operator=(const AsyncLoader &) = delete;
+  ~AsyncLoader();
+
+  // Set the options used for subsequent loads. The progress callback is
+  // replaced by the one passed to load.
+  void set_options(const LoadOptions &options) { _options = options; }
+
+  // Start loading a file, cancelling any load already in progress. Returns
+  // the generation number for this load.
+  uint64_t load(const std::string &path, ProgressFn progress, DoneFn done);
+
+  // Cancel any load in progress
+  void cancel() { _generation++; }
+
+  // Check whether a generation number belongs to the most recent load. Results
+  // from any other generation are stale and should be discarded.
+  bool is_current(uint64_t generation) const {
+    return generation == _generation;
+  }
+
+private:
+  LoadOptions _options;
+  std::thread _thread;
+  std::atomic<uint64_t> _generation{0};
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <yostat/parse.hpp>
+
+// Identifies one version of an input file. The content hash only samples the
+// file, so that computing a key stays cheap for very large netlists.
+struct CacheKey {
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t content_hash;
+};
+
+// Path of the sidecar cache file for a json file
+std::string cache_path(const std::string &json_path);
+
+// Compute the key for the current version of a file. Returns false if the
+// file can't be read.
+bool cache_key(const std::string &json_path, CacheKey &key);
+
+// Load a design from the sidecar cache of a json file. The cache is memory
+// mapped and copied straight into the summaries, without any parsing.
+// Returns nullptr if there is no cache, or it doesn't match the key, or it is
+// corrupt, in which case the json should be parsed instead.
+Design *read_cache(const std::string &json_path, const CacheKey &key);
+
+// Write the sidecar cache for a design loaded from a json file whose key was
+// taken before loading. Returns false if the cache couldn't be written.
+bool write_cache(const std::string &json_path, const CacheKey &key,
+                 const Design &design);
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <yostat/parse.hpp>
+
+// A node in a tree formed by overlaying several designs on top of each other.
+// Nodes are matched up between designs by name, so each aligned node refers
+// to at most one module tree node in each design.
+struct AlignedNode {
+  AlignedNode *parent;
+  std::string name;
+  // The corresponding node in each design, or nullptr if that design has no
+  // node at this position
+  std::vector<Module *> modules;
+  // Whether the children have been generated yet
+  bool expanded = false;
+  std::vector<AlignedNode *> children;
+};
+
+// Change in the count of one primitive between a baseline and a candidate
+struct PrimitiveDelta {
+  int baseline;
+  int candidate;
+
+  int delta() const { return candidate - baseline; }
+  // Change as a percentage of the baseline. Infinite if the primitive is new.
+  double percent() const {
+    if (baseline == 0) {
+      const double inf = std::numeric_limits<double>::infinity();
+      return candidate > 0 ? inf : candidate < 0 ? -inf : 0;
+    }
+    return 100.0 * delta() / baseline;
+  }
+};
+
+// Several designs displayed side by side, e.g. the results of different
+// synthesis runs of the same RTL.
+// Like the module trees of the designs themselves, the aligned tree is only
+// generated as far as something asks for it.
+class DesignComparison {
+public:
+  // Takes ownership of the designs. Each design has a label, usually its
+  // file name.
+  DesignComparison(const std::vector<Design *> &designs,
+                   const std::vector<std::string> &labels);
+  // Shares ownership of the designs, e.g. with the query daemon that keeps
+  // them loaded. The comparison generates nodes in the designs' trees as it
+  // is expanded, so nothing else may use them at the same time.
+  DesignComparison(const std::vector<std::shared_ptr<Design>> &designs,
+                   const std::vector<std::string> &labels);
+  DesignComparison(const DesignComparison &) = delete;
+  DesignComparison &operator=(const DesignComparison &) = delete;
+
+  size_t num_designs() const { return _designs.size(); }
+  Design &design(size_t i) { return *_designs[i]; }
+  const std::string &label(size_t i) const { return _labels[i]; }
+
+  // Union of the primitives used by all of the designs, in name order
+  const std::vector<std::string> &primitives() const { return _primitives; }
+
+  AlignedNode *top() { return _top; }
+
+  // Generate the children of an aligned node, if not already done
+  void expand(AlignedNode *node);
+
+  // Get the count of a primitive (an index into primitives()) at a node for
+  // one of the designs. Designs without a node here count as zero.
+  int get_primitive_count(const AlignedNode *node, size_t design,
+                          size_t primitive) const;
+
+  // Get the change in a primitive at a node from the first design (the
+  // baseline) to the second (the candidate)
+  PrimitiveDelta get_delta(const AlignedNode *node, size_t primitive) const {
+    return {get_primitive_count(node, 0, primitive),
+            get_primitive_count(node, 1, primitive)};
+  }
+
+  // Whether a node and everything below it is the same in every design.
+  // Decided from the structure hashes, so the subtree isn't walked or
+  // generated. Always false if the designs use different primitives, since
+  // their hashes aren't comparable.
+  bool unchanged(const AlignedNode *node) const;
+
+private:
+  AlignedNode *create(AlignedNode *parent, const std::string &name);
+
+  std::vector<std::shared_ptr<Design>> _designs;
+  std::vector<std::string> _labels;
+  std::vector<std::string> _primitives;
+  // Maps from primitives() index to the primitive id in each design, or -1
+  // if the design doesn't use that primitive
+  std::vector<std::vector<int>> _primitive_ids;
+  // Whether every design has the same primitive list
+  bool _same_primitives;
+  // Storage for the aligned nodes. Deque so that pointers stay valid.
+  std::deque<AlignedNode> _nodes;
+  AlignedNode *_top;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <yostat/parse.hpp>
+
+// What the primitives of a device cost, and how many of each it has. Read
+// from json files like:
+//   {
+//     "name": "LFE5U-25F",
+//     "primitives": {
+//       "LUT4": {"cost": 1, "capacity": 24288},
+//       "TRELLIS_FF": {"cost": 0.5, "capacity": 24288},
+//       "DP16KD": {"cost": 60, "capacity": 56}
+//     }
+//   }
+// Primitives without a cost cost nothing, and primitives without a capacity
+// don't count towards device use.
+struct CostModel {
+  std::string name;
+  std::map<std::string, double> costs;
+  std::map<std::string, double> capacities;
+
+  // Get the non-zero costs of the primitives of a design, as (primitive id,
+  // cost) pairs, e.g. to rank by
+  std::vector<std::pair<int, double>> weights(const Design &design) const;
+};
+
+// Read a cost model from a json file. Returns false, with a message in error,
+// if the file can't be read or isn't a valid cost model.
+bool read_cost_model(const std::string &path, CostModel &model,
+                     std::string &error);
+// Parse a cost model from json text
+bool parse_cost_model(const std::string &text, CostModel &model,
+                      std::string &error);
+
+// Columns derived from the primitive counts of a design under a cost model.
+// Both values scale with the counts of a node, so they are worked out once
+// per module summary (for its (self) row and its total) from the dense count
+// arrays, and a node just scales the value of its summary by its instance
+// count. Building the columns is cheap enough to redo whenever the model
+// changes; nothing else about the design needs to change with it.
+class CostColumns {
+public:
+  CostColumns(const Design &design, const CostModel &model);
+
+  // Weighted cost of a node
+  double cost(const Module *m) const { return value(_cost, m); }
+  // Percentage of the device a node uses: its share of whichever primitive
+  // it uses the largest fraction of
+  double device(const Module *m) const { return value(_device, m); }
+
+  const std::string &model_name() const { return _model_name; }
+
+private:
+  // Values are stored in pairs per summary, (self) first
+  double value(const std::vector<double> &values, const Module *m) const {
+    const size_t i = 2 * m->summary->id + (m->kind != Module::Kind::Self);
+    return values[i] * m->instances;
+  }
+
+  std::string _model_name;
+  std::vector<double> _cost;
+  std::vector<double> _device;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+#include <yostat/file_watcher.hpp>
+#include <yostat/parse.hpp>
+
+// Keeps designs loaded and answers queries about them (see query.hpp) over a
+// Unix domain socket, so that repeated reports on the same netlists don't
+// parse and aggregate them again every time.
+// The protocol is json lines: each request is a query object on a line of
+// its own, answered by a line of {"ok": true, "output": "<report>"} or
+// {"ok": false, "error": "<message>"}. A {"status": true} request is
+// answered with the load stats of the resident designs, in "designs".
+// Designs are loaded the first time a query names them and kept from then
+// on. Each file is watched, and reloaded incrementally (see IngestState) once
+// synthesis has finished rewriting it. Queries for a file that is being
+// rewritten wait for the reload, and a query that finds a file changed since
+// it was loaded reloads it first, in case the watcher missed the change.
+// Each connection is served on a thread of its own, but queries are answered
+// one at a time, since reports generate nodes in the designs they read.
+class QueryDaemon {
+public:
+  explicit QueryDaemon(const LoadOptions &options);
+  QueryDaemon(const QueryDaemon &) = delete;
+  QueryDaemon &operator=(const QueryDaemon &) = delete;
+  // Closes any connections and removes the socket file
+  ~QueryDaemon();
+
+  // Create the socket. Returns false, with a message in error, if it can't be
+  // created or another daemon is already listening on it.
+  bool listen(const std::string &socket_path, std::string &error);
+  // Serve connections until stop() is called
+  void run();
+  // Make run() return. Only writes to a pipe, so it can be called from a
+  // signal handler.
+  void stop();
+
+  // Answer a single request line
+  std::string answer(const std::string &request);
+
+private:
+  // A loaded design, and what is needed to reload it
+  struct Resident {
+    std::shared_ptr<Design> design;
+    std::shared_ptr<IngestState> state;
+    // Size and modification time of the file that was loaded
+    int64_t size = -1;
+    int64_t mtime_ns = 0;
+    // Whether the watcher has seen the file being rewritten, and it hasn't
+    // been reloaded since
+    bool writing = false;
+    std::unique_ptr<FileWatcher> watcher;
+  };
+
+  struct Connection {
+    int fd;
+    std::thread thread;
+    bool done = false;
+  };
+
+  // Get the design for a file for a query holding the lock on _mutex,
+  // waiting for it to be rewritten and loading or reloading it as needed
+  std::shared_ptr<Design> design(const std::string &path,
+                                 std::unique_lock<std::mutex> &lock,
+                                 std::string &error);
+  // Load a design, or reload it if its file has changed. Must be called with
+  // _mutex held.
+  std::shared_ptr<Design> load(const std::string &path, std::string &error);
+  // Watcher callbacks, for when a file starts being rewritten and when it
+  // has been quiet for a while
+  void modified(const std::string &path);
+  void refresh(const std::string &path);
+  // Answer the requests on one connection until the client hangs up
+  void serve(Connection *connection);
+  // Join and close finished connections, or all of them
+  void reap(bool all);
+
+  LoadOptions _options;
+  // Guards the designs, and everything done with them
+  std::mutex _mutex;
+  std::map<std::string, std::unique_ptr<Resident>> _designs;
+  // Signalled when a file that was being rewritten has been reloaded
+  std::condition_variable _reloaded;
+  bool _stopping = false;
+
+  std::string _socket_path;
+  int _listen_fd = -1;
+  // Pipe used to wake run() up for shutdown
+  int _wake_fds[2] = {-1, -1};
+  std::mutex _connections_mutex;
+  std::list<Connection> _connections;
+};
+
+// Send a request to the daemon listening on a socket, and wait for its
+// response. Returns false, with a message in error, if the daemon can't be
+// reached or doesn't respond with json.
+bool send_request(const std::string &socket_path,
+                  const nlohmann::json &request, nlohmann::json &response,
+                  std::string &error);
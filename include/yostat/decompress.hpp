@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <string>
+
+// Compression formats recognised from the first bytes of a file
+enum class Compression { None, Gzip, Zstd };
+
+// Work out how some data is compressed from its magic number
+Compression detect_compression(const char *data, size_t size);
+// Work out how a file is compressed. Files that can't be read count as
+// uncompressed.
+Compression detect_compression(const std::string &path);
+
+// Name of a compression format, for messages
+const char *compression_name(Compression compression);
+// Whether this build can decompress a format. Gzip needs zlib and zstd needs
+// libzstd at build time.
+bool compression_supported(Compression compression);
+
+// Input stream of the decompressed contents of a file.
+// A worker thread reads and decompresses the file a chunk at a time into a
+// short queue, and reading from the stream takes chunks off the queue, so
+// decompression overlaps with whatever consumes the stream and only a few
+// chunks are held in memory at once. Nothing is written to disk.
+// The stream ends early, with failed() set, if the file can't be read or
+// isn't valid compressed data.
+class DecompressStream : public std::istream {
+public:
+  DecompressStream(const std::string &path, Compression compression);
+  DecompressStream(const DecompressStream &) = delete;
+  DecompressStream &operator=(const DecompressStream &) = delete;
+  // Stops the worker if it hasn't finished
+  ~DecompressStream();
+
+  // Number of compressed bytes read so far, and the size of the compressed
+  // file, for reporting progress
+  size_t compressed_done() const;
+  size_t compressed_size() const;
+
+  // Whether decompression failed, and why
+  bool failed() const;
+  std::string error() const;
+
+private:
+  class Buffer;
+  std::unique_ptr<Buffer> _buffer;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Kinds of device resource that primitives are grouped into
+enum class PrimitiveCategory : uint8_t {
+  Logic,
+  FF,
+  Carry,
+  Bram,
+  Dsp,
+  Io,
+  // Clocking, configuration and anything else
+  Other,
+};
+constexpr size_t num_primitive_categories = 7;
+
+// Column name for a category, e.g. "bram"
+const char *category_name(PrimitiveCategory category);
+
+// One entry of a family's primitive table
+struct FamilyPrimitive {
+  const char *name;
+  PrimitiveCategory category;
+};
+
+// The primitives of an FPGA family, as yosys names them.
+// The tables are built in, and each comes with a perfect hash generated at
+// compile time, so looking up a cell type hashes it once, reads a seed and a
+// slot, and compares a single string, whether or not it is in the table.
+class PrimitiveFamily {
+public:
+  constexpr PrimitiveFamily(const char *name, const FamilyPrimitive *entries,
+                            size_t size, const uint16_t *seeds,
+                            size_t num_buckets, const int16_t *slots,
+                            size_t num_slots)
+      : _name(name), _entries(entries), _size(size), _seeds(seeds),
+        _num_buckets(num_buckets), _slots(slots), _num_slots(num_slots) {}
+
+  const char *name() const { return _name; }
+
+  // Number of primitives in the table, and the i'th one. Table positions are
+  // dense ids for the family's primitives.
+  size_t size() const { return _size; }
+  const FamilyPrimitive &primitive(size_t i) const { return _entries[i]; }
+
+  // Get the table position of a cell type, or -1 if it isn't a primitive of
+  // this family
+  int find(const std::string &cell_type) const;
+
+  // Get the category of a cell type. Cell types that aren't in the table are
+  // Other.
+  PrimitiveCategory category(const std::string &cell_type) const {
+    const int i = find(cell_type);
+    return i < 0 ? PrimitiveCategory::Other : _entries[i].category;
+  }
+
+private:
+  const char *_name;
+  const FamilyPrimitive *_entries;
+  size_t _size;
+  // Hash-and-displace tables: the first hash of a name picks a bucket, whose
+  // seed displaces the second hash to a slot holding the table position
+  const uint16_t *_seeds;
+  size_t _num_buckets;
+  const int16_t *_slots;
+  size_t _num_slots;
+};
+
+// Look up a built-in family by name: "ecp5", "ice40", "gowin" or "xc7"
+// (Xilinx 7-series). Returns nullptr if there is no such family.
+const PrimitiveFamily *find_family(const std::string &name);
+
+// Names of the built-in families, for messages
+std::vector<std::string> family_names();
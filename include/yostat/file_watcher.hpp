@@ -0,0 +1,37 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <thread>
+
+// Watches a single file for changes using inotify.
+// Since synthesis tools rewrite their output over some period of time, change
+// notifications are debounced: on_change is only invoked once the file has
+// been quiet for debounce_ms. on_modified is invoked as soon as the first
+// write of a new version is seen, so that any work on the previous version of
+// the file can be abandoned early.
+// Both callbacks are invoked on the watcher thread.
+class FileWatcher {
+public:
+  FileWatcher(const std::string &path, std::function<void()> on_modified,
+              std::function<void()> on_change, int debounce_ms = 500);
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+  ~FileWatcher();
+
+  // Whether the watch was set up successfully
+  bool ok() const { return _inotify_fd >= 0; }
+
+private:
+  void run();
+
+  std::string _dir;
+  std::string _basename;
+  std::function<void()> _on_modified;
+  std::function<void()> _on_change;
+  int _debounce_ms;
+  int _inotify_fd = -1;
+  // Pipe used to wake the watcher thread up for shutdown
+  int _wake_fds[2] = {-1, -1};
+  std::thread _thread;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// FNV-1a, the hash used for names, structure hashes and checksums throughout.
+// None of them need to resist deliberate collisions, only to be fast and
+// spread well.
+constexpr uint64_t hash_offset = 0xcbf29ce484222325ull;
+constexpr uint64_t hash_prime = 0x100000001b3ull;
+
+// Hash a span of bytes one at a time. Usable at compile time, e.g. for the
+// family tables.
+constexpr uint64_t hash_bytes(const char *data, size_t size,
+                              uint64_t hash = hash_offset) {
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ (uint8_t)data[i]) * hash_prime;
+  }
+  return hash;
+}
+
+inline uint64_t hash_string(const std::string &s) {
+  return hash_bytes(s.data(), s.size());
+}
+
+// Hash a span of bytes a word at a time, with an extra shift to mix the high
+// bits down. Several times faster than hash_bytes, for spans of json and
+// whole files, but gives different hashes. Cache and history files store
+// these as checksums, so changing it means bumping their versions.
+inline uint64_t hash_words(const char *data, size_t size,
+                           uint64_t hash = hash_offset) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * hash_prime;
+    hash ^= hash >> 29;
+  }
+  return hash_bytes(data + i, size - i, hash);
+}
+
+// Mix a value into a running hash
+inline void hash_combine(uint64_t &hash, uint64_t value) {
+  hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <yostat/mapped_file.hpp>
+#include <yostat/parse.hpp>
+#include <yostat/string_pool.hpp>
+
+// A build recorded in a history store
+struct HistoryBuild {
+  // Name given to the build when it was recorded, e.g. a CI build number
+  std::string label;
+  // When the build was made, in seconds since the epoch
+  int64_t timestamp = 0;
+};
+
+// The per-module primitive counts of many builds of a design, so that their
+// trends can be followed without loading the netlists again.
+// A store is a single file that builds are only ever appended to (see
+// append_history). Each build is stored as sparse columns: for each
+// primitive, the modules that use any of it and the count for one instance of
+// each. Module, primitive and label names are stored once for the whole store
+// and referred to by id. Opening a store maps it and indexes its records,
+// after which looking up a count is a few binary searches in place.
+// A store must only be used by one thread at a time.
+class HistoryStore {
+public:
+  // Open the store at a path. A store that doesn't exist yet opens empty.
+  // Returns false, with a message in error, if the file isn't a history
+  // store.
+  bool open(const std::string &path, std::string &error);
+
+  // Number of builds, and the i'th one. Builds are in timestamp order, and
+  // builds with the same timestamp in the order they were recorded.
+  size_t size() const { return _order.size(); }
+  const HistoryBuild &build(size_t i) const { return _builds[_order[i]].info; }
+
+  // Id of a module or primitive name, or StringPool::none if no build has it
+  uint32_t find(const std::string &name) const { return _names.find(name); }
+  std::string name(uint32_t id) const { return _names.str(id); }
+  // Whether an id names a primitive of any build
+  bool is_primitive(uint32_t id) const {
+    return id < _is_primitive.size() && _is_primitive[id];
+  }
+
+  // Id of the top module of the i'th build
+  uint32_t top(size_t i) const;
+  // Whether the i'th build has a module, and its record is intact
+  bool has_module(size_t i, uint32_t module) const;
+  // Get the count of a primitive used by one instance of a module in the i'th
+  // build, including everything below it. Returns -1 if the build doesn't
+  // have the module, which is also the case for every module of a build
+  // whose record turns out to be damaged.
+  int count(size_t i, uint32_t module, uint32_t primitive) const;
+  // Ids of the primitives of the i'th build that a module uses any of
+  std::vector<uint32_t> primitives_used(size_t i, uint32_t module) const;
+
+private:
+  struct BuildRecord {
+    HistoryBuild info;
+    // Start of the record's body in the mapping
+    const char *body;
+    uint64_t body_size;
+    uint64_t checksum;
+    // Whether the body has been checked against its checksum yet, and if so
+    // whether it was intact
+    mutable bool checked = false;
+    mutable bool intact = false;
+  };
+  // Get a build's record, or nullptr if it is damaged. Records are checked
+  // the first time they are used rather than when the store is opened.
+  const BuildRecord *record(size_t i) const;
+  // Find a module in a build record, returning false if it isn't there
+  bool find_module(const BuildRecord &record, uint32_t module) const;
+
+  friend bool append_history(const std::string &path, const Design &design,
+                             const HistoryBuild &build, bool &appended,
+                             std::string &error);
+
+  MappedFile _file;
+  // End of the last complete record. Anything after it is left over from an
+  // append that didn't finish, and is overwritten by the next one.
+  uint64_t _end = 0;
+  StringPool _names;
+  std::vector<bool> _is_primitive;
+  // Builds in the order they were recorded, and their indexes in timestamp
+  // order
+  std::vector<BuildRecord> _builds;
+  std::vector<size_t> _order;
+};
+
+// Record a build of a design at the end of the history store at a path,
+// creating the store if it doesn't exist. A build with the same label and
+// timestamp as one already in the store isn't recorded again, in which case
+// appended is set to false. Appends are serialized with a file lock, so
+// several processes can record builds in the same store at once. Returns
+// false, with a message in error, if the store can't be read or written.
+bool append_history(const std::string &path, const Design &design,
+                    const HistoryBuild &build, bool &appended,
+                    std::string &error);
+
+// A question about how a module's primitive counts changed across builds
+struct HistoryQuery {
+  // Module to follow. If empty, the top module of each build is followed.
+  std::string module;
+  // Primitives to report. If empty, every primitive the module uses in any
+  // of the builds is reported.
+  std::vector<std::string> primitives;
+  // If nonzero, only look at this many of the most recent builds
+  size_t last = 0;
+  // If set, only report the first build where the count of this primitive is
+  // more than threshold
+  std::string threshold_primitive;
+  int threshold = 0;
+};
+
+// The answer to a HistoryQuery
+struct HistoryTrend {
+  // Name of the module followed, or of the top module of the latest build
+  // if the query followed the top module
+  std::string module;
+  std::vector<std::string> primitives;
+  // Indexes of the builds reported, oldest first, and for each one the
+  // count of each primitive, or -1 if the build doesn't have the module
+  std::vector<size_t> builds;
+  std::vector<std::vector<int>> counts;
+};
+
+// Answer a query from a history store. Returns false, with a message in
+// error, if the query names a module or primitive that isn't in the store.
+bool history_trend(const HistoryStore &store, const HistoryQuery &query,
+                   HistoryTrend &trend, std::string &error);
+
+// Get the counts of a primitive (or, if primitive is StringPool::none, the
+// total over every primitive) used by one instance of a module across the
+// most recent builds, oldest first, with -1 for builds without the module.
+// Used for the trend column in the GUI.
+std::vector<int> history_series(const HistoryStore &store,
+                                const std::string &module,
+                                uint32_t primitive, size_t last);
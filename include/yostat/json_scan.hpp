@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Location of one module's body within a yosys json file
+struct ModuleSpan {
+  std::string name;
+  // Byte offsets of the module's object, from its opening brace to just past
+  // its closing brace
+  size_t begin;
+  size_t end;
+};
+
+// Find the modules in a yosys json buffer without tokenizing them.
+// This only understands enough of the json syntax (strings and bracket
+// nesting) to find where each member of the top level "modules" object
+// starts and ends, so it is much faster than a full parse, and the module
+// bodies can then be parsed independently.
+// Returns false if the buffer doesn't have the expected structure.
+bool scan_modules(const char *data, size_t size,
+                  std::vector<ModuleSpan> &modules);
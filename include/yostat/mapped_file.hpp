@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A read-only memory mapping of a whole file
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() { close(); }
+
+  // Map the given file. Returns false if it can't be opened or mapped, e.g.
+  // because it is empty or isn't a regular file.
+  bool open(const std::string &path);
+  void close();
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const char *_data = nullptr;
+  size_t _size = 0;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Number of worker threads to use by default, based on the number of cores
+unsigned default_thread_count();
+
+// Run fn(i) for every i in [0, count) across a pool of worker threads.
+// Items are handed out one at a time, so uneven item sizes balance out.
+// If threads is zero, default_thread_count() is used. Blocks until every item
+// is done.
+void parallel_for(size_t count, const std::function<void(size_t)> &fn,
+                  unsigned threads = 0);
@@ -1,17 +1,38 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include <yostat/family.hpp>
+#include <yostat/stats.hpp>
+#include <yostat/string_pool.hpp>
+
 struct YosysModule {
   // Basic struct for tracking some data we pull from the yosys output json for
   // each module. To tally the resource usage, we only really care about
   // - The name of each module
   // - The number of cells it has of each type
+  // - Whether it is the top module, or a blackbox/whitebox (device primitive)
+  // - The names of the cells that are instances of other modules
   std::string name;
   std::map<std::string, int> cell_counts;
+  // Cell names by cell type, each name followed by a '\0'. The names of
+  // primitive cells are dropped once all the modules are known (see
+  // prune_cell_names).
+  std::map<std::string, std::string> cell_names;
+  bool top = false;
+  bool blackbox = false;
+  // Whether the cell counts came from a 'stat -json' report rather than from
+  // the cells themselves
+  bool from_stat = false;
   void increment_celltype(std::string celltype) {
     auto search = cell_counts.find(celltype);
     if (search == cell_counts.end()) {
@@ -19,7 +40,45 @@ struct YosysModule {
     }
     cell_counts[celltype] = cell_counts[celltype] + 1;
   }
-  bool all_cells_are_primitives(std::set<std::string> primitive_names);
+  void add_cell(const std::string &celltype, const std::string &cellname) {
+    increment_celltype(celltype);
+    std::string &names = cell_names[celltype];
+    names += cellname;
+    names += '\0';
+  }
+  bool all_cells_are_primitives(
+      const std::unordered_map<std::string, int> &primitive_ids) const;
+};
+
+// Aggregated resource usage for a single yosys module definition.
+// Each module is summarized exactly once, no matter how many times it is
+// instantiated, and the summary is shared by every node in the display tree
+// that represents an instance of that module.
+struct ModuleSummary {
+  std::string name;
+  // Primitives instantiated directly by this module, indexed by primitive id
+  std::vector<int> self_primitives;
+  // Primitives used by this module and all of its submodules, indexed by
+  // primitive id
+  std::vector<int> total_primitives;
+  // Non-primitive cells, as (submodule, number of instances) pairs
+  std::vector<std::pair<const ModuleSummary *, int>> submodules;
+  // Instance names of the non-primitive cells, in the design's string pool:
+  // one per instance, in the same order as submodules. Empty if the input
+  // doesn't name its cells (e.g. a stat -json report).
+  std::vector<uint32_t> instance_names;
+  // In order to differentiate logic used by a module and logic used by
+  // submodules of that module, modules that do not consist entirely of
+  // primitives get a special ' (self)' child node
+  bool has_self = false;
+  // Hash of the name, primitive counts and structure of this module and
+  // everything below it. Two modules with the same hash (in designs with the
+  // same primitive list) generate identical subtrees, apart from instance
+  // names, which synthesis doesn't keep stable for generated cells.
+  uint64_t hash = 0;
+  // Position of this summary in its design's summary list, for indexing data
+  // about modules that is kept outside the summaries (see CostColumns)
+  uint32_t id = 0;
 };
 
 // One element in the data view control.
@@ -27,68 +86,303 @@ struct YosysModule {
 // the number of primitives used by that node _and_ all child nodes.
 // Due to the way that wx interacts with the data structures, we need to retain
 // pointers from parents to children, as well as children to parents.
+// Nodes are allocated from the ModulePool of the owning design, which also
+// holds the child lists.
+// Nodes don't hold any resource counts themselves, they just refer to the
+// summary of the module they represent. Child nodes are only generated once
+// something asks for them (see expand_module), so the size of the tree in
+// memory depends on what has been viewed, not on the flattened design size.
 struct Module {
-  // Construct a module with no parent. Only the top module should be created
-  // this way.
-  Module(std::string name_) : parent(nullptr), name(name_) {}
-  // Create a module that is a child of another module.
-  Module(Module *parent_, std::string name_) : parent(parent_), name(name_) {
-    if (parent)
-      parent->add_submodule(this);
-  }
+  enum class Kind {
+    // A single instantiation of a module
+    Instance,
+    // For non-primitives with multiple instances, we generate two hierarchy
+    // levels - one the counts all instantiations as one line item, and then
+    // each individual instantiation below that. This way, we can easily see
+    // both the individual and combined weight of the modules.
+    Holder,
+    // The primitives instantiated directly by the parent module
+    Self,
+  };
+
+  Module(Module *parent_, Kind kind_, const ModuleSummary *summary_,
+         int instances_)
+      : parent(parent_), kind(kind_), instance_name(StringPool::none),
+        summary(summary_), instances(instances_),
+        expanded(kind_ == Kind::Self), first_child(0), num_children(0) {}
 
-  // Invoked on parents to connect child modules
-  void add_submodule(Module *s) { submodules.emplace_back(s); }
+  // Display name for this node, given the string pool of its design. Named
+  // instances show the instance and then the module, e.g. "u_cpu (cpu)".
+  std::string name(const StringPool &names) const {
+    switch (kind) {
+    case Kind::Holder:
+      return "[" + std::to_string(instances) + "x] " + summary->name;
+    case Kind::Self:
+      return " (self)";
+    default:
+      if (instance_name == StringPool::none) {
+        return summary->name;
+      }
+      return names.str(instance_name) + " (" + summary->name + ")";
+    }
+  }
 
-  // Directly set the primitive count for a certain primitive
-  void set_primitive_count(std::string prim, int count) {
-    primitives[prim] = count;
+  // Name of this node in an instance path (see instance_path): the instance
+  // name if it has one, or else its display name
+  std::string path_name(const StringPool &names) const {
+    if (kind == Kind::Instance && instance_name != StringPool::none) {
+      return names.str(instance_name);
+    }
+    return kind == Kind::Self ? "(self)" : name(names);
   }
 
-  // Increment the current count on this module for a given primitive
-  // If the primitive was previously unreferenced, increment starts from zero.
-  void increment_primitive_count(std::string prim, int count) {
-    auto search = primitives.find(prim);
-    if (search == primitives.end()) {
-      primitives[prim] = count;
-      return;
+  // Whether this node has children, which is known from the summary without
+  // generating them
+  bool has_children() const {
+    switch (kind) {
+    case Kind::Holder:
+      return instances > 0;
+    case Kind::Self:
+      return false;
+    default:
+      return summary->has_self || !summary->submodules.empty();
     }
-    primitives[prim] += count;
   }
 
-  // Get the number of primitives of a given type used by this node (which
+  // Get the number of primitives with a given id used by this node (which
   // includes all resources used by child nodes)
-  int get_primitive_count(std::string primitive) {
-    auto search = primitives.find(primitive);
-    if (search == primitives.end()) {
+  int get_primitive_count(int primitive) const {
+    const auto &counts = kind == Kind::Self ? summary->self_primitives
+                                            : summary->total_primitives;
+    if (primitive < 0 || primitive >= (int)counts.size()) {
       return 0;
-    } else {
-      return search->second;
     }
+    return counts[primitive] * instances;
   }
 
   Module *parent;
-  std::string name;
-  std::map<std::string, int> primitives;
-  std::vector<Module *> submodules;
+  Kind kind;
+  // Id of the instance name in the design's string pool, or none for the top
+  // module, holders, (self) rows and cells the input didn't name
+  uint32_t instance_name;
+  const ModuleSummary *summary;
+  // Number of module instances this node stands for. Only holders have more
+  // than one.
+  int instances;
+  // Whether the child nodes have been generated yet
+  bool expanded;
+  // Index range of the child list in the shared link array of the pool
+  uint32_t first_child;
+  uint32_t num_children;
 };
 
-// Recursive generator for Module tree
-Module *generate_module_tree(std::map<std::string, YosysModule> modules,
-                             std::set<std::string> primitive_names,
-                             Module *parent, std::string module_name);
-// Module tree destructor
-void delete_module_tree(Module *m);
+// Arena allocator for module tree nodes.
+// Nodes are carved out of large contiguous blocks rather than being allocated
+// one by one, and child lists are stored as index ranges into a single link
+// array shared by all nodes. Generated subtrees can be released again (see
+// release_children and release), in which case their slots and link ranges
+// are reused by later nodes; everything else goes away in one go when the
+// pool is destroyed.
+class ModulePool {
+public:
+  ModulePool() = default;
+  ModulePool(const ModulePool &) = delete;
+  ModulePool &operator=(const ModulePool &) = delete;
+
+  // Allocate a new node. The node isn't attached to the parent until it is
+  // added to the parent's child list with set_children.
+  Module *create(Module *parent, Module::Kind kind,
+                 const ModuleSummary *summary, int instances = 1);
+
+  // Replace the child list of a node, reparenting the children to it
+  void set_children(Module *m, const std::vector<Module *> &children);
+
+  // Free every node below a node, and mark it as not expanded so that its
+  // children are generated again when next asked for. Any pointers to the
+  // freed nodes become invalid. Returns the number of nodes freed.
+  size_t release_children(Module *m);
+
+  // Free a node that has been taken out of its parent's child list, along
+  // with every node below it. Returns the number of nodes freed.
+  size_t release(Module *m);
+
+  // Get the i'th child of a node
+  Module *child(const Module *m, unsigned i) const {
+    return _links[m->first_child + i];
+  }
+
+  // Get a copy of the child list of a node
+  std::vector<Module *> children(const Module *m) const {
+    return std::vector<Module *>(_links.begin() + m->first_child,
+                                 _links.begin() + m->first_child +
+                                     m->num_children);
+  }
+
+  // Copy a node belonging to another pool into this one, along with any
+  // children it has generated. This is how nodes move between designs.
+  Module *adopt(const ModulePool &other, const Module *m, Module *parent);
+
+  // Number of live nodes allocated from this pool
+  size_t size() const { return _size; }
+
+private:
+  static constexpr size_t block_size = 4096;
+  using Slot =
+      typename std::aligned_storage<sizeof(Module), alignof(Module)>::type;
+
+  std::vector<std::unique_ptr<Slot[]>> _blocks;
+  size_t _block_used = block_size;
+  size_t _size = 0;
+  std::vector<Module *> _links;
+  // Released node slots, and released link ranges keyed by their length. A
+  // node always generates the same number of children, so ranges freed by
+  // collapsing a subtree fit exactly when it is expanded again.
+  std::vector<Slot *> _free_slots;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> _free_ranges;
+};
+
+// Summaries from an earlier build of the same design that summarize_module
+// can copy rather than recompute
+struct SummaryReuse {
+  // Summaries from the earlier build, which must have the same primitive ids.
+  // Their submodule lists are ignored.
+  const std::unordered_map<std::string, ModuleSummary> *previous = nullptr;
+  // Modules that were added, removed or changed since the earlier build
+  const std::unordered_set<std::string> *changed = nullptr;
+  // Modules whose summaries have been copied so far
+  std::unordered_set<std::string> reused;
+};
+
+// Memoized summary generator. Looks up the summary for the named module,
+// building it (and the summaries for everything below it) if necessary.
+// Instance names are interned in names.
+// If reuse is given, the summary of a module that hasn't changed, and that
+// has nothing below it that changed, is copied from the earlier build.
+const ModuleSummary *
+summarize_module(const std::map<std::string, YosysModule> &modules,
+                 const std::unordered_map<std::string, int> &primitive_ids,
+                 std::map<std::string, ModuleSummary> &summaries,
+                 StringPool &names, const std::string &module_name,
+                 SummaryReuse *reuse = nullptr);
+// Generate the child nodes of a module tree node, if not already done
+void expand_module(ModulePool &pool, Module *m);
+
+// Hierarchical path of a node, following the parent links up to the top
+// module, e.g. "top/u_cpu/u_alu". [Nx] holders are left out of the path of
+// the instances below them, and named instances are named by their instance
+// name rather than their module.
+std::string instance_path(const StringPool &names, const Module *m);
 
 // Wrapper class that contains all the data necessary for wx to display a design
 struct Design {
-  ~Design() { delete_module_tree(top); }
+  // Primitives used by the design, in name order. The index of a primitive in
+  // this list is its dense id, which is used to index the count arrays in the
+  // module summaries.
   std::vector<std::string> primitives;
+  std::unordered_map<std::string, int> primitive_ids;
+  // Summaries for every module reachable from the top module, keyed by name.
+  // Referenced by the nodes of the module tree.
+  std::map<std::string, ModuleSummary> summaries;
+  // Storage for the module tree nodes
+  ModulePool nodes;
   Module *top;
+  // Instance names, shared by the summaries and the nodes. Each distinct name
+  // is stored once, however many times it appears in the hierarchy.
+  StringPool names;
+  // How the design was loaded, as measured by read_json
+  LoadStats stats;
+  // FPGA family the design was loaded for, which classifies its primitives,
+  // or nullptr
+  const PrimitiveFamily *family = nullptr;
+};
+
+// What read_json remembers about the last load of a file, so that reloading
+// it after a small change only parses and summarizes the modules whose json
+// changed. Content fingerprints rather than timestamps decide what changed,
+// so a state that has fallen behind the file is still safe to use; it just
+// saves less work. A state must only be used by one load at a time.
+struct IngestState {
+  // Modules parsed so far, and a fingerprint of the json of each one
+  std::map<std::string, YosysModule> modules;
+  std::unordered_map<std::string, uint64_t> fingerprints;
+  // Modules that were added, removed or changed since the summaries below
+  // were taken
+  std::unordered_set<std::string> changed;
+  // Primitives and summaries of the last design built from the modules. The
+  // summaries' submodule and instance name lists are left empty.
+  std::vector<std::string> primitives;
+  std::unordered_map<std::string, ModuleSummary> summaries;
 };
 
-// Load a design from a yosys json file
-Design *read_json(std::string path);
+// Optional settings for read_json
+struct LoadOptions {
+  // Called periodically during parsing with the number of bytes of input
+  // consumed so far and the total input size. Returning false cancels the
+  // load.
+  std::function<bool(size_t, size_t)> progress;
+  // Number of threads used to parse the modules of a file. Zero uses one per
+  // core. One streams the file through a single parser rather than memory
+  // mapping it, which is also the fallback if the file can't be mapped.
+  // Compressed (gzip or zstd) files are always streamed, with decompression
+  // on a thread of its own.
+  unsigned threads = 0;
+  // Whether to load from, and save to, a binary cache file alongside the
+  // json (see cache.hpp)
+  bool cache = true;
+  // If set, reuse whatever the last load with this state parsed that is
+  // still the same, and update the state for the next load. Only modules
+  // found by a memory mapped scan can be reused; streamed files are always
+  // parsed completely.
+  std::shared_ptr<IngestState> previous;
+  // Cell types to count as primitives, as well as any blackbox modules. For
+  // inputs that don't mark blackboxes, such as stat -json reports.
+  std::set<std::string> primitives;
+  // If set, cell types that are primitives of this family count as
+  // primitives too, unless the design defines them as a module that isn't a
+  // blackbox
+  const PrimitiveFamily *family = nullptr;
+};
+
+// Load a design from a yosys json netlist or 'stat -json' report, which may be
+// gzip or zstd compressed.
+// Returns nullptr if the file can't be read or parsed, or if the load was
+// cancelled.
+Design *read_json(std::string path, const LoadOptions &options = LoadOptions());
+
+// The two halves of read_json, minus the cache. Parse the modules of a yosys
+// json file, returning false if the file can't be read or parsed, or if the
+// load was cancelled. This always parses the whole file, whatever
+// options.previous is.
+bool read_json_modules(const std::string &path, const LoadOptions &options,
+                       std::map<std::string, YosysModule> &modules);
+// Find the top module and primitives of a parsed design, and summarize it.
+// If stats is given, the time taken by each step is recorded in it. If state
+// is given, the summaries it holds are reused where possible, and then
+// replaced with the new ones.
+// Blackbox modules, any cell types in primitives, and the family's primitives
+// (as for LoadOptions::family) are primitives. A stat -json report, or a
+// design with none of them, also counts every cell type that isn't defined
+// as a module. The top module is the one with the top attribute, or failing
+// that the one called "top", or failing that the uninstantiated module with
+// the most modules below it.
+Design *build_design(const std::map<std::string, YosysModule> &modules,
+                     LoadStats *stats = nullptr, IngestState *state = nullptr,
+                     const std::set<std::string> *primitives = nullptr,
+                     const PrimitiveFamily *family = nullptr);
+
+// Load several designs concurrently, one file per worker thread. If threads
+// is zero, one thread per core is used. Returns one design per path, which is
+// nullptr if that file failed to load. options.previous is only used when
+// there is a single path. Files loaded side by side don't get peak RSS for
+// their phases; peak_rss_kib() afterwards gives the peak for all of them.
+std::vector<Design *>
+read_json_files(const std::vector<std::string> &paths,
+                const LoadOptions &options = LoadOptions(),
+                unsigned threads = 0);
 
-// Get the set of primitives actually used by a design
-std::vector<std::string> unique_primitives_in_tree(Module *tree);
+// Get the set of primitives actually used by the tree below a given module,
+// in name order
+std::vector<std::string>
+unique_primitives_in_tree(const std::map<std::string, YosysModule> &modules,
+                          const std::set<std::string> &primitive_names,
+                          const std::string &top_module);
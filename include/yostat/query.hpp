@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <yostat/cost.hpp>
+#include <yostat/parse.hpp>
+#include <yostat/rank.hpp>
+#include <yostat/report.hpp>
+
+// A request for a report, as made by yostat-cli's options. The same request
+// can be answered by the CLI itself or, as json, by the query daemon, which
+// keeps the designs loaded between requests.
+struct Query {
+  // Files to report on. One file gets a plain report and several get
+  // compared side by side.
+  std::vector<std::string> files;
+  // If set, report the change from this file to the single other file
+  std::string baseline;
+  // Names for the inputs() in comparison reports, if not their paths
+  std::vector<std::string> labels;
+  // Report settings. The subtree and cost model pointers are ignored; they
+  // are filled in from the fields below for each design.
+  ReportOptions options;
+  // Instance path of the subtree to report (see find_instance_path)
+  std::string subtree;
+  // Cost model file to add cost columns from, or to rank by
+  std::string cost_model;
+  // Whether to write the heaviest contributors (rank_query.count of them)
+  // rather than the hierarchy
+  bool rank = false;
+  RankQuery rank_query;
+  // Primitives to rank by, as for parse_rank_weights. If empty, the cost
+  // model's costs are used, or failing that every primitive with weight 1.
+  std::string rank_weights;
+
+  // Files to load for the query, in the order run_query expects them: the
+  // baseline first, if there is one
+  std::vector<std::string> inputs() const;
+};
+
+// Check that a query makes sense before loading anything for it. Returns
+// false, with a message in error, if not.
+bool check_query(const Query &query, std::string &error);
+
+// Answer a query about designs already loaded from its inputs(), writing the
+// report to os. Reports generate nodes in the designs' trees as needed.
+// Returns false, with a message in error, if the query can't be answered,
+// e.g. because a primitive or instance it names isn't in the design.
+bool run_query(const Query &query,
+               const std::vector<std::shared_ptr<Design>> &designs,
+               std::ostream &os, std::string &error);
+
+// Convert a query to and from the json used by the query daemon's protocol,
+// e.g. {"files": ["soc.json"], "format": "csv", "depth": 2}. Fields left out
+// keep their defaults. Returns false, with a message in error, if the json
+// isn't a valid query.
+nlohmann::json query_json(const Query &query);
+bool parse_query(const nlohmann::json &json, Query &query, std::string &error);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <yostat/parse.hpp>
+
+// A "heaviest contributors" query
+struct RankQuery {
+  // Primitive ids to rank by, with a weight for each. Something's score is
+  // the sum of its primitive counts times their weights. Weights must not be
+  // negative.
+  std::vector<std::pair<int, double>> weights;
+  // Number of results wanted
+  size_t count = 20;
+  // Rank the primitives used directly by each module (its (self) row) rather
+  // than its hierarchical total
+  bool self = false;
+  // Rank module definitions, by their score summed over every instance,
+  // rather than individual instances
+  bool modules = false;
+};
+
+// One result of a ranking
+struct RankEntry {
+  // Modules on the path from the top module down to the instance. When
+  // ranking modules, this is just the module.
+  std::vector<const ModuleSummary *> path;
+  // Number of instances the entry stands for. Instances reached through the
+  // same path are identical, so they are ranked as one entry.
+  uint64_t instances = 0;
+  // Score of a single instance
+  double score = 0;
+
+  // What the entry was ranked by: the score of one instance, or when ranking
+  // modules, of all of them
+  double rank_score(const RankQuery &query) const {
+    return query.modules ? score * instances : score;
+  }
+  // Instance path, as '/' separated module names
+  std::string path_name() const;
+};
+
+// Parse a comma separated list of primitives to rank by, each with an
+// optional weight, e.g. "LUT4,DP16KD=30". Returns false, with a message in
+// error, if a primitive isn't in the design or a weight isn't valid.
+bool parse_rank_weights(const Design &design, const std::string &list,
+                        std::vector<std::pair<int, double>> &weights,
+                        std::string &error);
+
+// Find the highest scoring instances or modules of a design, best first.
+// Works on the module summaries rather than the instance tree, so replicated
+// instances are never flattened. Instances are found best first by their
+// hierarchical totals, which bound the score of everything below them, and
+// candidates are kept in a heap of the best count so far, so the search
+// stops as soon as nothing left can make the cut. Equal scores are ordered by
+// path, so asking for more results only ever adds to the end. Entries scoring
+// zero are left out.
+std::vector<RankEntry> rank_contributors(const Design &design,
+                                         const RankQuery &query);
+
+// Find the first node of a design's tree for an instance path found by
+// rank_contributors, generating nodes as needed. Returns nullptr if the path
+// doesn't exist.
+Module *find_instance(Design &design,
+                     const std::vector<const ModuleSummary *> &path);
+// Same for an instance path written as '/' separated names, starting with the
+// top module. Each name can be an instance name, as from instance_path, or a
+// module name, as from RankEntry::path_name, which picks the first instance of
+// that module.
+Module *find_instance_path(Design &design, const std::string &path);
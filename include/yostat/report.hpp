@@ -0,0 +1,77 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <yostat/compare.hpp>
+#include <yostat/cost.hpp>
+#include <yostat/history.hpp>
+#include <yostat/parse.hpp>
+#include <yostat/rank.hpp>
+
+enum class ReportFormat { Text, Csv, Json };
+
+// Settings for write_report
+struct ReportOptions {
+  ReportFormat format = ReportFormat::Text;
+  // Maximum depth of the hierarchy to report, where the top module is depth 0.
+  // Negative for no limit.
+  int max_depth = -1;
+  // Primitives to report, in order. If empty, every primitive in the design
+  // is reported.
+  std::vector<std::string> primitives;
+  // Instances under an [Nx] holder are identical, so by default only the
+  // first one is reported. Set this to report every instance.
+  bool all_instances = false;
+  // For comparison and delta reports, leave out parts of the hierarchy that
+  // are the same in every design
+  bool changed_only = false;
+  // For delta reports, order each module's children by how much they grew
+  // across the reported primitives, largest first
+  bool sort_by_delta = false;
+  // For single design reports, only report instances matching this query
+  // and the modules above them (see SearchResult)
+  std::string search;
+  // For single design reports, report the subtree below this node of the
+  // design (see find_instance_path) rather than the whole hierarchy
+  Module *subtree = nullptr;
+  // For single design reports, also report the weighted cost and device use
+  // of each row under this model
+  const CostModel *cost_model = nullptr;
+  // For single design reports on a design loaded for a family (see
+  // LoadOptions::family), also report the total count of each category of
+  // primitive the design uses
+  bool categories = false;
+};
+
+// Write the aggregated module hierarchy of a design as text, CSV or JSON.
+// Parts of the tree that haven't been generated yet are generated as needed.
+void write_report(std::ostream &os, Design &design,
+                  const ReportOptions &options);
+
+// Write the aligned hierarchy of several designs, with a group of primitive
+// columns for each design.
+void write_comparison_report(std::ostream &os, DesignComparison &comparison,
+                             const ReportOptions &options);
+
+// Write the aligned hierarchy of a baseline (the first design) and a candidate
+// (the second), with the baseline and candidate counts, and the absolute and
+// percentage change, for each primitive.
+void write_delta_report(std::ostream &os, DesignComparison &comparison,
+                        const ReportOptions &options);
+
+// Write the results of a ranking query, best first, with the counts of the
+// primitives ranked by for one instance of each entry.
+void write_rank_report(std::ostream &os, const Design &design,
+                       const RankQuery &query,
+                       const std::vector<RankEntry> &entries,
+                       ReportFormat format);
+
+// Write the answer to a history query, with a row per build, oldest first,
+// and the count of each primitive in one instance of the module followed.
+void write_history_report(std::ostream &os, const HistoryStore &store,
+                          const HistoryTrend &trend, ReportFormat format);
+
+// Parse a report format name. Returns false if the name isn't recognised.
+bool parse_report_format(const std::string &name, ReportFormat &format);
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <yostat/parse.hpp>
+
+// Trigram index over the module names and instance names of a design.
+// Every instance in the tree is named by its module and, if the input named
+// it, its instance name. There are far fewer modules and distinct instance
+// names than instances, so searches work on the names and only look at the
+// tree to decide what to show. Building the index is linear in the total
+// length of the names, so it is simply rebuilt on reload.
+class SearchIndex {
+public:
+  explicit SearchIndex(const Design &design);
+
+  // Get the modules whose names contain the text, ignoring case
+  std::vector<const ModuleSummary *> find(const std::string &text) const;
+  // Get the ids of the instance names, in the design's string pool, that
+  // contain the text, ignoring case
+  std::vector<uint32_t> find_instances(const std::string &text) const;
+
+  size_t size() const { return _modules.size(); }
+
+private:
+  // Lower case names, and the indices of the names containing each trigram,
+  // in ascending order
+  struct Trigrams {
+    std::vector<std::string> names;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+
+    void add(const std::string &name);
+    // Indices of the names containing the text, which must be lower case
+    std::vector<uint32_t> find(const std::string &text) const;
+  };
+
+  std::vector<const ModuleSummary *> _modules;
+  // Module names indexed like _modules, and instance names indexed by id
+  Trigrams _module_names;
+  Trigrams _instance_names;
+};
+
+// The result of searching a design's hierarchy, which decides which nodes of
+// the tree a filtered view shows.
+// A query is one or more (up to 63) name fragments separated by '/'. A node
+// matches if the fragments are found, in order, in the names of the node and
+// the instances directly above it; e.g. "cpu/alu" matches any instance whose
+// name contains "alu" whose parent instance's name contains "cpu". An
+// instance's name is either its module's name or its instance name. [Nx]
+// holders and (self) rows aren't part of paths, and never match themselves.
+// Whether anything below a node matches is worked out per module rather than
+// per instance, and memoized, so nothing walks the whole tree. Only the
+// instances whose names match a fragment are looked at one by one.
+class SearchResult {
+public:
+  SearchResult(const SearchIndex &index, const Design &design,
+               const std::string &query);
+
+  // Whether a node matches the query
+  bool matches(const Module *m) const;
+  // Whether a filtered view should show a node, because it or something
+  // below it matches. The top module is always shown.
+  bool visible(const Module *m) const;
+
+  // Number of matching instances in the whole design, and of distinct
+  // modules among them
+  uint64_t instances() const { return _instances; }
+  size_t modules() const { return _matched_modules.size(); }
+
+private:
+  // Set of query fragments matched so far along a path, as a bitmask. Bit j
+  // means the path ends with instances matching fragments 0..j-1.
+  using State = uint64_t;
+
+  // State after stepping from a path in the given state into an instance of
+  // a module with the given instance name (or none)
+  State advance(State state, const ModuleSummary *summary,
+                uint32_t name) const;
+  bool is_match(State state) const {
+    return (state >> _fragments.size()) & 1;
+  }
+  // State of the path ending at a node. Holders take their parent's state.
+  State state_of(const Module *m) const;
+  // Number of matching instances strictly below an instance of a module
+  // reached in a given state. Also notes which modules match.
+  uint64_t below(const ModuleSummary *summary, State state) const;
+
+  std::vector<std::string> _fragments;
+  // Modules and instance names containing each fragment, and the instance
+  // names containing any of them
+  std::vector<std::unordered_set<const ModuleSummary *>> _fragment_modules;
+  std::vector<std::unordered_set<uint32_t>> _fragment_names;
+  std::unordered_set<uint32_t> _matched_names;
+  const ModuleSummary *_top;
+  uint64_t _instances = 0;
+  mutable std::unordered_set<const ModuleSummary *> _matched_modules;
+  mutable std::map<std::pair<const ModuleSummary *, State>, uint64_t> _below;
+};
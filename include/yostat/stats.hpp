@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+struct Design;
+
+// Measurements for one phase of loading or displaying a design
+struct PhaseStats {
+  std::string name;
+  double ms = 0;
+  // Heap allocations made during the phase by the thread running it, and by
+  // the parallel_for workers it started
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  // Peak RSS of the process during the phase in KiB, or -1 if unknown. Only
+  // known if no other phase ran at the same time, as RSS isn't per thread.
+  long peak_rss_kib = -1;
+};
+
+// Everything measured during one load of a design
+struct LoadStats {
+  std::vector<PhaseStats> phases;
+  // Whether the design came from the binary cache rather than the json
+  bool from_cache = false;
+  size_t file_size = 0;
+  // Number of modules in the json (zero if loaded from the cache), of those
+  // reachable from the top module, and of primitive types used
+  size_t modules = 0;
+  size_t summaries = 0;
+  size_t primitives = 0;
+  // Number of modules whose json was parsed. A reload only parses the modules
+  // that changed since the last load (see IngestState).
+  size_t parsed_modules = 0;
+
+  double total_ms() const;
+  uint64_t total_allocations() const;
+  long peak_rss_kib() const;
+};
+
+// Size of the generated part of a module tree
+struct TreeStats {
+  size_t nodes = 0;
+  // Nodes whose children have been generated
+  size_t expanded = 0;
+  // Nodes generated by expanding an [Nx] holder into its instances
+  size_t instances = 0;
+};
+
+// Walk the generated part of a design's module tree
+TreeStats tree_stats(const Design &design);
+
+// Measures a phase from construction until finish() or destruction, and
+// appends the result to stats. If stats is nullptr, nothing is measured.
+// Peak RSS is tracked for the whole process, so a phase that overlaps another
+// (nested, or on another thread) leaves it unknown.
+class ScopedPhase {
+public:
+  ScopedPhase(LoadStats *stats, const char *name);
+  ScopedPhase(const ScopedPhase &) = delete;
+  ScopedPhase &operator=(const ScopedPhase &) = delete;
+  ~ScopedPhase() { finish(); }
+
+  void finish();
+
+private:
+  LoadStats *_stats;
+  const char *_name;
+  uint64_t _allocations = 0;
+  uint64_t _allocated_bytes = 0;
+  // Value of the phase counter when this phase started, or 0 if peak RSS
+  // wasn't reset for it
+  uint64_t _rss_phase = 0;
+  std::chrono::steady_clock::time_point _start;
+};
+
+// While one of these exists, phases leave peak RSS alone, for loads running
+// side by side whose peaks can't be told apart. peak_rss_kib() then gives
+// the peak since the first of them was created, covering all the loads.
+class SharedPeakRss {
+public:
+  SharedPeakRss();
+  SharedPeakRss(const SharedPeakRss &) = delete;
+  SharedPeakRss &operator=(const SharedPeakRss &) = delete;
+  ~SharedPeakRss();
+};
+
+// Heap allocations made so far by the calling thread, plus those of the
+// parallel_for workers it has run. Zero unless the program links in the
+// replacement operator new from yostat_allocations.cpp.
+uint64_t allocation_count();
+uint64_t allocated_bytes();
+// Count an allocation against the calling thread
+void count_allocation(size_t size);
+// Count allocations made by a worker thread against the calling thread
+void add_allocations(uint64_t count, uint64_t bytes);
+
+// Current and peak RSS of the process in KiB, or -1 where unavailable
+long current_rss_kib();
+long peak_rss_kib();
+// Restart peak RSS tracking from the current RSS, where supported
+void reset_peak_rss();
+
+// Machine readable versions of the stats
+nlohmann::json stats_json(const PhaseStats &phase);
+nlohmann::json stats_json(const LoadStats &stats);
+nlohmann::json stats_json(const TreeStats &tree);
+
+// One line summary of a load, e.g. for a status bar
+std::string format_stats_summary(const LoadStats &stats);
+// Multi-line breakdown of a load, with a line per phase
+std::string format_stats_report(const LoadStats &stats,
+                                const TreeStats &tree);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Interned strings, each stored once and referred to by a dense id.
+// The characters of every string are kept back to back in one buffer, with
+// an offset per string and an open addressing index over the ids, so a pool
+// costs little more than the distinct strings themselves however many times
+// each one is interned.
+class StringPool {
+public:
+  // Id that refers to no string
+  static constexpr uint32_t none = UINT32_MAX;
+
+  // Get the id of a string, adding it to the pool if it isn't there yet. Ids
+  // are handed out in order, starting from 0.
+  uint32_t intern(const char *data, size_t count);
+  uint32_t intern(const std::string &s) { return intern(s.data(), s.size()); }
+
+  // Get the id of a string, or none if it isn't in the pool
+  uint32_t find(const std::string &s) const;
+
+  // Get the string with a given id
+  std::string str(uint32_t id) const {
+    return std::string(_chars.data() + _offsets[id], length(id));
+  }
+  size_t length(uint32_t id) const {
+    return _offsets[id + 1] - _offsets[id];
+  }
+
+  // Number of distinct strings in the pool
+  size_t size() const { return _offsets.size() - 1; }
+
+  // Bytes used by the pool
+  size_t memory() const {
+    return _chars.capacity() + _offsets.capacity() * sizeof(uint32_t) +
+           _index.capacity() * sizeof(uint32_t);
+  }
+
+private:
+  // Index slot for a string: either the slot holding its id, or the empty
+  // slot it would go in
+  size_t slot(const char *data, size_t count) const;
+  void grow();
+
+  std::vector<char> _chars;
+  // Start of each string in _chars, and the end of the last one
+  std::vector<uint32_t> _offsets = {0};
+  // Ids by hash, with none in empty slots. Kept at most half full.
+  std::vector<uint32_t> _index;
+};
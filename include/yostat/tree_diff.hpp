@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <yostat/parse.hpp>
+
+// Receives the changes made to a module tree by update_design.
+// Notifications are batched per parent node, and are delivered once the tree
+// has been updated to reflect them. Deleted nodes are freed when
+// update_design returns, after which only their addresses can be used, e.g.
+// as view item ids.
+class TreeDiffListener {
+public:
+  virtual ~TreeDiffListener() {}
+  virtual void items_added(Module *parent,
+                           const std::vector<Module *> &items) = 0;
+  virtual void items_deleted(Module *parent,
+                             const std::vector<Module *> &items) = 0;
+  virtual void items_changed(const std::vector<Module *> &items) = 0;
+};
+
+// Summary of the work done by update_design
+struct TreeDiffStats {
+  // Nodes compared between the two trees
+  size_t visited = 0;
+  // Nodes whose subtrees were identical, and so were not compared
+  size_t skipped = 0;
+  size_t added = 0;
+  size_t deleted = 0;
+  size_t changed = 0;
+};
+
+// Whether two nodes would display the same values and generate identical
+// subtrees, without walking them. Only meaningful for nodes from designs with
+// the same primitive list.
+bool same_subtree(const Module *a, const Module *b);
+
+// Update a design in place to match another one, preserving as many of the
+// existing tree nodes as possible so that any view state attached to them
+// survives. Only the parts of the tree that have been generated in dst are
+// compared. Children are matched by name through a hash table, and subtrees
+// with identical structure hashes are only walked to point them at the new
+// summaries, reporting any instances whose names changed.
+// Nodes that only exist in src are copied into dst, and dst takes over the
+// module summaries and string pool of src. src can be discarded afterwards.
+TreeDiffStats update_design(Design &dst, Design &src,
+                            TreeDiffListener &listener);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+
+#include <wx/dataview.h>
+#include <wx/wx.h>
+
+#include <yostat/compare.hpp>
+
+// Data model showing several designs side by side. Column 0 is the module
+// name, followed by one group of primitive columns per design. In delta mode,
+// the first design is a baseline for the second, and each primitive gets a
+// group of baseline, candidate, change and percentage change columns.
+class YostatCompareModel : public wxDataViewModel {
+public:
+  YostatCompareModel(DesignComparison *comparison, bool delta)
+      : _comparison(comparison), _delta(delta) {}
+
+  // Leave out children that are the same in every design. Call Cleared()
+  // after changing this.
+  void set_hide_unchanged(bool hide) { _hide_unchanged = hide; }
+
+  /* wxDataViewModel overrides */
+  bool HasContainerColumns(const wxDataViewItem &item) const override;
+  bool IsContainer(const wxDataViewItem &item) const override;
+  wxDataViewItem GetParent(const wxDataViewItem &item) const override;
+  unsigned int GetColumnCount() const override;
+  wxString GetColumnType(unsigned int col) const override;
+  unsigned int GetChildren(const wxDataViewItem &item,
+                           wxDataViewItemArray &children) const override;
+  void GetValue(wxVariant &variant, const wxDataViewItem &item,
+                unsigned int col) const;
+  bool SetValue(const wxVariant &variant, const wxDataViewItem &item,
+                unsigned int col);
+  int Compare(const wxDataViewItem &item1, const wxDataViewItem &item2,
+              unsigned int column, bool ascending) const override;
+
+  // Number of columns per primitive in delta mode
+  static const unsigned DELTA_COLUMNS = 4;
+
+private:
+  DesignComparison *_comparison;
+  bool _delta;
+  bool _hide_unchanged = false;
+};
+
+class YostatCompareFrame : public wxFrame {
+public:
+  // Takes ownership of the comparison. In delta mode, the comparison must be
+  // of exactly two designs.
+  YostatCompareFrame(DesignComparison *comparison, bool delta = false);
+  DECLARE_EVENT_TABLE();
+
+  void on_dataview_item_activated(wxDataViewEvent &evt);
+  void toggle_hide_unchanged(wxCommandEvent &evt);
+
+private:
+  void create_columns();
+
+  std::unique_ptr<DesignComparison> _comparison;
+  bool _delta;
+  wxDataViewCtrl *_dataview;
+  YostatCompareModel *_datamodel;
+};
@@ -1,13 +1,25 @@
 #pragma once
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #include <wx/dataview.h>
+#include <wx/filedlg.h>
+#include <wx/srchctrl.h>
 #include <wx/wx.h>
 
+#include <yostat/async_loader.hpp>
+#include <yostat/cost.hpp>
+#include <yostat/file_watcher.hpp>
+#include <yostat/history.hpp>
 #include <yostat/parse.hpp>
+#include <yostat/search.hpp>
+#include <yostat/yostat_wx_rank.hpp>
 
 class YostatDataModel : public wxDataViewModel {
 public:
-  YostatDataModel(Design *d) : _design(d) {}
+  YostatDataModel(Design *d) : _design(d) { update_categories(); }
   ~YostatDataModel();
 
   /* wxDataViewModel overrides */
@@ -22,25 +34,174 @@ public:
                 unsigned int col) const;
   bool SetValue(const wxVariant &variant, const wxDataViewItem &item,
                 unsigned int col);
+  // Sorts siblings by comparing their positions in an ordering worked out
+  // once per node and column, rather than by going through GetValue
+  int Compare(const wxDataViewItem &item1, const wxDataViewItem &item2,
+              unsigned int column, bool ascending) const override;
 
   void set_design(Design *d);
   Design *get_design();
 
+  // Called when the view collapses an item. If more nodes have been generated
+  // than the budget allows, the item's subtree is freed.
+  void item_collapsed(const wxDataViewItem &item);
+
+  // Only show instances matching a query, and the modules above them. An
+  // empty query shows everything again.
+  void set_filter(const std::string &query);
+  // The current filter, or nullptr if everything is shown
+  const SearchResult *get_filter() const { return _filter.get(); }
+
+  // If the design's family is known, the primitive columns are followed by
+  // a column for each category of primitive the design uses, totalling its
+  // primitives of that category
+  unsigned num_categories() const { return _categories.size(); }
+  PrimitiveCategory category(unsigned i) const { return _categories[i]; }
+
+  // Add cost and device use columns after the categories, worked out with
+  // the given model, or remove them if it is nullptr. The model must outlive
+  // the data model or the next call.
+  void set_cost_model(const CostModel *model);
+  // Number of columns a cost model adds, and the first of them
+  static constexpr unsigned cost_columns = 2;
+  unsigned first_cost_column() const {
+    return _design->primitives.size() + 1 + _categories.size();
+  }
+
+  // Add a column showing how the module of each row changed over the most
+  // recent builds in a history store, or remove it if nullptr. The store must
+  // outlive the data model or the next call.
+  void set_history(const HistoryStore *history) { _history = history; }
+  // Follow a primitive in the trend column, or the total over every
+  // primitive if the name is empty
+  void set_trend_primitive(const std::string &primitive) {
+    _trend_primitive = primitive;
+  }
+  // The trend column comes after the cost model columns, if there are any
+  unsigned trend_column() const {
+    return first_cost_column() + (_costs ? cost_columns : 0);
+  }
+  // Number of builds the trend column shows
+  static constexpr size_t trend_builds = 60;
+
 private:
+  friend class YostatDiffListener;
+
+  // Number of generated nodes above which collapsed subtrees are freed
+  static constexpr size_t node_budget = 500000;
+
+  // Number of changes above which set_design has wx rebuild the whole view
+  // rather than applying each change
+  static constexpr size_t clear_threshold = 1000;
+
+  // Rebuild the filter for the current design and query
+  void apply_filter();
+  // Work out the category columns for the current design
+  void update_categories();
+
+  // Value shown in a numeric column
+  double get_number(const Module *node, unsigned col) const;
+  // Counts shown in the trend column
+  void get_trend(wxVariant &variant, const Module *node) const;
+
+  // The children of a node in sorted order, for each column sorted by so far
+  struct ChildOrder {
+    // Position of each child in the node's child list
+    std::unordered_map<const Module *, uint32_t> index;
+    // Per column, the rank of each child when sorted ascending, by child list
+    // position. Empty for columns that haven't been sorted by.
+    std::vector<std::vector<uint32_t>> ranks;
+  };
+  // Get the order of a node's children, working out the ranks for a column
+  // if they aren't known yet
+  const ChildOrder &sorted_children(const Module *node, unsigned col) const;
+  // Drop the child orders of a node, or of a node and everything below it,
+  // after their children or values change
+  void forget_order(const Module *node) { _orders.erase(node); }
+  void forget_orders_below(const Module *node);
+
   Design *_design;
+  // Category of each primitive, and the categories that have columns
+  std::vector<PrimitiveCategory> _primitive_categories;
+  std::vector<PrimitiveCategory> _categories;
+  const CostModel *_cost_model = nullptr;
+  std::unique_ptr<CostColumns> _costs;
+  const HistoryStore *_history = nullptr;
+  std::string _trend_primitive;
+  std::string _query;
+  // Built the first time a filter is set for a design
+  std::unique_ptr<SearchIndex> _index;
+  std::unique_ptr<SearchResult> _filter;
+  // Filled in as the view sorts, and kept across reloads for the nodes that
+  // didn't change, so that sorting by a column again is cheap
+  mutable std::unordered_map<const Module *, ChildOrder> _orders;
 };
 
 class YostatWxPanel : public wxFrame {
 public:
-  YostatWxPanel(std::string filename, Design *d);
+  YostatWxPanel(std::string filename, Design *d, bool watch = false,
+                const LoadOptions &options = LoadOptions());
   DECLARE_EVENT_TABLE();
 
   void create_columns_for_design(Design *design, bool sort);
   void on_dataview_item_activated(wxDataViewEvent &evt);
+  void on_dataview_item_collapsed(wxDataViewEvent &evt);
+  void on_dataview_column_sorted(wxDataViewEvent &evt);
+  void on_search(wxCommandEvent &evt);
   void reload(wxCommandEvent &evt);
+  void toggle_watch(wxCommandEvent &evt);
+  void show_load_stats(wxCommandEvent &evt);
+  void show_top_contributors(wxCommandEvent &evt);
+  void load_cost_model(wxCommandEvent &evt);
+  void select_cost_model(wxCommandEvent &evt);
+
+  // Add a cost model to the Cost menu and switch to it
+  void add_cost_model(const CostModel &model);
+  // Add a trend column from a history store opened from a path, which is
+  // opened again on each reload to pick up any builds recorded since
+  void set_history(const std::string &path,
+                   std::unique_ptr<HistoryStore> history);
 
 private:
+  // Start re-reading the input file in the background
+  void start_reload();
+  // Swap in a design loaded by start_reload
+  void finish_reload(Design *d, uint64_t generation);
+  // Enable or disable automatic reloads when the input file changes
+  void set_watching(bool watch);
+  // Expand the filtered tree far enough to show the first few matches
+  void expand_matches();
+  // Switch to a loaded cost model by index, or hide the cost columns if the
+  // index is negative
+  void use_cost_model(int index);
+  void append_cost_columns();
+  wxString cost_column_title() const;
+  void append_trend_column();
+  // Have the trend column follow the primitive being sorted by, if any
+  void update_trend_column();
+  // Get the view column showing a model column, or nullptr if there isn't one
+  wxDataViewColumn *find_column(unsigned model_column) const;
+  // Select a ranked instance in the tree, expanding everything above it
+  void show_instance(const RankEntry &entry);
+  // Show the load summary, or the number of matches when filtering
+  void update_status();
+
   const std::string _filename;
+  wxSearchCtrl *_search;
   wxDataViewCtrl *_dataview;
   YostatDataModel *_datamodel;
+  YostatRankDialog *_rank_dialog = nullptr;
+  wxMenu *_cost_menu;
+  std::vector<std::unique_ptr<CostModel>> _cost_models;
+  // Index of the cost model in use, or -1 for none
+  int _cost_model = -1;
+  std::string _history_path;
+  std::unique_ptr<HistoryStore> _history;
+  // Measurements from the most recent load, including the time taken to
+  // update the view afterwards
+  LoadStats _load_stats;
+  // Declared after everything their callbacks touch, so that they are
+  // destroyed (and their threads joined) first
+  AsyncLoader _loader;
+  std::unique_ptr<FileWatcher> _watcher;
 };
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <wx/checkbox.h>
+#include <wx/choice.h>
+#include <wx/dialog.h>
+#include <wx/listctrl.h>
+#include <wx/spinctrl.h>
+#include <wx/wx.h>
+
+#include <yostat/parse.hpp>
+#include <yostat/rank.hpp>
+
+// Window listing the heaviest contributors to a design (see
+// rank_contributors). The query is rerun whenever one of the controls
+// changes, and activating a result reports it back to the owner so that it
+// can be shown in the tree.
+class YostatRankDialog : public wxDialog {
+public:
+  using ActivateFn = std::function<void(const RankEntry &)>;
+
+  YostatRankDialog(wxWindow *parent, Design *design, ActivateFn activate);
+  DECLARE_EVENT_TABLE();
+
+  // Switch to a reloaded design, keeping the current settings where they
+  // still apply
+  void set_design(Design *design);
+
+  void on_query_changed(wxCommandEvent &evt);
+  void on_item_activated(wxListEvent &evt);
+  void on_close(wxCloseEvent &evt);
+
+private:
+  // Fill the primitive list from the design
+  void update_primitives();
+  // Rerun the query and show the results
+  void update_results();
+
+  Design *_design;
+  ActivateFn _activate;
+  wxChoice *_primitive;
+  wxSpinCtrl *_count;
+  wxCheckBox *_self;
+  wxCheckBox *_modules;
+  wxListCtrl *_results;
+  RankQuery _query;
+  std::vector<RankEntry> _entries;
+};
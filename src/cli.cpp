@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <yostat/daemon.hpp>
+#include <yostat/history.hpp>
+#include <yostat/parse.hpp>
+#include <yostat/query.hpp>
+#include <yostat/stats.hpp>
+
+// Headless entry point. Loads a design and writes the aggregated hierarchy as
+// a report, without touching any GUI toolkit. Given several designs, loads
+// them in parallel and writes a single report comparing them side by side.
+// Given a baseline and one other design, writes the change from one to the
+// other. With --top, writes the heaviest contributors to a design instead of
+// the hierarchy. With --serve, keeps designs loaded and answers the same
+// queries from other invocations run with --connect (see daemon.hpp). With
+// --history, records the designs as builds in a history store, or given no
+// designs, reports how a module changed over the builds in the store.
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: yostat-cli [options] [json file]...\n"
+          "Options:\n"
+          "  -f, --format FORMAT      Report format: text, csv or json "
+          "(default text)\n"
+          "  -d, --depth N            Only report N levels below the top "
+          "module\n"
+          "  -p, --primitives A,B,... Only report the listed primitives\n"
+          "  -a, --all-instances      Report every instance under an [Nx] "
+          "holder\n"
+          "  -s, --search QUERY       Only report instances whose names "
+          "match QUERY (e.g. cpu/alu),\n"
+          "                           and the modules above them\n"
+          "  -c, --cost-model FILE    Add weighted cost and device use "
+          "columns from a cost model\n"
+          "  -o, --output FILE        Write the report to FILE instead of "
+          "stdout\n"
+          "  -b, --baseline FILE      Report the change from FILE to the "
+          "single other json file\n"
+          "      --changed-only       Leave out parts of the hierarchy that "
+          "are the same in every file\n"
+          "      --sort-delta         With --baseline, list the modules that "
+          "grew most first\n"
+          "  -t, --top N              List the N instances using the most of "
+          "the --rank primitives\n"
+          "  -r, --rank A[=W],...     Primitives to rank by for --top, with "
+          "optional weights\n"
+          "                           (default the cost model's costs, or "
+          "every primitive, weight 1)\n"
+          "      --self               With --top, rank the logic used by "
+          "each module itself\n"
+          "      --modules            With --top, rank module definitions "
+          "over all their instances\n"
+          "      --blackboxes A,B,... Count these cell types as primitives, "
+          "e.g. for netlists\n"
+          "                           without blackbox attributes\n"
+          "      --family NAME        Count the cell types of an FPGA family "
+          "as primitives, and add\n"
+          "                           a column for each category of "
+          "primitive (ecp5, ice40, gowin\n"
+          "                           or xc7)\n"
+          "      --subtree PATH       Only report the instance at PATH (e.g. "
+          "top/cpu/alu) and below\n"
+          "      --serve SOCKET       Keep designs loaded and answer queries "
+          "on a Unix socket\n"
+          "      --connect SOCKET     Ask the daemon on SOCKET instead of "
+          "loading the json files\n"
+          "      --history FILE       Record the json files as builds in "
+          "a history store, or with no\n"
+          "                           json files, report how a module "
+          "changed over its builds\n"
+          "      --label NAME         Name of the build recorded with "
+          "--history (default the file name)\n"
+          "      --trend MODULE       With --history, report MODULE rather "
+          "than the top module\n"
+          "      --last N             With --history, only report the last "
+          "N builds\n"
+          "      --exceeds PRIM=N     With --history, report the first build "
+          "using more than N of PRIM\n"
+          "  -j, --jobs N             Load up to N json files at once "
+          "(default one per core)\n"
+          "      --no-cache           Don't read or write .yostat cache "
+          "files\n"
+          "      --stats              Write load timings and memory use to "
+          "stderr as json\n"
+          "  -h, --help               Show this message\n");
+}
+
+// Daemon being run by --serve, for the signal handler to stop
+static QueryDaemon *running_daemon = nullptr;
+
+static void stop_daemon(int) { running_daemon->stop(); }
+
+// Make a path absolute, so that a daemon with a different working directory
+// finds the same file
+static std::string absolute_path(const std::string &path) {
+  if (path.empty() || path[0] == '/') {
+    return path;
+  }
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    return path;
+  }
+  return std::string(cwd) + "/" + path;
+}
+
+// Record designs as builds in a history store, each labelled with its file
+// name unless a label is given, and timestamped with the time the file was
+// last modified
+static bool record_history(const std::string &store,
+                           const std::vector<std::string> &files,
+                           const std::string &label,
+                           const LoadOptions &load_options, unsigned jobs) {
+  if (!label.empty() && files.size() != 1) {
+    fprintf(stderr, "--label needs a single json file\n");
+    return false;
+  }
+  std::vector<Design *> loaded = read_json_files(files, load_options, jobs);
+  bool ok = true;
+  for (size_t i = 0; i < files.size(); i++) {
+    std::unique_ptr<Design> design(loaded[i]);
+    if (!design) {
+      fprintf(stderr, "Failed to parse input file '%s'\n", files[i].c_str());
+      ok = false;
+      continue;
+    }
+    HistoryBuild build;
+    build.label = label.empty() ? files[i].substr(files[i].rfind('/') + 1)
+                                : label;
+    struct stat st;
+    build.timestamp = stat(files[i].c_str(), &st) == 0 ? st.st_mtime : 0;
+    bool appended;
+    std::string error;
+    if (!append_history(store, *design, build, appended, error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      ok = false;
+    } else if (!appended) {
+      fprintf(stderr, "'%s' is already in %s\n", build.label.c_str(),
+              store.c_str());
+    } else {
+      fprintf(stderr, "Recorded '%s' in %s\n", build.label.c_str(),
+              store.c_str());
+    }
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  Query query;
+  ReportOptions &options = query.options;
+  std::string output_file;
+  unsigned jobs = 0;
+  LoadOptions load_options;
+  bool show_stats = false;
+  std::string serve_socket;
+  std::string connect_socket;
+  std::string history_store;
+  std::string history_label;
+  HistoryQuery history_query;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    // Fetch the value for options that take one
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing value for %s\n", arg.c_str());
+        exit(EXIT_FAILURE);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return EXIT_SUCCESS;
+    } else if (arg == "-f" || arg == "--format") {
+      const std::string format = value();
+      if (!parse_report_format(format, options.format)) {
+        fprintf(stderr, "Unknown report format '%s'\n", format.c_str());
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "-d" || arg == "--depth") {
+      options.max_depth = atoi(value().c_str());
+    } else if (arg == "-p" || arg == "--primitives") {
+      std::stringstream list(value());
+      std::string primitive;
+      while (std::getline(list, primitive, ',')) {
+        if (!primitive.empty()) {
+          options.primitives.emplace_back(primitive);
+        }
+      }
+    } else if (arg == "-a" || arg == "--all-instances") {
+      options.all_instances = true;
+    } else if (arg == "-s" || arg == "--search") {
+      options.search = value();
+    } else if (arg == "-c" || arg == "--cost-model") {
+      query.cost_model = value();
+    } else if (arg == "-o" || arg == "--output") {
+      output_file = value();
+    } else if (arg == "-b" || arg == "--baseline") {
+      query.baseline = value();
+    } else if (arg == "--changed-only") {
+      options.changed_only = true;
+    } else if (arg == "--sort-delta") {
+      options.sort_by_delta = true;
+    } else if (arg == "-t" || arg == "--top") {
+      query.rank = true;
+      query.rank_query.count = std::max(0, atoi(value().c_str()));
+    } else if (arg == "-r" || arg == "--rank") {
+      query.rank_weights = value();
+    } else if (arg == "--self") {
+      query.rank_query.self = true;
+    } else if (arg == "--modules") {
+      query.rank_query.modules = true;
+    } else if (arg == "--subtree") {
+      query.subtree = value();
+    } else if (arg == "--blackboxes") {
+      std::stringstream list(value());
+      std::string primitive;
+      while (std::getline(list, primitive, ',')) {
+        if (!primitive.empty()) {
+          load_options.primitives.emplace(primitive);
+        }
+      }
+    } else if (arg == "--family") {
+      const std::string family = value();
+      load_options.family = find_family(family);
+      if (!load_options.family) {
+        std::string names;
+        for (auto &name : family_names()) {
+          names += (names.empty() ? "" : ", ") + name;
+        }
+        fprintf(stderr, "Unknown family '%s' (expected one of %s)\n",
+                family.c_str(), names.c_str());
+        return EXIT_FAILURE;
+      }
+      options.categories = true;
+    } else if (arg == "--serve") {
+      serve_socket = value();
+    } else if (arg == "--connect") {
+      connect_socket = value();
+    } else if (arg == "--history") {
+      history_store = value();
+    } else if (arg == "--label") {
+      history_label = value();
+    } else if (arg == "--trend") {
+      history_query.module = value();
+    } else if (arg == "--last") {
+      history_query.last = std::max(0, atoi(value().c_str()));
+    } else if (arg == "--exceeds") {
+      const std::string threshold = value();
+      const size_t equals = threshold.rfind('=');
+      if (equals == std::string::npos || equals == 0) {
+        fprintf(stderr, "Expected PRIMITIVE=N for --exceeds, not '%s'\n",
+                threshold.c_str());
+        return EXIT_FAILURE;
+      }
+      history_query.threshold_primitive = threshold.substr(0, equals);
+      history_query.threshold = atoi(threshold.c_str() + equals + 1);
+    } else if (arg == "-j" || arg == "--jobs") {
+      jobs = atoi(value().c_str());
+    } else if (arg == "--no-cache") {
+      load_options.cache = false;
+    } else if (arg == "--stats") {
+      show_stats = true;
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      fprintf(stderr, "Unknown option '%s'\n", arg.c_str());
+      usage();
+      return EXIT_FAILURE;
+    } else {
+      query.files.emplace_back(arg);
+    }
+  }
+
+  std::string error;
+  if (!serve_socket.empty()) {
+    QueryDaemon daemon(load_options);
+    if (!daemon.listen(serve_socket, error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return EXIT_FAILURE;
+    }
+    running_daemon = &daemon;
+    signal(SIGINT, stop_daemon);
+    signal(SIGTERM, stop_daemon);
+    // Clients that hang up early shouldn't take the daemon down with them
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Listening on %s\n", serve_socket.c_str());
+    daemon.run();
+    return EXIT_SUCCESS;
+  }
+
+  if (!history_store.empty() && !query.files.empty()) {
+    return record_history(history_store, query.files, history_label,
+                          load_options, jobs)
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+  }
+  if (history_store.empty() &&
+      (!history_query.module.empty() || history_query.last ||
+       !history_query.threshold_primitive.empty())) {
+    fprintf(stderr, "--trend, --last and --exceeds need --history\n");
+    return EXIT_FAILURE;
+  }
+  if (query.files.empty() && history_store.empty()) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  if (history_store.empty() && !check_query(query, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return EXIT_FAILURE;
+  }
+
+  // Run the report on the stream, or fail with a message
+  std::function<bool(std::ostream &)> report;
+  nlohmann::json response;
+  std::vector<std::shared_ptr<Design>> designs;
+  LoadStats report_stats;
+  // Peak RSS while loading every input, which covers loads run side by side
+  long load_peak_rss_kib = -1;
+  HistoryStore history;
+  if (!history_store.empty()) {
+    // Reports from the store don't need the json files at all
+    if (!connect_socket.empty()) {
+      fprintf(stderr, "--history isn't available with --connect\n");
+      return EXIT_FAILURE;
+    }
+    if (!history.open(history_store, error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return EXIT_FAILURE;
+    }
+    history_query.primitives = options.primitives;
+    report = [&](std::ostream &os) {
+      ScopedPhase phase(&report_stats, "report");
+      HistoryTrend trend;
+      if (!history_trend(history, history_query, trend, error)) {
+        return false;
+      }
+      write_history_report(os, history, trend, options.format);
+      return true;
+    };
+  } else if (!connect_socket.empty()) {
+    if (show_stats) {
+      fprintf(stderr, "--stats isn't available with --connect\n");
+      return EXIT_FAILURE;
+    }
+    // Label comparisons with the paths as given, like a local report
+    query.labels = query.inputs();
+    for (std::string &file : query.files) {
+      file = absolute_path(file);
+    }
+    query.baseline = absolute_path(query.baseline);
+    query.cost_model = absolute_path(query.cost_model);
+    if (!send_request(connect_socket, query_json(query), response, error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return EXIT_FAILURE;
+    }
+    if (!response.value("ok", false)) {
+      fprintf(stderr, "%s\n", response.value("error", "").c_str());
+      return EXIT_FAILURE;
+    }
+    report = [&](std::ostream &os) {
+      os << response.value("output", "");
+      return true;
+    };
+  } else {
+    const std::vector<std::string> inputs = query.inputs();
+    std::vector<Design *> loaded = read_json_files(inputs, load_options, jobs);
+    load_peak_rss_kib = peak_rss_kib();
+    bool failed = false;
+    for (size_t i = 0; i < loaded.size(); i++) {
+      if (loaded[i]) {
+        load_peak_rss_kib =
+            std::max(load_peak_rss_kib, loaded[i]->stats.peak_rss_kib());
+      } else {
+        fprintf(stderr, "Failed to parse input file '%s'\n",
+                inputs[i].c_str());
+        failed = true;
+      }
+    }
+    if (failed) {
+      for (Design *d : loaded) {
+        delete d;
+      }
+      return EXIT_FAILURE;
+    }
+    for (Design *d : loaded) {
+      designs.emplace_back(d);
+    }
+    report = [&](std::ostream &os) {
+      ScopedPhase phase(&report_stats, "report");
+      return run_query(query, designs, os, error);
+    };
+  }
+
+  bool ok;
+  if (output_file.empty()) {
+    ok = report(std::cout);
+  } else {
+    std::ofstream output(output_file);
+    if (!output) {
+      fprintf(stderr, "Failed to open '%s' for writing\n", output_file.c_str());
+      return EXIT_FAILURE;
+    }
+    ok = report(output);
+  }
+  if (!ok) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return EXIT_FAILURE;
+  }
+
+  if (show_stats) {
+    const std::vector<std::string> inputs = query.inputs();
+    nlohmann::json stats;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      Design &d = *designs[i];
+      nlohmann::json input = stats_json(d.stats);
+      input["path"] = inputs[i];
+      input["tree"] = stats_json(tree_stats(d));
+      stats["inputs"].emplace_back(input);
+    }
+    stats["load_peak_rss_kib"] = load_peak_rss_kib;
+    stats["report"] = stats_json(report_stats.phases.at(0));
+    std::cerr << stats.dump(2) << "\n";
+  }
+
+  return EXIT_SUCCESS;
+}
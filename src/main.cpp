@@ -1,7 +1,14 @@
+#include <memory>
+#include <sstream>
+
 #include <wx/cmdline.h>
 #include <wx/wx.h>
 
+#include <yostat/compare.hpp>
+#include <yostat/cost.hpp>
+#include <yostat/history.hpp>
 #include <yostat/parse.hpp>
+#include <yostat/yostat_wx_compare.hpp>
 #include <yostat/yostat_wx_panel.hpp>
 
 class YostatApp : public wxApp {
@@ -12,7 +19,15 @@ public:
 
 private:
   YostatWxPanel *_panel = nullptr;
-  std::string _json_file;
+  std::vector<std::string> _json_files;
+  bool _watch = false;
+  // Set when the first file is a baseline for the second
+  bool _delta = false;
+  // Cost model to start with, if any
+  std::string _cost_model_file;
+  // History store to show trends from, if any
+  std::string _history_file;
+  LoadOptions _load_options;
 };
 
 bool YostatApp::OnInit() {
@@ -20,24 +35,94 @@ bool YostatApp::OnInit() {
   if (!wxApp::OnInit())
     return false;
 
-  // Attempt to parse the given file
-  fprintf(stderr, "Parsing input from '%s'...\n", _json_file.c_str());
-  Design *d = read_json(_json_file);
-  if (!d) {
-    fprintf(stderr, "Failed to parse input file '%s'\n", _json_file.c_str());
+  // A single file may be reloaded, so keep what we parse for next time
+  if (_json_files.size() == 1) {
+    _load_options.previous = std::make_shared<IngestState>();
+  }
+
+  // Attempt to parse the given files, all at once if there are several
+  for (auto &json_file : _json_files) {
+    fprintf(stderr, "Parsing input from '%s'...\n", json_file.c_str());
+  }
+  std::vector<Design *> designs = read_json_files(_json_files, _load_options);
+  bool failed = false;
+  for (size_t i = 0; i < designs.size(); i++) {
+    if (!designs[i]) {
+      fprintf(stderr, "Failed to parse input file '%s'\n",
+              _json_files[i].c_str());
+      failed = true;
+    }
+  }
+  if (failed) {
+    for (Design *d : designs) {
+      delete d;
+    }
     return false;
   }
 
-  // If we loaded it OK, display the data
-  _panel = new YostatWxPanel(_json_file, d);
+  // If we loaded OK, display the data. Several designs are shown side by side.
+  if (designs.size() > 1) {
+    YostatCompareFrame *frame = new YostatCompareFrame(
+        new DesignComparison(designs, _json_files), _delta);
+    frame->Show(true);
+    return true;
+  }
+  CostModel cost_model;
+  std::string error;
+  if (!_cost_model_file.empty() &&
+      !read_cost_model(_cost_model_file, cost_model, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    delete designs[0];
+    return false;
+  }
+  std::unique_ptr<HistoryStore> history;
+  if (!_history_file.empty()) {
+    history.reset(new HistoryStore);
+    if (!history->open(_history_file, error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      delete designs[0];
+      return false;
+    }
+  }
+  _panel =
+      new YostatWxPanel(_json_files[0], designs[0], _watch, _load_options);
+  if (!_cost_model_file.empty()) {
+    _panel->add_cost_model(cost_model);
+  }
+  if (history) {
+    _panel->set_history(_history_file, std::move(history));
+  }
   _panel->Show(true);
   return true;
 }
 
 void YostatApp::OnInitCmdLine(wxCmdLineParser &parser) {
   static const wxCmdLineEntryDesc cli_args[] = {
-      {wxCMD_LINE_PARAM, nullptr, nullptr, "[json file]", wxCMD_LINE_VAL_STRING,
-       wxCMD_LINE_OPTION_MANDATORY},
+      {wxCMD_LINE_SWITCH, "w", "watch",
+       "Reload automatically when the json file changes", wxCMD_LINE_VAL_NONE,
+       0},
+      {wxCMD_LINE_OPTION, "b", "baseline",
+       "Show the change from this json file to the other one",
+       wxCMD_LINE_VAL_STRING, 0},
+      {wxCMD_LINE_OPTION, "c", "cost-model",
+       "Add cost and device use columns from this cost model",
+       wxCMD_LINE_VAL_STRING, 0},
+      {wxCMD_LINE_OPTION, nullptr, "history",
+       "Add a column with the trend of each module over the builds recorded "
+       "in this history store (see yostat-cli --history)",
+       wxCMD_LINE_VAL_STRING, 0},
+      {wxCMD_LINE_OPTION, nullptr, "blackboxes",
+       "Count these comma separated cell types as primitives",
+       wxCMD_LINE_VAL_STRING, 0},
+      {wxCMD_LINE_OPTION, nullptr, "family",
+       "Count the cell types of this FPGA family (ecp5, ice40, gowin or xc7) "
+       "as primitives, and add a column for each category of primitive",
+       wxCMD_LINE_VAL_STRING, 0},
+      {wxCMD_LINE_SWITCH, nullptr, "no-cache",
+       "Don't read or write .yostat cache files", wxCMD_LINE_VAL_NONE, 0},
+      {wxCMD_LINE_PARAM, nullptr, nullptr, "[json file]...",
+       wxCMD_LINE_VAL_STRING,
+       wxCMD_LINE_OPTION_MANDATORY | wxCMD_LINE_PARAM_MULTIPLE},
       {wxCMD_LINE_NONE, nullptr, nullptr, nullptr, wxCMD_LINE_VAL_NONE, 0}};
 
   parser.SetDesc(cli_args);
@@ -45,11 +130,50 @@ void YostatApp::OnInitCmdLine(wxCmdLineParser &parser) {
 }
 
 bool YostatApp::OnCmdLineParsed(wxCmdLineParser &parser) {
-  if (parser.GetParamCount() != 1) {
-    fprintf(stderr, "Usage: yostat [json file]\n");
+  if (parser.GetParamCount() < 1) {
+    fprintf(stderr, "Usage: yostat [json file]...\n");
     return false;
   }
-  _json_file = std::string(parser.GetParam(0));
+  wxString baseline;
+  if (parser.Found("baseline", &baseline)) {
+    if (parser.GetParamCount() != 1) {
+      fprintf(stderr, "--baseline takes exactly one other json file\n");
+      return false;
+    }
+    _json_files.emplace_back(std::string(baseline));
+    _delta = true;
+  }
+  for (size_t i = 0; i < parser.GetParamCount(); i++) {
+    _json_files.emplace_back(std::string(parser.GetParam(i)));
+  }
+  wxString cost_model;
+  if (parser.Found("cost-model", &cost_model)) {
+    _cost_model_file = std::string(cost_model);
+  }
+  wxString history;
+  if (parser.Found("history", &history)) {
+    _history_file = std::string(history);
+  }
+  wxString blackboxes;
+  if (parser.Found("blackboxes", &blackboxes)) {
+    std::stringstream list(blackboxes.ToStdString());
+    std::string primitive;
+    while (std::getline(list, primitive, ',')) {
+      if (!primitive.empty()) {
+        _load_options.primitives.emplace(primitive);
+      }
+    }
+  }
+  wxString family;
+  if (parser.Found("family", &family)) {
+    _load_options.family = find_family(family.ToStdString());
+    if (!_load_options.family) {
+      fprintf(stderr, "Unknown family '%s'\n", family.ToStdString().c_str());
+      return false;
+    }
+  }
+  _watch = parser.Found("watch");
+  _load_options.cache = !parser.Found("no-cache");
   return true;
 }
 
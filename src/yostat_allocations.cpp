@@ -0,0 +1,44 @@
+#include <cstdlib>
+#include <new>
+
+#include <yostat/stats.hpp>
+
+// Replacement global operator new and delete, which count allocations for
+// the load stats (see allocation_count). Linked into the executables rather
+// than yostat_core, so that programs using the library keep their own.
+
+static void *counted_malloc(size_t size) {
+  count_allocation(size);
+  return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size) {
+  void *p = counted_malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) {
+  void *p = counted_malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return counted_malloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return counted_malloc(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
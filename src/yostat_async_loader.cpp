@@ -0,0 +1,40 @@
+#include <yostat/async_loader.hpp>
+
+AsyncLoader::~AsyncLoader() {
+  cancel();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+uint64_t AsyncLoader::load(const std::string &path, ProgressFn progress,
+                           DoneFn done) {
+  // Cancel the previous load. It will notice on its next progress poll, so
+  // this won't block for long.
+  const uint64_t generation = ++_generation;
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+
+  _thread = std::thread([this, path, progress, done, generation,
+                         options = _options]() mutable {
+    options.progress = [&](size_t bytes_done, size_t bytes_total) {
+      if (!is_current(generation)) {
+        return false;
+      }
+      if (progress) {
+        progress(bytes_done, bytes_total);
+      }
+      return true;
+    };
+    Design *d = read_json(path, options);
+
+    // If we were superseded while finishing up, just throw the result away
+    if (!is_current(generation)) {
+      delete d;
+      return;
+    }
+    done(d, generation);
+  });
+  return generation;
+}
@@ -0,0 +1,401 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include <yostat/cache.hpp>
+#include <yostat/hash.hpp>
+#include <yostat/mapped_file.hpp>
+
+#include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+// Cache file layout. Everything is stored in native byte order, and each
+// section starts on an 8 byte boundary so that it can be used in place.
+//   CacheHeader
+//   uint32_t string_offsets[num_primitives + num_summaries + num_names + 1]
+//   CacheSummary summaries[num_summaries]
+//   CacheSubmodule submodules[num_submodules]
+//   uint32_t instance_names[num_instance_names]
+//   int32_t self_primitives[num_summaries][num_primitives]
+//   int32_t total_primitives[num_summaries][num_primitives]
+//   char strings[strings_size]
+// The strings are the primitive names, then the summary names, then the
+// design's string pool in id order. Instance names are pool ids.
+
+namespace {
+
+constexpr char cache_magic[8] = {'Y', 'O', 'S', 'T', 'A', 'T', 'C', '\0'};
+// Bump whenever the layout, or the way designs are derived from the json,
+// changes
+constexpr uint32_t cache_version = 3;
+// Written as-is, so reads back differently on a machine of the other
+// endianness
+constexpr uint32_t cache_byte_order = 0x01020304;
+// Upper limit for any count in the header, which keeps all of the size
+// arithmetic well clear of overflow
+constexpr uint64_t cache_max_count = 1ull << 28;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  CacheKey key;
+  // Size and checksum of everything after the header
+  uint64_t body_size;
+  uint64_t body_checksum;
+  uint32_t num_primitives;
+  uint32_t num_summaries;
+  uint32_t num_submodules;
+  // Index of the top module's summary
+  uint32_t top;
+  uint32_t num_names;
+  uint32_t num_instance_names;
+  uint64_t strings_size;
+};
+
+struct CacheSummary {
+  uint64_t hash;
+  uint32_t has_self;
+  uint32_t first_submodule;
+  uint32_t num_submodules;
+  uint32_t first_instance_name;
+  uint32_t num_instance_names;
+  uint32_t padding;
+};
+
+struct CacheSubmodule {
+  uint32_t summary;
+  int32_t count;
+};
+
+static_assert(sizeof(CacheHeader) % 8 == 0, "Header must keep alignment");
+static_assert(sizeof(CacheSummary) % 8 == 0, "Summaries must keep alignment");
+
+uint64_t align8(uint64_t offset) { return (offset + 7) & ~7ull; }
+
+// Offsets of each section, relative to the start of the body
+struct CacheLayout {
+  uint64_t string_offsets, summaries, submodules, instance_names,
+      self_primitives, total_primitives, strings, body_size;
+
+  CacheLayout(const CacheHeader &h) {
+    const uint64_t counts = (uint64_t)h.num_summaries * h.num_primitives;
+    string_offsets = 0;
+    const uint64_t num_strings =
+        (uint64_t)h.num_primitives + h.num_summaries + h.num_names;
+    summaries = align8(string_offsets + 4 * (num_strings + 1));
+    submodules = summaries + sizeof(CacheSummary) * h.num_summaries;
+    instance_names = submodules + sizeof(CacheSubmodule) * h.num_submodules;
+    self_primitives =
+        align8(instance_names + 4 * (uint64_t)h.num_instance_names);
+    total_primitives = align8(self_primitives + 4 * counts);
+    strings = align8(total_primitives + 4 * counts);
+    body_size = align8(strings + h.strings_size);
+  }
+};
+
+} // namespace
+
+std::string cache_path(const std::string &json_path) {
+  return json_path + ".yostat";
+}
+
+bool cache_key(const std::string &json_path, CacheKey &key) {
+  struct stat st;
+  if (stat(json_path.c_str(), &st) < 0) {
+    return false;
+  }
+  key.size = st.st_size;
+  key.mtime_sec = st.st_mtime;
+#if defined(__APPLE__)
+  key.mtime_nsec = st.st_mtimespec.tv_nsec;
+#elif defined(__unix__)
+  key.mtime_nsec = st.st_mtim.tv_nsec;
+#else
+  key.mtime_nsec = 0;
+#endif
+
+  // Hash a fixed number of evenly spaced blocks, always including the start
+  // and end of the file. Small files are hashed completely.
+  constexpr size_t num_samples = 64;
+  constexpr size_t sample_size = 4096;
+  MappedFile file;
+  if (!file.open(json_path)) {
+    return false;
+  }
+  key.content_hash = 0;
+  if (file.size() <= num_samples * sample_size) {
+    key.content_hash = hash_words(file.data(), file.size());
+  } else {
+    const size_t stride = (file.size() - sample_size) / (num_samples - 1);
+    for (size_t i = 0; i < num_samples; i++) {
+      key.content_hash ^=
+          hash_words(file.data() + i * stride, sample_size) +
+          i * 0x9e3779b97f4a7c15ull;
+    }
+  }
+  return true;
+}
+
+Design *read_cache(const std::string &json_path, const CacheKey &key) {
+  MappedFile file;
+  if (!file.open(cache_path(json_path)) || file.size() < sizeof(CacheHeader)) {
+    return nullptr;
+  }
+
+  // Check that this cache belongs to the current version of the json, and
+  // that it is intact
+  CacheHeader h;
+  memcpy(&h, file.data(), sizeof(h));
+  if (memcmp(h.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+      h.version != cache_version || h.byte_order != cache_byte_order ||
+      memcmp(&h.key, &key, sizeof(key)) != 0) {
+    return nullptr;
+  }
+  if (h.num_primitives > cache_max_count || h.num_summaries > cache_max_count ||
+      h.num_submodules > cache_max_count || h.num_names > cache_max_count ||
+      h.num_instance_names > cache_max_count ||
+      h.strings_size > cache_max_count * 64 || h.top >= h.num_summaries) {
+    return nullptr;
+  }
+  const CacheLayout layout(h);
+  const char *body = file.data() + sizeof(CacheHeader);
+  if (h.body_size != layout.body_size ||
+      file.size() - sizeof(CacheHeader) != h.body_size ||
+      hash_words(body, h.body_size) != h.body_checksum) {
+    return nullptr;
+  }
+
+  const uint32_t *string_offsets =
+      reinterpret_cast<const uint32_t *>(body + layout.string_offsets);
+  const CacheSummary *summaries =
+      reinterpret_cast<const CacheSummary *>(body + layout.summaries);
+  const CacheSubmodule *submodules =
+      reinterpret_cast<const CacheSubmodule *>(body + layout.submodules);
+  const uint32_t *instance_names =
+      reinterpret_cast<const uint32_t *>(body + layout.instance_names);
+  const int32_t *self_primitives =
+      reinterpret_cast<const int32_t *>(body + layout.self_primitives);
+  const int32_t *total_primitives =
+      reinterpret_cast<const int32_t *>(body + layout.total_primitives);
+  const char *strings = body + layout.strings;
+
+  // Even with a good checksum, don't trust any index in the file
+  const size_t num_strings = h.num_primitives + h.num_summaries + h.num_names;
+  if (string_offsets[0] != 0) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < num_strings; i++) {
+    if (string_offsets[i + 1] < string_offsets[i] ||
+        string_offsets[i + 1] > h.strings_size) {
+      return nullptr;
+    }
+  }
+  auto string = [&](size_t i) {
+    return std::string(strings + string_offsets[i],
+                       string_offsets[i + 1] - string_offsets[i]);
+  };
+  for (size_t i = 0; i < h.num_summaries; i++) {
+    const CacheSummary &s = summaries[i];
+    if (s.first_submodule > h.num_submodules ||
+        s.num_submodules > h.num_submodules - s.first_submodule ||
+        s.first_instance_name > h.num_instance_names ||
+        s.num_instance_names > h.num_instance_names - s.first_instance_name) {
+      return nullptr;
+    }
+  }
+  for (size_t i = 0; i < h.num_submodules; i++) {
+    if (submodules[i].summary >= h.num_summaries) {
+      return nullptr;
+    }
+  }
+  for (size_t i = 0; i < h.num_instance_names; i++) {
+    if (instance_names[i] >= h.num_names &&
+        instance_names[i] != StringPool::none) {
+      return nullptr;
+    }
+  }
+
+  Design *d = new Design;
+  for (size_t i = 0; i < h.num_primitives; i++) {
+    d->primitives.emplace_back(string(i));
+    d->primitive_ids[d->primitives.back()] = i;
+  }
+
+  // Create every summary first, so that submodules can point at them
+  std::vector<ModuleSummary *> by_index;
+  for (size_t i = 0; i < h.num_summaries; i++) {
+    const std::string name = string(h.num_primitives + i);
+    ModuleSummary &summary = d->summaries[name];
+    summary.name = name;
+    by_index.emplace_back(&summary);
+  }
+  // Interning the pool's strings in order gives them back their ids, unless
+  // the file repeats one
+  for (size_t i = 0; i < h.num_names; i++) {
+    const size_t n = h.num_primitives + h.num_summaries + i;
+    d->names.intern(strings + string_offsets[n],
+                    string_offsets[n + 1] - string_offsets[n]);
+  }
+  if (d->summaries.size() != h.num_summaries ||
+      d->primitive_ids.size() != h.num_primitives ||
+      d->names.size() != h.num_names) {
+    delete d;
+    return nullptr;
+  }
+  for (size_t i = 0; i < h.num_summaries; i++) {
+    const CacheSummary &s = summaries[i];
+    ModuleSummary &summary = *by_index[i];
+    const size_t counts = i * h.num_primitives;
+    summary.self_primitives.assign(self_primitives + counts,
+                                   self_primitives + counts + h.num_primitives);
+    summary.total_primitives.assign(total_primitives + counts,
+                                    total_primitives + counts +
+                                        h.num_primitives);
+    for (size_t j = 0; j < s.num_submodules; j++) {
+      const CacheSubmodule &sub = submodules[s.first_submodule + j];
+      summary.submodules.emplace_back(by_index[sub.summary], sub.count);
+    }
+    summary.instance_names.assign(
+        instance_names + s.first_instance_name,
+        instance_names + s.first_instance_name + s.num_instance_names);
+    summary.has_self = s.has_self;
+    summary.hash = s.hash;
+    summary.id = i;
+  }
+
+  d->top = d->nodes.create(nullptr, Module::Kind::Instance, by_index[h.top]);
+  return d;
+}
+
+bool write_cache(const std::string &json_path, const CacheKey &key,
+                 const Design &design) {
+  CacheHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, cache_magic, sizeof(cache_magic));
+  h.version = cache_version;
+  h.byte_order = cache_byte_order;
+  h.key = key;
+  h.num_primitives = design.primitives.size();
+  h.num_summaries = design.summaries.size();
+  h.num_names = design.names.size();
+
+  // Number the summaries, and gather up the strings
+  std::unordered_map<const ModuleSummary *, uint32_t> index;
+  std::vector<const std::string *> strings;
+  for (auto &primitive : design.primitives) {
+    strings.emplace_back(&primitive);
+  }
+  for (auto &summary : design.summaries) {
+    const uint32_t i = index.size();
+    index[&summary.second] = i;
+    strings.emplace_back(&summary.second.name);
+    h.num_submodules += summary.second.submodules.size();
+    h.num_instance_names += summary.second.instance_names.size();
+    if (&summary.second == design.top->summary) {
+      h.top = i;
+    }
+  }
+  std::vector<std::string> names;
+  for (uint32_t i = 0; i < h.num_names; i++) {
+    names.emplace_back(design.names.str(i));
+  }
+  for (auto &name : names) {
+    strings.emplace_back(&name);
+  }
+  for (auto *s : strings) {
+    h.strings_size += s->size();
+  }
+  const CacheLayout layout(h);
+  h.body_size = layout.body_size;
+
+  // Fill in the body
+  std::vector<char> body(layout.body_size, 0);
+  uint32_t *string_offsets =
+      reinterpret_cast<uint32_t *>(&body[layout.string_offsets]);
+  CacheSummary *summaries =
+      reinterpret_cast<CacheSummary *>(&body[layout.summaries]);
+  CacheSubmodule *submodules =
+      reinterpret_cast<CacheSubmodule *>(&body[layout.submodules]);
+  uint32_t *instance_names =
+      reinterpret_cast<uint32_t *>(&body[layout.instance_names]);
+  int32_t *self_primitives =
+      reinterpret_cast<int32_t *>(&body[layout.self_primitives]);
+  int32_t *total_primitives =
+      reinterpret_cast<int32_t *>(&body[layout.total_primitives]);
+
+  uint32_t offset = 0;
+  for (size_t i = 0; i < strings.size(); i++) {
+    string_offsets[i] = offset;
+    memcpy(&body[layout.strings + offset], strings[i]->data(),
+           strings[i]->size());
+    offset += strings[i]->size();
+  }
+  string_offsets[strings.size()] = offset;
+
+  uint32_t next_submodule = 0;
+  uint32_t next_instance_name = 0;
+  for (auto &entry : design.summaries) {
+    const ModuleSummary &summary = entry.second;
+    const size_t i = index[&summary];
+    summaries[i].hash = summary.hash;
+    summaries[i].has_self = summary.has_self;
+    summaries[i].first_submodule = next_submodule;
+    summaries[i].num_submodules = summary.submodules.size();
+    for (auto &sub : summary.submodules) {
+      submodules[next_submodule++] = {index[sub.first], sub.second};
+    }
+    summaries[i].first_instance_name = next_instance_name;
+    summaries[i].num_instance_names = summary.instance_names.size();
+    for (const uint32_t name : summary.instance_names) {
+      instance_names[next_instance_name++] = name;
+    }
+    // Count arrays always cover every primitive, but don't write past the
+    // end of the body if one somehow doesn't
+    for (size_t p = 0; p < h.num_primitives; p++) {
+      if (p < summary.self_primitives.size()) {
+        self_primitives[i * h.num_primitives + p] = summary.self_primitives[p];
+      }
+      if (p < summary.total_primitives.size()) {
+        total_primitives[i * h.num_primitives + p] =
+            summary.total_primitives[p];
+      }
+    }
+  }
+  h.body_checksum = hash_words(body.data(), body.size());
+
+  // Write to a temporary file and rename it into place, so that a reader
+  // never sees a partial cache. The temporary file is named after the
+  // process and thread, so that writers of the same cache (e.g. the daemon
+  // and a CLI run, or parallel CI jobs) each write their own.
+  const std::string path = cache_path(json_path);
+  std::string tmp_path = path + ".";
+#if defined(__unix__) || defined(__APPLE__)
+  tmp_path += std::to_string(getpid()) + ".";
+#endif
+  tmp_path +=
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) +
+      ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.write(body.data(), body.size());
+    if (!out) {
+      out.close();
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,162 @@
+#include <set>
+#include <unordered_map>
+
+#include <yostat/compare.hpp>
+#include <yostat/tree_diff.hpp>
+
+// Take ownership of a list of designs
+static std::vector<std::shared_ptr<Design>>
+owned(const std::vector<Design *> &designs) {
+  return std::vector<std::shared_ptr<Design>>(designs.begin(), designs.end());
+}
+
+DesignComparison::DesignComparison(const std::vector<Design *> &designs,
+                                   const std::vector<std::string> &labels)
+    : DesignComparison(owned(designs), labels) {}
+
+DesignComparison::DesignComparison(
+    const std::vector<std::shared_ptr<Design>> &designs,
+    const std::vector<std::string> &labels)
+    : _designs(designs), _labels(labels) {
+  // Merge the primitive lists, then work out where each merged primitive
+  // lives in each design
+  std::set<std::string> primitives;
+  for (auto &d : _designs) {
+    primitives.insert(d->primitives.begin(), d->primitives.end());
+  }
+  _primitives.assign(primitives.begin(), primitives.end());
+  _same_primitives = true;
+  for (auto &d : _designs) {
+    _same_primitives &= d->primitives == _primitives;
+  }
+  for (auto &d : _designs) {
+    std::vector<int> ids;
+    for (auto &primitive : _primitives) {
+      auto search = d->primitive_ids.find(primitive);
+      ids.emplace_back(search == d->primitive_ids.end() ? -1 : search->second);
+    }
+    _primitive_ids.emplace_back(ids);
+  }
+
+  // The top modules are always aligned with each other, even if they are
+  // named differently
+  _top = create(nullptr, _designs.empty()
+                             ? ""
+                             : _designs[0]->top->name(_designs[0]->names));
+  for (size_t i = 0; i < _designs.size(); i++) {
+    _top->modules[i] = _designs[i]->top;
+  }
+}
+
+AlignedNode *DesignComparison::create(AlignedNode *parent,
+                                      const std::string &name) {
+  _nodes.emplace_back();
+  AlignedNode *node = &_nodes.back();
+  node->parent = parent;
+  node->name = name;
+  node->modules.assign(_designs.size(), nullptr);
+  return node;
+}
+
+// Key used to match up children between designs. Holders are matched by the
+// module they hold rather than by display name, since the number of instances
+// is one of the things that may differ between runs. Instances are matched by
+// module too, as generated instance names change from one synthesis run to
+// the next.
+static std::string match_key(const Module *m) {
+  switch (m->kind) {
+  case Module::Kind::Holder:
+    return "[]" + m->summary->name;
+  case Module::Kind::Self:
+    return "()";
+  default:
+    return m->summary->name;
+  }
+}
+
+// Display name for an aligned holder, listing each design's instance count
+// if they differ, e.g. "[4x|8x] foo"
+static std::string holder_name(const AlignedNode *node) {
+  std::string counts;
+  const Module *first = nullptr;
+  bool differ = false;
+  for (const Module *m : node->modules) {
+    if (!m) {
+      continue;
+    }
+    if (first && m->instances != first->instances) {
+      differ = true;
+    }
+    if (!first) {
+      first = m;
+    }
+    counts += (counts.empty() ? "" : "|") + std::to_string(m->instances) + "x";
+  }
+  if (!differ) {
+    counts = std::to_string(first->instances) + "x";
+  }
+  return "[" + counts + "] " + first->summary->name;
+}
+
+void DesignComparison::expand(AlignedNode *node) {
+  if (node->expanded) {
+    return;
+  }
+  node->expanded = true;
+
+  // Children are merged in the order each design lists them. Nodes with the
+  // same key under one parent (instances under a holder) are matched up in
+  // order.
+  std::unordered_map<std::string, std::vector<AlignedNode *>> by_key;
+  for (size_t i = 0; i < _designs.size(); i++) {
+    Module *m = node->modules[i];
+    if (!m) {
+      continue;
+    }
+    expand_module(_designs[i]->nodes, m);
+
+    std::unordered_map<std::string, size_t> seen;
+    for (unsigned c = 0; c < m->num_children; c++) {
+      Module *child = _designs[i]->nodes.child(m, c);
+      const std::string key = match_key(child);
+      auto &matches = by_key[key];
+      const size_t ordinal = seen[key]++;
+      if (ordinal == matches.size()) {
+        matches.emplace_back(create(node, child->name(_designs[i]->names)));
+        node->children.emplace_back(matches.back());
+      }
+      matches[ordinal]->modules[i] = child;
+    }
+  }
+
+  for (AlignedNode *child : node->children) {
+    for (const Module *m : child->modules) {
+      if (m && m->kind == Module::Kind::Holder) {
+        child->name = holder_name(child);
+        break;
+      }
+    }
+  }
+}
+
+int DesignComparison::get_primitive_count(const AlignedNode *node,
+                                          size_t design,
+                                          size_t primitive) const {
+  const Module *m = node->modules[design];
+  if (!m) {
+    return 0;
+  }
+  return m->get_primitive_count(_primitive_ids[design][primitive]);
+}
+
+bool DesignComparison::unchanged(const AlignedNode *node) const {
+  if (!_same_primitives) {
+    return false;
+  }
+  for (const Module *m : node->modules) {
+    if (!m || !same_subtree(m, node->modules[0])) {
+      return false;
+    }
+  }
+  return true;
+}
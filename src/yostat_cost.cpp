@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <nlohmann/json.hpp>
+
+#include <yostat/cost.hpp>
+
+namespace {
+
+// Sum of counts times weights. The loop keeps four separate sums so that the
+// compiler can work on several primitives at once without reordering any
+// one floating point sum.
+double dot(const int *counts, const double *weights, size_t n) {
+  double sums[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (size_t j = 0; j < 4; j++) {
+      sums[j] += counts[i + j] * weights[i + j];
+    }
+  }
+  for (; i < n; i++) {
+    sums[0] += counts[i] * weights[i];
+  }
+  return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+// Largest of counts times scales, in the same shape as dot
+double max_scaled(const int *counts, const double *scales, size_t n) {
+  double maxes[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (size_t j = 0; j < 4; j++) {
+      const double value = counts[i + j] * scales[i + j];
+      maxes[j] = value > maxes[j] ? value : maxes[j];
+    }
+  }
+  for (; i < n; i++) {
+    const double value = counts[i] * scales[i];
+    maxes[0] = value > maxes[0] ? value : maxes[0];
+  }
+  return std::max(std::max(maxes[0], maxes[1]), std::max(maxes[2], maxes[3]));
+}
+
+} // namespace
+
+std::vector<std::pair<int, double>>
+CostModel::weights(const Design &design) const {
+  std::vector<std::pair<int, double>> weights;
+  for (size_t i = 0; i < design.primitives.size(); i++) {
+    auto search = costs.find(design.primitives[i]);
+    if (search != costs.end() && search->second > 0) {
+      weights.emplace_back(i, search->second);
+    }
+  }
+  return weights;
+}
+
+bool read_cost_model(const std::string &path, CostModel &model,
+                     std::string &error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "Failed to open '" + path + "'";
+    return false;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  if (!parse_cost_model(text.str(), model, error)) {
+    error = path + ": " + error;
+    return false;
+  }
+  // Fall back to the file name if the model doesn't have one
+  if (model.name.empty()) {
+    model.name = path.substr(path.find_last_of('/') + 1);
+  }
+  return true;
+}
+
+bool parse_cost_model(const std::string &text, CostModel &model,
+                      std::string &error) {
+  nlohmann::json root;
+  try {
+    root = nlohmann::json::parse(text);
+  } catch (const nlohmann::json::exception &e) {
+    error = e.what();
+    return false;
+  }
+  if (!root.is_object() || !root["primitives"].is_object()) {
+    error = "Expected an object with a \"primitives\" object";
+    return false;
+  }
+  if (root["name"].is_string()) {
+    model.name = root["name"].get<std::string>();
+  }
+
+  for (auto &item : root["primitives"].items()) {
+    const nlohmann::json &primitive = item.value();
+    if (!primitive.is_object()) {
+      error = "Expected an object for " + item.key();
+      return false;
+    }
+    for (auto &field : primitive.items()) {
+      if (field.key() != "cost" && field.key() != "capacity") {
+        continue;
+      }
+      if (!field.value().is_number() || field.value().get<double>() < 0) {
+        error = "Invalid " + field.key() + " for " + item.key();
+        return false;
+      }
+      const double value = field.value().get<double>();
+      if (field.key() == "cost") {
+        model.costs[item.key()] = value;
+      } else if (value > 0) {
+        model.capacities[item.key()] = value;
+      }
+    }
+  }
+  return true;
+}
+
+CostColumns::CostColumns(const Design &design, const CostModel &model)
+    : _model_name(model.name) {
+  // Lay the model out densely by primitive id. Device use is a percentage of
+  // each capacity, so precompute the scale for that; primitives the model
+  // has no capacity for scale to zero.
+  const size_t n = design.primitives.size();
+  std::vector<double> costs(n, 0), scales(n, 0);
+  for (size_t i = 0; i < n; i++) {
+    auto cost = model.costs.find(design.primitives[i]);
+    if (cost != model.costs.end()) {
+      costs[i] = cost->second;
+    }
+    auto capacity = model.capacities.find(design.primitives[i]);
+    if (capacity != model.capacities.end()) {
+      scales[i] = 100 / capacity->second;
+    }
+  }
+
+  // Summaries already hold their hierarchical totals, so every value is a
+  // single pass over one count array
+  _cost.resize(2 * design.summaries.size());
+  _device.resize(2 * design.summaries.size());
+  for (auto &entry : design.summaries) {
+    const ModuleSummary &summary = entry.second;
+    const size_t i = 2 * summary.id;
+    _cost[i] = dot(summary.self_primitives.data(), costs.data(), n);
+    _cost[i + 1] = dot(summary.total_primitives.data(), costs.data(), n);
+    _device[i] = max_scaled(summary.self_primitives.data(), scales.data(), n);
+    _device[i + 1] =
+        max_scaled(summary.total_primitives.data(), scales.data(), n);
+  }
+}
@@ -0,0 +1,403 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <yostat/daemon.hpp>
+#include <yostat/query.hpp>
+
+// Not every platform can suppress SIGPIPE per call
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+// Longest request line accepted, to stop a bad client from using up memory
+constexpr size_t max_request_size = 1024 * 1024;
+
+// Longest a query waits for a file to finish being written before reading
+// it anyway
+constexpr std::chrono::seconds max_write_wait(60);
+
+int64_t modification_time_ns(const struct stat &st) {
+#if defined(__APPLE__)
+  const int64_t nsec = st.st_mtimespec.tv_nsec;
+#elif defined(__unix__)
+  const int64_t nsec = st.st_mtim.tv_nsec;
+#else
+  const int64_t nsec = 0;
+#endif
+  return (int64_t)st.st_mtime * 1000000000 + nsec;
+}
+
+// Fill in the address of a socket file. Returns false if the path is too
+// long for one.
+bool socket_address(const std::string &path, struct sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+// Connect to a socket file, returning the socket or -1
+int connect_socket(const std::string &path) {
+  struct sockaddr_un addr;
+  if (!socket_address(path, addr)) {
+    return -1;
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Write all of a buffer to a socket, without raising SIGPIPE if the other
+// end has gone (where MSG_NOSIGNAL is supported)
+bool send_all(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    const ssize_t n =
+        send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+// Read one line from a socket, keeping anything read past it in buffer for
+// the next call. Returns false at the end of the stream, or if the line is
+// longer than max_size.
+bool read_line(int fd, std::string &buffer, std::string &line,
+               size_t max_size) {
+  size_t newline;
+  while ((newline = buffer.find('\n')) == std::string::npos) {
+    if (buffer.size() > max_size) {
+      return false;
+    }
+    char chunk[64 * 1024];
+    const ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+  }
+  line = buffer.substr(0, newline);
+  buffer.erase(0, newline + 1);
+  return true;
+}
+
+} // namespace
+
+QueryDaemon::QueryDaemon(const LoadOptions &options) : _options(options) {
+  // Progress is of no interest to anyone, and reloads manage their own state
+  _options.progress = nullptr;
+  _options.previous = nullptr;
+}
+
+QueryDaemon::~QueryDaemon() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _reloaded.notify_all();
+  reap(true);
+  // Destroy the designs without the lock held, since a watcher may be
+  // waiting for it to reload one
+  std::map<std::string, std::unique_ptr<Resident>> designs;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    designs.swap(_designs);
+  }
+  designs.clear();
+  if (_listen_fd >= 0) {
+    close(_listen_fd);
+    unlink(_socket_path.c_str());
+  }
+  for (int fd : _wake_fds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool QueryDaemon::listen(const std::string &socket_path, std::string &error) {
+  struct sockaddr_un addr;
+  if (!socket_address(socket_path, addr)) {
+    error = "Socket path '" + socket_path + "' is too long";
+    return false;
+  }
+  // A socket file left behind by a daemon that died can be replaced, but not
+  // one that a daemon is still answering on
+  const int existing = connect_socket(socket_path);
+  if (existing >= 0) {
+    close(existing);
+    error = "A daemon is already listening on '" + socket_path + "'";
+    return false;
+  }
+  unlink(socket_path.c_str());
+
+  _listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (_listen_fd < 0 ||
+      bind(_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      ::listen(_listen_fd, 16) < 0 || pipe(_wake_fds) < 0) {
+    error = "Failed to listen on '" + socket_path + "': " + strerror(errno);
+    if (_listen_fd >= 0) {
+      close(_listen_fd);
+      _listen_fd = -1;
+    }
+    return false;
+  }
+  _socket_path = socket_path;
+  return true;
+}
+
+void QueryDaemon::run() {
+  while (true) {
+    struct pollfd fds[2] = {{_listen_fd, POLLIN, 0}, {_wake_fds[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      return;
+    }
+    if (fds[1].revents) {
+      // Shutting down
+      return;
+    }
+    const int fd = accept(_listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    reap(false);
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    _connections.emplace_back();
+    Connection *connection = &_connections.back();
+    connection->fd = fd;
+    connection->thread = std::thread([this, connection]() {
+      serve(connection);
+    });
+  }
+}
+
+void QueryDaemon::stop() {
+  // Only async-signal-safe calls here, so no perror
+  const char c = 0;
+  if (write(_wake_fds[1], &c, 1) < 0) {
+    static const char message[] = "yostat: failed to stop the daemon\n";
+    if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0) {
+      return;
+    }
+  }
+}
+
+void QueryDaemon::serve(Connection *connection) {
+  std::string buffer, line;
+  while (read_line(connection->fd, buffer, line, max_request_size)) {
+    if (!send_all(connection->fd, answer(line) + "\n")) {
+      break;
+    }
+  }
+  std::lock_guard<std::mutex> lock(_connections_mutex);
+  connection->done = true;
+}
+
+void QueryDaemon::reap(bool all) {
+  std::list<Connection> finished;
+  {
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    for (auto it = _connections.begin(); it != _connections.end();) {
+      auto next = std::next(it);
+      if (all || it->done) {
+        // Wake the thread up if it's still waiting for a request
+        shutdown(it->fd, SHUT_RDWR);
+        finished.splice(finished.end(), _connections, it);
+      }
+      it = next;
+    }
+  }
+  for (Connection &connection : finished) {
+    connection.thread.join();
+    close(connection.fd);
+  }
+}
+
+std::string QueryDaemon::answer(const std::string &request) {
+  nlohmann::json response;
+  std::string error;
+  try {
+    const nlohmann::json json = nlohmann::json::parse(request);
+    auto status = json.find("status");
+    Query query;
+    if (json.is_object() && status != json.end() && *status == true) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      response["designs"] = nlohmann::json::array();
+      for (auto &entry : _designs) {
+        nlohmann::json design = stats_json(entry.second->design->stats);
+        design["path"] = entry.first;
+        response["designs"].emplace_back(design);
+      }
+    } else if (parse_query(json, query, error) &&
+               check_query(query, error)) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      std::vector<std::shared_ptr<Design>> designs;
+      for (const std::string &path : query.inputs()) {
+        std::shared_ptr<Design> d = design(path, lock, error);
+        if (!d) {
+          break;
+        }
+        designs.emplace_back(d);
+      }
+      std::ostringstream output;
+      if (designs.size() == query.inputs().size() &&
+          run_query(query, designs, output, error)) {
+        response["output"] = output.str();
+      }
+      // Only the summaries need to stay resident, so free whatever tree the
+      // report generated
+      for (auto &d : designs) {
+        d->nodes.release_children(d->top);
+      }
+    }
+    if (error.empty()) {
+      response["ok"] = true;
+      return response.dump();
+    }
+  } catch (const nlohmann::json::exception &e) {
+    error = e.what();
+  }
+  response = nlohmann::json();
+  response["ok"] = false;
+  response["error"] = error;
+  return response.dump();
+}
+
+std::shared_ptr<Design> QueryDaemon::design(const std::string &path,
+                                            std::unique_lock<std::mutex> &lock,
+                                            std::string &error) {
+  // Don't read a file while synthesis is still writing it. The watcher
+  // reloads it once it has been quiet for a while.
+  auto search = _designs.find(path);
+  if (search != _designs.end()) {
+    Resident *resident = search->second.get();
+    _reloaded.wait_for(lock, max_write_wait,
+                       [&]() { return !resident->writing || _stopping; });
+  }
+  return load(path, error);
+}
+
+std::shared_ptr<Design> QueryDaemon::load(const std::string &path,
+                                          std::string &error) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0) {
+    error = "Failed to parse input file '" + path + "'";
+    return nullptr;
+  }
+  const int64_t mtime_ns = modification_time_ns(st);
+  std::unique_ptr<Resident> &resident = _designs[path];
+  if (!resident) {
+    resident.reset(new Resident());
+    resident->state = std::make_shared<IngestState>();
+  } else if (resident->size == st.st_size && resident->mtime_ns == mtime_ns) {
+    return resident->design;
+  }
+
+  LoadOptions options = _options;
+  options.previous = resident->state;
+  std::shared_ptr<Design> design(read_json(path, options));
+  if (!design) {
+    error = "Failed to parse input file '" + path + "'";
+    if (!resident->design) {
+      _designs.erase(path);
+    }
+    return nullptr;
+  }
+  resident->design = design;
+  resident->size = st.st_size;
+  resident->mtime_ns = mtime_ns;
+  if (!resident->watcher) {
+    resident->watcher.reset(new FileWatcher(
+        path, [this, path]() { modified(path); },
+        [this, path]() { refresh(path); }));
+  }
+  return design;
+}
+
+void QueryDaemon::modified(const std::string &path) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto search = _designs.find(path);
+  if (search != _designs.end()) {
+    search->second->writing = true;
+  }
+}
+
+void QueryDaemon::refresh(const std::string &path) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto search = _designs.find(path);
+    if (search == _designs.end()) {
+      return;
+    }
+    search->second->writing = false;
+    // A failed reload is reported by the next query for the file instead
+    std::string error;
+    load(path, error);
+  }
+  _reloaded.notify_all();
+}
+
+bool send_request(const std::string &socket_path,
+                  const nlohmann::json &request, nlohmann::json &response,
+                  std::string &error) {
+  const int fd = connect_socket(socket_path);
+  if (fd < 0) {
+    error = "Failed to connect to '" + socket_path + "': " + strerror(errno);
+    return false;
+  }
+  std::string buffer, line;
+  const bool ok =
+      send_all(fd, request.dump() + "\n") &&
+      read_line(fd, buffer, line, std::numeric_limits<size_t>::max());
+  close(fd);
+  if (!ok) {
+    error = "No response from '" + socket_path + "'";
+    return false;
+  }
+  try {
+    response = nlohmann::json::parse(line);
+  } catch (const nlohmann::json::exception &e) {
+    error = "Invalid response from '" + socket_path + "': " + e.what();
+    return false;
+  }
+  if (!response.is_object()) {
+    error = "Invalid response from '" + socket_path + "'";
+    return false;
+  }
+  return true;
+}
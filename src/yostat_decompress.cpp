@@ -0,0 +1,372 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef YOSTAT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef YOSTAT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <yostat/decompress.hpp>
+
+namespace {
+
+// Size of the reads from the compressed file, and of the decompressed chunks
+// handed to the reader
+constexpr size_t input_chunk_size = 256 * 1024;
+constexpr size_t output_chunk_size = 1024 * 1024;
+// Number of decompressed chunks the worker can get ahead of the reader by
+constexpr size_t max_queued_chunks = 4;
+
+// A decompression library behind a common interface
+class Decoder {
+public:
+  virtual ~Decoder() {}
+  // Decompress as much of [in, in_end) into [out, out_end) as will fit,
+  // advancing both pointers. Returns false if the data is corrupt.
+  virtual bool decode(const char *&in, const char *in_end, char *&out,
+                      char *out_end) = 0;
+  // Whether the data so far ends at the end of a compressed stream, rather
+  // than partway through one
+  virtual bool complete() const = 0;
+};
+
+#ifdef YOSTAT_HAVE_ZLIB
+class GzipDecoder : public Decoder {
+public:
+  GzipDecoder() {
+    memset(&_stream, 0, sizeof(_stream));
+    // Accept gzip or zlib headers
+    _ok = inflateInit2(&_stream, 15 + 32) == Z_OK;
+  }
+  ~GzipDecoder() { inflateEnd(&_stream); }
+
+  bool decode(const char *&in, const char *in_end, char *&out,
+              char *out_end) override {
+    if (!_ok) {
+      return false;
+    }
+    _stream.next_in = (Bytef *)in;
+    _stream.avail_in = in_end - in;
+    _stream.next_out = (Bytef *)out;
+    _stream.avail_out = out_end - out;
+    const int result = inflate(&_stream, Z_NO_FLUSH);
+    in = (const char *)_stream.next_in;
+    out = (char *)_stream.next_out;
+    if (result == Z_STREAM_END) {
+      // Concatenated files are several streams, one after another
+      _complete = true;
+      if (in != in_end) {
+        _complete = false;
+        return inflateReset(&_stream) == Z_OK;
+      }
+      return true;
+    }
+    // Z_BUF_ERROR just means there was nothing to do
+    return result == Z_OK || result == Z_BUF_ERROR;
+  }
+
+  bool complete() const override { return _complete; }
+
+private:
+  z_stream _stream;
+  bool _ok = false;
+  bool _complete = false;
+};
+#endif
+
+#ifdef YOSTAT_HAVE_ZSTD
+class ZstdDecoder : public Decoder {
+public:
+  ZstdDecoder() : _stream(ZSTD_createDStream()) {
+    if (_stream) {
+      ZSTD_initDStream(_stream);
+    }
+  }
+  ~ZstdDecoder() { ZSTD_freeDStream(_stream); }
+
+  bool decode(const char *&in, const char *in_end, char *&out,
+              char *out_end) override {
+    if (!_stream) {
+      return false;
+    }
+    ZSTD_inBuffer input = {in, (size_t)(in_end - in), 0};
+    ZSTD_outBuffer output = {out, (size_t)(out_end - out), 0};
+    const size_t result = ZSTD_decompressStream(_stream, &output, &input);
+    if (ZSTD_isError(result)) {
+      return false;
+    }
+    in += input.pos;
+    out += output.pos;
+    // Zero means a frame has just been completely decoded and flushed
+    if (input.pos || output.pos) {
+      _complete = result == 0;
+    }
+    return true;
+  }
+
+  bool complete() const override { return _complete; }
+
+private:
+  ZSTD_DStream *_stream;
+  bool _complete = false;
+};
+#endif
+
+std::unique_ptr<Decoder> create_decoder(Compression compression) {
+  switch (compression) {
+#ifdef YOSTAT_HAVE_ZLIB
+  case Compression::Gzip:
+    return std::unique_ptr<Decoder>(new GzipDecoder());
+#endif
+#ifdef YOSTAT_HAVE_ZSTD
+  case Compression::Zstd:
+    return std::unique_ptr<Decoder>(new ZstdDecoder());
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+} // namespace
+
+// The stream buffer, which owns the worker thread and the chunk queue
+class DecompressStream::Buffer : public std::streambuf {
+public:
+  Buffer(const std::string &path, Compression compression)
+      : _path(path), _compression(compression) {
+    _thread = std::thread([this]() { run(); });
+  }
+
+  ~Buffer() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+  }
+
+  std::atomic<size_t> done{0};
+  std::atomic<size_t> size{0};
+
+  std::string error() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _error;
+  }
+
+protected:
+  int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    // Hand the chunk we just finished back for reuse
+    if (_current.capacity()) {
+      _empty.emplace_back(std::move(_current));
+      _current = std::vector<char>();
+    }
+    _cv.wait(lock, [&]() { return !_full.empty() || _finished; });
+    if (_full.empty()) {
+      return traits_type::eof();
+    }
+    _current = std::move(_full.front());
+    _full.pop_front();
+    lock.unlock();
+    _cv.notify_all();
+
+    setg(_current.data(), _current.data(), _current.data() + _current.size());
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  // Worker thread body
+  void run() {
+    std::unique_ptr<Decoder> decoder = create_decoder(_compression);
+    if (!decoder) {
+      finish(std::string("Can't read ") + compression_name(_compression) +
+             " files: support wasn't built in");
+      return;
+    }
+    std::ifstream file(_path, std::ios::binary | std::ios::ate);
+    if (!file) {
+      finish("Failed to open '" + _path + "'");
+      return;
+    }
+    size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::vector<char> input(input_chunk_size);
+    const char *in = input.data();
+    const char *in_end = input.data();
+    std::vector<char> chunk = empty_chunk();
+    char *out = chunk.data();
+    bool eof = false;
+    while (true) {
+      if (in == in_end && !eof) {
+        file.read(input.data(), input.size());
+        in = input.data();
+        in_end = in + file.gcount();
+        done += file.gcount();
+        eof = file.gcount() == 0;
+        if (file.bad()) {
+          finish("Failed to read '" + _path + "'");
+          return;
+        }
+      }
+      char *const out_before = out;
+      if (!decoder->decode(in, in_end, out, chunk.data() + chunk.size())) {
+        finish(std::string("Invalid ") + compression_name(_compression) +
+               " data in '" + _path + "'");
+        return;
+      }
+      if (out == chunk.data() + chunk.size()) {
+        if (!push(chunk)) {
+          return;
+        }
+        chunk = empty_chunk();
+        out = chunk.data();
+      } else if (eof && out == out_before) {
+        // Everything has been read, and nothing more is coming out
+        break;
+      }
+    }
+
+    chunk.resize(out - chunk.data());
+    if (!chunk.empty() && !push(chunk)) {
+      return;
+    }
+    if (!decoder->complete()) {
+      finish(std::string("Unexpected end of ") +
+             compression_name(_compression) + " data in '" + _path + "'");
+      return;
+    }
+    finish("");
+  }
+
+  // Get a chunk to decompress into, reusing one the reader has finished with
+  // if possible
+  std::vector<char> empty_chunk() {
+    std::vector<char> chunk;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!_empty.empty()) {
+        chunk = std::move(_empty.back());
+        _empty.pop_back();
+      }
+    }
+    chunk.resize(output_chunk_size);
+    return chunk;
+  }
+
+  // Queue a decompressed chunk for the reader, waiting if it is too far
+  // behind. Returns false if the stream is being destroyed.
+  bool push(std::vector<char> &chunk) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock,
+             [&]() { return _full.size() < max_queued_chunks || _stop; });
+    if (_stop) {
+      return false;
+    }
+    _full.emplace_back(std::move(chunk));
+    lock.unlock();
+    _cv.notify_all();
+    return true;
+  }
+
+  // End the stream, with an error message if it ended early
+  void finish(const std::string &error) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _finished = true;
+      _error = error;
+    }
+    _cv.notify_all();
+  }
+
+  const std::string _path;
+  const Compression _compression;
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  // Decompressed chunks waiting to be read, and ones that have been read
+  std::deque<std::vector<char>> _full;
+  std::vector<std::vector<char>> _empty;
+  // Chunk being read
+  std::vector<char> _current;
+  bool _finished = false;
+  bool _stop = false;
+  std::string _error;
+  std::thread _thread;
+};
+
+Compression detect_compression(const char *data, size_t size) {
+  if (size >= 2 && (uint8_t)data[0] == 0x1f && (uint8_t)data[1] == 0x8b) {
+    return Compression::Gzip;
+  }
+  if (size >= 4 && (uint8_t)data[0] == 0x28 && (uint8_t)data[1] == 0xb5 &&
+      (uint8_t)data[2] == 0x2f && (uint8_t)data[3] == 0xfd) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+Compression detect_compression(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[4];
+  file.read(magic, sizeof(magic));
+  return detect_compression(magic, file.gcount());
+}
+
+const char *compression_name(Compression compression) {
+  switch (compression) {
+  case Compression::Gzip:
+    return "gzip";
+  case Compression::Zstd:
+    return "zstd";
+  default:
+    return "uncompressed";
+  }
+}
+
+bool compression_supported(Compression compression) {
+  switch (compression) {
+  case Compression::None:
+    return true;
+  case Compression::Gzip:
+#ifdef YOSTAT_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  case Compression::Zstd:
+#ifdef YOSTAT_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+DecompressStream::DecompressStream(const std::string &path,
+                                   Compression compression)
+    : std::istream(nullptr), _buffer(new Buffer(path, compression)) {
+  rdbuf(_buffer.get());
+}
+
+DecompressStream::~DecompressStream() = default;
+
+size_t DecompressStream::compressed_done() const { return _buffer->done; }
+
+size_t DecompressStream::compressed_size() const { return _buffer->size; }
+
+bool DecompressStream::failed() const { return !_buffer->error().empty(); }
+
+std::string DecompressStream::error() const { return _buffer->error(); }
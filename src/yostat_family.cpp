@@ -0,0 +1,447 @@
+#include <yostat/family.hpp>
+#include <yostat/hash.hpp>
+
+namespace {
+
+using C = PrimitiveCategory;
+
+// Primitive tables, roughly as the yosys synth_* scripts for each family
+// leave them. Anything missing just counts as Other when classified, and can
+// still be made a primitive with --blackboxes.
+
+constexpr FamilyPrimitive ecp5_primitives[] = {
+    {"LUT4", C::Logic},
+    {"PFUMX", C::Logic},
+    {"L6MUX21", C::Logic},
+    {"TRELLIS_DPR16X4", C::Logic},
+    {"TRELLIS_FF", C::FF},
+    {"FD1S3AX", C::FF},
+    {"FD1S3AY", C::FF},
+    {"FD1S3BX", C::FF},
+    {"FD1S3DX", C::FF},
+    {"FD1S3IX", C::FF},
+    {"FD1S3JX", C::FF},
+    {"FD1P3AX", C::FF},
+    {"FD1P3AY", C::FF},
+    {"FD1P3BX", C::FF},
+    {"FD1P3DX", C::FF},
+    {"FD1P3IX", C::FF},
+    {"FD1P3JX", C::FF},
+    {"CCU2C", C::Carry},
+    {"DP16KD", C::Bram},
+    {"PDPW16KD", C::Bram},
+    {"MULT9X9D", C::Dsp},
+    {"MULT18X18D", C::Dsp},
+    {"ALU24B", C::Dsp},
+    {"ALU54B", C::Dsp},
+    {"TRELLIS_IO", C::Io},
+    {"BB", C::Io},
+    {"IB", C::Io},
+    {"OB", C::Io},
+    {"OBZ", C::Io},
+    {"IDDRX1F", C::Io},
+    {"ODDRX1F", C::Io},
+    {"IDDRX2F", C::Io},
+    {"ODDRX2F", C::Io},
+    {"DELAYF", C::Io},
+    {"DELAYG", C::Io},
+    {"IOLOGIC", C::Io},
+    {"SIOLOGIC", C::Io},
+    {"EHXPLLL", C::Other},
+    {"DCCA", C::Other},
+    {"DCSC", C::Other},
+    {"CLKDIVF", C::Other},
+    {"ECLKSYNCB", C::Other},
+    {"ECLKBRIDGECS", C::Other},
+    {"OSCG", C::Other},
+    {"USRMCLK", C::Other},
+    {"GSR", C::Other},
+    {"SGSR", C::Other},
+    {"JTAGG", C::Other},
+    {"DTR", C::Other},
+    {"EXTREFB", C::Other},
+    {"DCUA", C::Other},
+    {"PCSCLKDIV", C::Other},
+};
+
+constexpr FamilyPrimitive ice40_primitives[] = {
+    {"SB_LUT4", C::Logic},
+    {"SB_CARRY", C::Carry},
+    {"SB_DFF", C::FF},
+    {"SB_DFFE", C::FF},
+    {"SB_DFFSR", C::FF},
+    {"SB_DFFR", C::FF},
+    {"SB_DFFSS", C::FF},
+    {"SB_DFFS", C::FF},
+    {"SB_DFFESR", C::FF},
+    {"SB_DFFER", C::FF},
+    {"SB_DFFESS", C::FF},
+    {"SB_DFFES", C::FF},
+    {"SB_DFFN", C::FF},
+    {"SB_DFFNE", C::FF},
+    {"SB_DFFNSR", C::FF},
+    {"SB_DFFNR", C::FF},
+    {"SB_DFFNSS", C::FF},
+    {"SB_DFFNS", C::FF},
+    {"SB_DFFNESR", C::FF},
+    {"SB_DFFNER", C::FF},
+    {"SB_DFFNESS", C::FF},
+    {"SB_DFFNES", C::FF},
+    {"SB_RAM40_4K", C::Bram},
+    {"SB_RAM40_4KNR", C::Bram},
+    {"SB_RAM40_4KNW", C::Bram},
+    {"SB_RAM40_4KNRNW", C::Bram},
+    {"SB_SPRAM256KA", C::Bram},
+    {"SB_MAC16", C::Dsp},
+    {"SB_IO", C::Io},
+    {"SB_GB_IO", C::Io},
+    {"SB_IO_OD", C::Io},
+    {"SB_IO_I3C", C::Io},
+    {"SB_RGBA_DRV", C::Io},
+    {"SB_GB", C::Other},
+    {"SB_PLL40_CORE", C::Other},
+    {"SB_PLL40_PAD", C::Other},
+    {"SB_PLL40_2_PAD", C::Other},
+    {"SB_PLL40_2F_CORE", C::Other},
+    {"SB_PLL40_2F_PAD", C::Other},
+    {"SB_HFOSC", C::Other},
+    {"SB_LFOSC", C::Other},
+    {"SB_WARMBOOT", C::Other},
+    {"SB_LED_DRV_CUR", C::Other},
+    {"SB_LEDDA_IP", C::Other},
+    {"SB_I2C", C::Other},
+    {"SB_SPI", C::Other},
+    {"SB_FILTER_50NS", C::Other},
+};
+
+constexpr FamilyPrimitive gowin_primitives[] = {
+    {"LUT1", C::Logic},
+    {"LUT2", C::Logic},
+    {"LUT3", C::Logic},
+    {"LUT4", C::Logic},
+    {"MUX2", C::Logic},
+    {"MUX2_LUT5", C::Logic},
+    {"MUX2_LUT6", C::Logic},
+    {"MUX2_LUT7", C::Logic},
+    {"MUX2_LUT8", C::Logic},
+    {"RAM16S1", C::Logic},
+    {"RAM16S2", C::Logic},
+    {"RAM16S4", C::Logic},
+    {"RAM16SDP1", C::Logic},
+    {"RAM16SDP2", C::Logic},
+    {"RAM16SDP4", C::Logic},
+    {"ALU", C::Carry},
+    {"DFF", C::FF},
+    {"DFFE", C::FF},
+    {"DFFS", C::FF},
+    {"DFFSE", C::FF},
+    {"DFFR", C::FF},
+    {"DFFRE", C::FF},
+    {"DFFP", C::FF},
+    {"DFFPE", C::FF},
+    {"DFFC", C::FF},
+    {"DFFCE", C::FF},
+    {"DFFN", C::FF},
+    {"DFFNE", C::FF},
+    {"DFFNS", C::FF},
+    {"DFFNSE", C::FF},
+    {"DFFNR", C::FF},
+    {"DFFNRE", C::FF},
+    {"DFFNP", C::FF},
+    {"DFFNPE", C::FF},
+    {"DFFNC", C::FF},
+    {"DFFNCE", C::FF},
+    {"SP", C::Bram},
+    {"SPX9", C::Bram},
+    {"SDP", C::Bram},
+    {"SDPB", C::Bram},
+    {"SDPX9", C::Bram},
+    {"SDPX9B", C::Bram},
+    {"DP", C::Bram},
+    {"DPB", C::Bram},
+    {"DPX9", C::Bram},
+    {"DPX9B", C::Bram},
+    {"pROM", C::Bram},
+    {"pROMX9", C::Bram},
+    {"MULT9X9", C::Dsp},
+    {"MULT18X18", C::Dsp},
+    {"MULT36X36", C::Dsp},
+    {"MULTALU18X18", C::Dsp},
+    {"MULTALU36X18", C::Dsp},
+    {"MULTADDALU18X18", C::Dsp},
+    {"ALU54D", C::Dsp},
+    {"PADD9", C::Dsp},
+    {"PADD18", C::Dsp},
+    {"IBUF", C::Io},
+    {"OBUF", C::Io},
+    {"TBUF", C::Io},
+    {"IOBUF", C::Io},
+    {"TLVDS_IBUF", C::Io},
+    {"TLVDS_OBUF", C::Io},
+    {"ELVDS_IBUF", C::Io},
+    {"ELVDS_OBUF", C::Io},
+    {"IDDR", C::Io},
+    {"ODDR", C::Io},
+    {"IDDRC", C::Io},
+    {"ODDRC", C::Io},
+    {"rPLL", C::Other},
+    {"PLLVR", C::Other},
+    {"OSC", C::Other},
+    {"OSCH", C::Other},
+    {"OSCZ", C::Other},
+    {"OSCF", C::Other},
+    {"CLKDIV", C::Other},
+    {"DHCEN", C::Other},
+    {"DQCE", C::Other},
+    {"DCS", C::Other},
+    {"BUFG", C::Other},
+    {"GND", C::Other},
+    {"VCC", C::Other},
+};
+
+constexpr FamilyPrimitive xc7_primitives[] = {
+    {"LUT1", C::Logic},
+    {"LUT2", C::Logic},
+    {"LUT3", C::Logic},
+    {"LUT4", C::Logic},
+    {"LUT5", C::Logic},
+    {"LUT6", C::Logic},
+    {"LUT6_2", C::Logic},
+    {"MUXF7", C::Logic},
+    {"MUXF8", C::Logic},
+    {"SRL16E", C::Logic},
+    {"SRLC32E", C::Logic},
+    {"RAM32X1S", C::Logic},
+    {"RAM64X1S", C::Logic},
+    {"RAM128X1S", C::Logic},
+    {"RAM256X1S", C::Logic},
+    {"RAM32X1D", C::Logic},
+    {"RAM64X1D", C::Logic},
+    {"RAM128X1D", C::Logic},
+    {"RAM32M", C::Logic},
+    {"RAM64M", C::Logic},
+    {"CARRY4", C::Carry},
+    {"FDRE", C::FF},
+    {"FDSE", C::FF},
+    {"FDCE", C::FF},
+    {"FDPE", C::FF},
+    {"FDRE_1", C::FF},
+    {"FDSE_1", C::FF},
+    {"FDCE_1", C::FF},
+    {"FDPE_1", C::FF},
+    {"LDCE", C::FF},
+    {"LDPE", C::FF},
+    {"RAMB18E1", C::Bram},
+    {"RAMB36E1", C::Bram},
+    {"FIFO18E1", C::Bram},
+    {"FIFO36E1", C::Bram},
+    {"DSP48E1", C::Dsp},
+    {"IBUF", C::Io},
+    {"IBUFG", C::Io},
+    {"OBUF", C::Io},
+    {"OBUFT", C::Io},
+    {"IOBUF", C::Io},
+    {"IBUFDS", C::Io},
+    {"OBUFDS", C::Io},
+    {"IOBUFDS", C::Io},
+    {"IDDR", C::Io},
+    {"ODDR", C::Io},
+    {"ISERDESE2", C::Io},
+    {"OSERDESE2", C::Io},
+    {"IDELAYE2", C::Io},
+    {"ODELAYE2", C::Io},
+    {"IDELAYCTRL", C::Io},
+    {"BUFG", C::Other},
+    {"BUFGCE", C::Other},
+    {"BUFGCTRL", C::Other},
+    {"BUFH", C::Other},
+    {"BUFHCE", C::Other},
+    {"BUFR", C::Other},
+    {"BUFIO", C::Other},
+    {"MMCME2_ADV", C::Other},
+    {"MMCME2_BASE", C::Other},
+    {"PLLE2_ADV", C::Other},
+    {"PLLE2_BASE", C::Other},
+    {"STARTUPE2", C::Other},
+    {"ICAPE2", C::Other},
+    {"BSCANE2", C::Other},
+    {"XADC", C::Other},
+    {"GND", C::Other},
+    {"VCC", C::Other},
+};
+
+constexpr size_t length(const char *s) {
+  size_t n = 0;
+  while (s[n]) {
+    n++;
+  }
+  return n;
+}
+
+constexpr uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+constexpr size_t bucket_of(uint64_t hash, size_t num_buckets) {
+  return (hash >> 32) % num_buckets;
+}
+
+constexpr size_t slot_of(uint64_t hash, uint16_t seed, size_t num_slots) {
+  return mix(hash + seed * 0x9e3779b97f4a7c15ull) & (num_slots - 1);
+}
+
+// Smallest power of two with room for twice as many entries
+constexpr size_t slot_count(size_t entries) {
+  size_t slots = 1;
+  while (slots < 2 * entries) {
+    slots *= 2;
+  }
+  return slots;
+}
+
+template <size_t N> struct PerfectHash {
+  static constexpr size_t num_buckets = N / 2 + 1;
+  static constexpr size_t num_slots = slot_count(N);
+  uint16_t seeds[num_buckets];
+  // Table position in each slot, or -1
+  int16_t slots[num_slots];
+  // Whether a seed was found for every bucket, which fails if two entries
+  // have the same name
+  bool ok;
+};
+
+// Try to put every entry of a bucket into a free slot with the given seed.
+// Either all of them are placed, or none are.
+template <size_t N>
+constexpr bool place_bucket(PerfectHash<N> &hash, const uint64_t (&hashes)[N],
+                            size_t bucket, uint16_t seed) {
+  using Hash = PerfectHash<N>;
+  for (size_t i = 0; i < N; i++) {
+    if (bucket_of(hashes[i], Hash::num_buckets) != bucket) {
+      continue;
+    }
+    const size_t slot = slot_of(hashes[i], seed, Hash::num_slots);
+    if (hash.slots[slot] < 0) {
+      hash.slots[slot] = i;
+      continue;
+    }
+    // Take back the ones placed so far
+    for (size_t j = 0; j < i; j++) {
+      if (bucket_of(hashes[j], Hash::num_buckets) == bucket) {
+        hash.slots[slot_of(hashes[j], seed, Hash::num_slots)] = -1;
+      }
+    }
+    return false;
+  }
+  return true;
+}
+
+// Build a perfect hash for a table by hash-and-displace: split the entries
+// into buckets, then from the largest bucket down, find a seed that moves the
+// whole bucket into free slots
+template <size_t N>
+constexpr PerfectHash<N> build_hash(const FamilyPrimitive (&entries)[N]) {
+  using Hash = PerfectHash<N>;
+  Hash hash{};
+  uint64_t hashes[N] = {};
+  size_t bucket_sizes[Hash::num_buckets] = {};
+  for (size_t i = 0; i < N; i++) {
+    hashes[i] = hash_bytes(entries[i].name, length(entries[i].name));
+    bucket_sizes[bucket_of(hashes[i], Hash::num_buckets)]++;
+  }
+  for (size_t i = 0; i < Hash::num_slots; i++) {
+    hash.slots[i] = -1;
+  }
+  for (size_t size = N; size > 0; size--) {
+    for (size_t bucket = 0; bucket < Hash::num_buckets; bucket++) {
+      if (bucket_sizes[bucket] != size) {
+        continue;
+      }
+      uint32_t seed = 0;
+      while (seed <= 0xffff && !place_bucket(hash, hashes, bucket, seed)) {
+        seed++;
+      }
+      if (seed > 0xffff) {
+        return hash;
+      }
+      hash.seeds[bucket] = seed;
+    }
+  }
+  hash.ok = true;
+  return hash;
+}
+
+constexpr auto ecp5_hash = build_hash(ecp5_primitives);
+constexpr auto ice40_hash = build_hash(ice40_primitives);
+constexpr auto gowin_hash = build_hash(gowin_primitives);
+constexpr auto xc7_hash = build_hash(xc7_primitives);
+static_assert(ecp5_hash.ok, "Duplicate ecp5 primitive");
+static_assert(ice40_hash.ok, "Duplicate ice40 primitive");
+static_assert(gowin_hash.ok, "Duplicate gowin primitive");
+static_assert(xc7_hash.ok, "Duplicate xc7 primitive");
+
+template <size_t N>
+constexpr PrimitiveFamily make_family(const char *name,
+                                      const FamilyPrimitive (&entries)[N],
+                                      const PerfectHash<N> &hash) {
+  return PrimitiveFamily(name, entries, N, hash.seeds,
+                         PerfectHash<N>::num_buckets, hash.slots,
+                         PerfectHash<N>::num_slots);
+}
+
+constexpr PrimitiveFamily families[] = {
+    make_family("ecp5", ecp5_primitives, ecp5_hash),
+    make_family("ice40", ice40_primitives, ice40_hash),
+    make_family("gowin", gowin_primitives, gowin_hash),
+    make_family("xc7", xc7_primitives, xc7_hash),
+};
+
+} // namespace
+
+const char *category_name(PrimitiveCategory category) {
+  switch (category) {
+  case PrimitiveCategory::Logic:
+    return "logic";
+  case PrimitiveCategory::FF:
+    return "ff";
+  case PrimitiveCategory::Carry:
+    return "carry";
+  case PrimitiveCategory::Bram:
+    return "bram";
+  case PrimitiveCategory::Dsp:
+    return "dsp";
+  case PrimitiveCategory::Io:
+    return "io";
+  default:
+    return "other";
+  }
+}
+
+int PrimitiveFamily::find(const std::string &cell_type) const {
+  const uint64_t hash = hash_bytes(cell_type.data(), cell_type.size());
+  const uint16_t seed = _seeds[bucket_of(hash, _num_buckets)];
+  const int i = _slots[slot_of(hash, seed, _num_slots)];
+  return i >= 0 && cell_type == _entries[i].name ? i : -1;
+}
+
+const PrimitiveFamily *find_family(const std::string &name) {
+  for (const PrimitiveFamily &family : families) {
+    if (name == family.name()) {
+      return &family;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<std::string> family_names() {
+  std::vector<std::string> names;
+  for (const PrimitiveFamily &family : families) {
+    names.emplace_back(family.name());
+  }
+  return names;
+}
@@ -0,0 +1,108 @@
+#include <cstdio>
+
+#include <yostat/file_watcher.hpp>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher(const std::string &path,
+                         std::function<void()> on_modified,
+                         std::function<void()> on_change, int debounce_ms)
+    : _on_modified(on_modified), _on_change(on_change),
+      _debounce_ms(debounce_ms) {
+  // Watch the directory rather than the file itself, so that we still see the
+  // new file if it gets replaced by a rename or delete + create
+  const size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    _dir = ".";
+    _basename = path;
+  } else {
+    _dir = slash == 0 ? "/" : path.substr(0, slash);
+    _basename = path.substr(slash + 1);
+  }
+
+#ifdef __linux__
+  _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_inotify_fd < 0) {
+    perror("inotify_init1");
+    return;
+  }
+  if (inotify_add_watch(_inotify_fd, _dir.c_str(),
+                        IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE |
+                            IN_MOVED_TO) < 0 ||
+      pipe2(_wake_fds, O_CLOEXEC) < 0) {
+    perror("Failed to watch input file");
+    close(_inotify_fd);
+    _inotify_fd = -1;
+    return;
+  }
+  _thread = std::thread(&FileWatcher::run, this);
+#else
+  fprintf(stderr, "File watching is only supported on Linux\n");
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+  if (_thread.joinable()) {
+    // Poke the watcher thread so that it exits
+    const char c = 0;
+    if (write(_wake_fds[1], &c, 1) < 0) {
+      perror("write");
+    }
+    _thread.join();
+  }
+  for (int fd : {_inotify_fd, _wake_fds[0], _wake_fds[1]}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+void FileWatcher::run() {
+#ifdef __linux__
+  bool pending = false;
+  while (true) {
+    // If we've seen changes, wait until the file has been quiet for the
+    // debounce period. Otherwise just wait for something to happen.
+    struct pollfd fds[2] = {{_inotify_fd, POLLIN, 0}, {_wake_fds[0], POLLIN, 0}};
+    const int ret = poll(fds, 2, pending ? _debounce_ms : -1);
+    if (ret < 0) {
+      perror("poll");
+      return;
+    }
+    if (fds[1].revents) {
+      // Shutting down
+      return;
+    }
+    if (ret == 0) {
+      // Quiet for the whole debounce period, so the new version is done
+      pending = false;
+      _on_change();
+      continue;
+    }
+
+    // Drain the inotify events and look for any that concern our file
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(_inotify_fd, buf, sizeof(buf))) > 0) {
+      for (char *ptr = buf; ptr < buf + len;) {
+        const struct inotify_event *event =
+            reinterpret_cast<const struct inotify_event *>(ptr);
+        ptr += sizeof(struct inotify_event) + event->len;
+        if (event->len && _basename == event->name) {
+          if (!pending) {
+            _on_modified();
+          }
+          pending = true;
+        }
+      }
+    }
+  }
+#endif
+}
@@ -0,0 +1,613 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include <yostat/hash.hpp>
+#include <yostat/history.hpp>
+
+#include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+// History file layout. Everything is stored in native byte order, and every
+// record starts on an 8 byte boundary so that it can be used in place.
+//   HistoryHeader
+//   Records, each a HistoryRecord and then its body, padded to 8 bytes:
+//   - Names: uint32_t offsets[count + 1], char strings[]
+//     Names that weren't in the store yet. Their ids follow on from the
+//     names of the records before.
+//   - Build: HistoryBuildHeader
+//            uint32_t modules[num_modules]
+//            uint32_t primitives[num_primitives]
+//            HistoryColumn columns[num_primitives]
+//            uint32_t column_modules[num_values]
+//            int32_t column_counts[num_values]
+//     Modules and primitives are name ids in ascending order. There is a
+//     column for each primitive, which lists the modules using any of it in
+//     ascending order, and the count for one instance of each.
+// A build's names always come before it, so a store can be read front to
+// back, and appending a build never changes anything already written.
+
+namespace {
+
+constexpr char history_magic[8] = {'Y', 'O', 'S', 'T', 'A', 'T', 'H', '\0'};
+constexpr uint32_t history_version = 1;
+constexpr uint32_t history_byte_order = 0x01020304;
+
+struct HistoryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+};
+
+enum HistoryRecordKind : uint32_t {
+  NAMES = 1,
+  BUILD = 2,
+};
+
+struct HistoryRecord {
+  uint32_t kind;
+  // Number of names in a names record
+  uint32_t count;
+  uint64_t body_size;
+  uint64_t body_checksum;
+};
+
+struct HistoryBuildHeader {
+  int64_t timestamp;
+  uint32_t label;
+  uint32_t top;
+  uint32_t num_modules;
+  uint32_t num_primitives;
+  uint32_t num_values;
+  uint32_t padding;
+};
+
+struct HistoryColumn {
+  uint32_t first_value;
+  uint32_t num_values;
+};
+
+static_assert(sizeof(HistoryHeader) % 8 == 0, "Header must keep alignment");
+static_assert(sizeof(HistoryRecord) % 8 == 0, "Records must keep alignment");
+static_assert(sizeof(HistoryBuildHeader) % 8 == 0,
+              "Build headers must keep alignment");
+
+uint64_t align8(uint64_t offset) { return (offset + 7) & ~7ull; }
+
+// Offsets of each section of a build record, relative to the start of its
+// body
+struct BuildLayout {
+  uint64_t modules, primitives, columns, column_modules, column_counts,
+      body_size;
+
+  BuildLayout(const HistoryBuildHeader &h) {
+    modules = sizeof(HistoryBuildHeader);
+    primitives = modules + 4 * (uint64_t)h.num_modules;
+    columns = align8(primitives + 4 * (uint64_t)h.num_primitives);
+    column_modules = columns + sizeof(HistoryColumn) * h.num_primitives;
+    column_counts = column_modules + 4 * (uint64_t)h.num_values;
+    body_size = align8(column_counts + 4 * (uint64_t)h.num_values);
+  }
+};
+
+// Typed view of an array in a record body
+template <typename T> const T *array_at(const char *body, uint64_t offset) {
+  return reinterpret_cast<const T *>(body + offset);
+}
+
+// Find a value in a sorted array, returning its index or -1
+int64_t find_sorted(const uint32_t *begin, size_t size, uint32_t value) {
+  const uint32_t *it = std::lower_bound(begin, begin + size, value);
+  return it != begin + size && *it == value ? it - begin : -1;
+}
+
+// Append a record with a given body to a buffer
+void add_record(std::vector<char> &out, uint32_t kind, uint32_t count,
+                const std::vector<char> &body) {
+  HistoryRecord record;
+  record.kind = kind;
+  record.count = count;
+  record.body_size = body.size();
+  record.body_checksum = hash_words(body.data(), body.size());
+  const char *bytes = reinterpret_cast<const char *>(&record);
+  out.insert(out.end(), bytes, bytes + sizeof(record));
+  out.insert(out.end(), body.begin(), body.end());
+}
+
+} // namespace
+
+bool HistoryStore::open(const std::string &path, std::string &error) {
+  _file.close();
+  _end = 0;
+  _names = StringPool();
+  _is_primitive.clear();
+  _builds.clear();
+  _order.clear();
+
+  // A store that doesn't exist yet, or was created but never written to,
+  // has no builds
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0 || (S_ISREG(st.st_mode) && !st.st_size)) {
+    return true;
+  }
+  if (!_file.open(path)) {
+    error = "Failed to read history store '" + path + "'";
+    return false;
+  }
+  HistoryHeader h;
+  if (_file.size() < sizeof(h)) {
+    error = "'" + path + "' isn't a yostat history store";
+    return false;
+  }
+  memcpy(&h, _file.data(), sizeof(h));
+  if (memcmp(h.magic, history_magic, sizeof(history_magic)) != 0) {
+    error = "'" + path + "' isn't a yostat history store";
+    return false;
+  }
+  if (h.version != history_version || h.byte_order != history_byte_order) {
+    error = "History store '" + path +
+            "' was written by a different version of yostat";
+    return false;
+  }
+
+  // Index the records. The names are read straight away, since everything
+  // else refers to them, but build bodies are only checked when used.
+  const char *data = _file.data();
+  const uint64_t size = _file.size();
+  uint64_t offset = sizeof(h);
+  _end = offset;
+  auto damaged = [&]() {
+    error = "History store '" + path + "' is damaged";
+    return false;
+  };
+  while (size - offset >= sizeof(HistoryRecord)) {
+    HistoryRecord record;
+    memcpy(&record, data + offset, sizeof(record));
+    const char *body = data + offset + sizeof(record);
+    // A record that runs off the end is from an append that didn't finish
+    if (record.body_size > size - offset - sizeof(record)) {
+      break;
+    }
+    if (record.body_size % 8 != 0) {
+      return damaged();
+    }
+
+    if (record.kind == NAMES) {
+      const uint64_t strings = 4 * ((uint64_t)record.count + 1);
+      if (strings > record.body_size ||
+          hash_words(body, record.body_size) != record.body_checksum) {
+        return damaged();
+      }
+      const uint32_t *offsets = array_at<uint32_t>(body, 0);
+      const size_t first = _names.size();
+      for (uint32_t i = 0; i < record.count; i++) {
+        if (offsets[i + 1] < offsets[i] ||
+            offsets[i + 1] > record.body_size - strings) {
+          return damaged();
+        }
+        _names.intern(body + strings + offsets[i],
+                      offsets[i + 1] - offsets[i]);
+      }
+      // Every name in a record is new, so each one must have got an id
+      if (_names.size() != first + record.count) {
+        return damaged();
+      }
+    } else if (record.kind == BUILD) {
+      HistoryBuildHeader b;
+      if (record.body_size < sizeof(b)) {
+        return damaged();
+      }
+      memcpy(&b, body, sizeof(b));
+      if (BuildLayout(b).body_size != record.body_size ||
+          b.label >= _names.size() || b.top >= _names.size()) {
+        return damaged();
+      }
+      const BuildLayout layout(b);
+      const uint32_t *primitives =
+          array_at<uint32_t>(body, layout.primitives);
+      for (uint32_t i = 0; i < b.num_primitives; i++) {
+        if (primitives[i] >= _names.size()) {
+          return damaged();
+        }
+        if (_is_primitive.size() <= primitives[i]) {
+          _is_primitive.resize(primitives[i] + 1);
+        }
+        _is_primitive[primitives[i]] = true;
+      }
+      BuildRecord build;
+      build.info.label = _names.str(b.label);
+      build.info.timestamp = b.timestamp;
+      build.body = body;
+      build.body_size = record.body_size;
+      build.checksum = record.body_checksum;
+      _builds.emplace_back(build);
+    } else {
+      return damaged();
+    }
+    offset += sizeof(record) + record.body_size;
+    _end = offset;
+  }
+
+  _order.resize(_builds.size());
+  std::iota(_order.begin(), _order.end(), 0);
+  std::stable_sort(_order.begin(), _order.end(), [&](size_t a, size_t b) {
+    return _builds[a].info.timestamp < _builds[b].info.timestamp;
+  });
+  return true;
+}
+
+const HistoryStore::BuildRecord *HistoryStore::record(size_t i) const {
+  const BuildRecord &build = _builds[_order[i]];
+  if (build.checked) {
+    return build.intact ? &build : nullptr;
+  }
+  build.checked = true;
+  if (hash_words(build.body, build.body_size) != build.checksum) {
+    return nullptr;
+  }
+  // Even with a good checksum, don't trust the column ranges
+  HistoryBuildHeader b;
+  memcpy(&b, build.body, sizeof(b));
+  const BuildLayout layout(b);
+  const HistoryColumn *columns =
+      array_at<HistoryColumn>(build.body, layout.columns);
+  for (uint32_t c = 0; c < b.num_primitives; c++) {
+    if (columns[c].first_value > b.num_values ||
+        columns[c].num_values > b.num_values - columns[c].first_value) {
+      return nullptr;
+    }
+  }
+  build.intact = true;
+  return &build;
+}
+
+uint32_t HistoryStore::top(size_t i) const {
+  HistoryBuildHeader b;
+  memcpy(&b, _builds[_order[i]].body, sizeof(b));
+  return b.top;
+}
+
+bool HistoryStore::find_module(const BuildRecord &record,
+                               uint32_t module) const {
+  HistoryBuildHeader b;
+  memcpy(&b, record.body, sizeof(b));
+  const BuildLayout layout(b);
+  return find_sorted(array_at<uint32_t>(record.body, layout.modules),
+                     b.num_modules, module) >= 0;
+}
+
+bool HistoryStore::has_module(size_t i, uint32_t module) const {
+  const BuildRecord *r = record(i);
+  return r && find_module(*r, module);
+}
+
+int HistoryStore::count(size_t i, uint32_t module, uint32_t primitive) const {
+  const BuildRecord *r = record(i);
+  if (!r || !find_module(*r, module)) {
+    return -1;
+  }
+  HistoryBuildHeader b;
+  memcpy(&b, r->body, sizeof(b));
+  const BuildLayout layout(b);
+  const int64_t p = find_sorted(
+      array_at<uint32_t>(r->body, layout.primitives), b.num_primitives,
+      primitive);
+  if (p < 0) {
+    return 0;
+  }
+  // Modules that aren't in the column don't use the primitive
+  const HistoryColumn &column =
+      array_at<HistoryColumn>(r->body, layout.columns)[p];
+  const int64_t v = find_sorted(
+      array_at<uint32_t>(r->body, layout.column_modules) + column.first_value,
+      column.num_values, module);
+  if (v < 0) {
+    return 0;
+  }
+  return array_at<int32_t>(r->body,
+                           layout.column_counts)[column.first_value + v];
+}
+
+std::vector<uint32_t> HistoryStore::primitives_used(size_t i,
+                                                    uint32_t module) const {
+  std::vector<uint32_t> used;
+  const BuildRecord *r = record(i);
+  if (!r || !find_module(*r, module)) {
+    return used;
+  }
+  HistoryBuildHeader b;
+  memcpy(&b, r->body, sizeof(b));
+  const BuildLayout layout(b);
+  const uint32_t *primitives = array_at<uint32_t>(r->body, layout.primitives);
+  const HistoryColumn *columns =
+      array_at<HistoryColumn>(r->body, layout.columns);
+  const uint32_t *column_modules =
+      array_at<uint32_t>(r->body, layout.column_modules);
+  for (uint32_t p = 0; p < b.num_primitives; p++) {
+    if (find_sorted(column_modules + columns[p].first_value,
+                    columns[p].num_values, module) >= 0) {
+      used.emplace_back(primitives[p]);
+    }
+  }
+  return used;
+}
+
+bool append_history(const std::string &path, const Design &design,
+                    const HistoryBuild &build, bool &appended,
+                    std::string &error) {
+  appended = false;
+#if defined(__unix__) || defined(__APPLE__)
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    error = "Failed to open history store '" + path + "'";
+    return false;
+  }
+  // Hold the lock while reading the store, so that the ids given to new
+  // names are still free when they are written
+  struct FileLock {
+    int fd;
+    ~FileLock() {
+      flock(fd, LOCK_UN);
+      ::close(fd);
+    }
+  } lock{fd};
+  if (flock(fd, LOCK_EX) < 0) {
+    error = "Failed to lock history store '" + path + "'";
+    return false;
+  }
+  HistoryStore store;
+  if (!store.open(path, error)) {
+    return false;
+  }
+  for (size_t i = 0; i < store.size(); i++) {
+    if (store.build(i).label == build.label &&
+        store.build(i).timestamp == build.timestamp) {
+      return true;
+    }
+  }
+
+  // Give ids to the names the store doesn't have yet
+  std::vector<const std::string *> new_names;
+  std::unordered_map<std::string, uint32_t> new_ids;
+  auto id = [&](const std::string &name) {
+    const uint32_t existing = store.find(name);
+    if (existing != StringPool::none) {
+      return existing;
+    }
+    auto inserted = new_ids.emplace(name, store._names.size() + new_ids.size());
+    if (inserted.second) {
+      new_names.emplace_back(&inserted.first->first);
+    }
+    return inserted.first->second;
+  };
+
+  HistoryBuildHeader b;
+  memset(&b, 0, sizeof(b));
+  b.timestamp = build.timestamp;
+  b.label = id(build.label);
+  b.top = id(design.top->summary->name);
+
+  // Modules and primitives in id order, remembering where each one came from
+  std::vector<std::pair<uint32_t, const ModuleSummary *>> modules;
+  for (auto &summary : design.summaries) {
+    modules.emplace_back(id(summary.first), &summary.second);
+  }
+  std::sort(modules.begin(), modules.end());
+  std::vector<std::pair<uint32_t, int>> primitives;
+  for (size_t p = 0; p < design.primitives.size(); p++) {
+    primitives.emplace_back(id(design.primitives[p]), p);
+  }
+  std::sort(primitives.begin(), primitives.end());
+  b.num_modules = modules.size();
+  b.num_primitives = primitives.size();
+
+  // Each column only lists the modules that use the primitive
+  std::vector<HistoryColumn> columns;
+  std::vector<uint32_t> column_modules;
+  std::vector<int32_t> column_counts;
+  for (auto &primitive : primitives) {
+    HistoryColumn column;
+    column.first_value = column_modules.size();
+    for (auto &module : modules) {
+      const auto &counts = module.second->total_primitives;
+      if (primitive.second < (int)counts.size() && counts[primitive.second]) {
+        column_modules.emplace_back(module.first);
+        column_counts.emplace_back(counts[primitive.second]);
+      }
+    }
+    column.num_values = column_modules.size() - column.first_value;
+    columns.emplace_back(column);
+  }
+  b.num_values = column_modules.size();
+
+  // Lay out the records to append: the file header if the store is new, the
+  // new names and then the build
+  std::vector<char> out;
+  uint64_t end = store._end;
+  if (end == 0) {
+    HistoryHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, history_magic, sizeof(history_magic));
+    h.version = history_version;
+    h.byte_order = history_byte_order;
+    const char *bytes = reinterpret_cast<const char *>(&h);
+    out.insert(out.end(), bytes, bytes + sizeof(h));
+  }
+  if (!new_names.empty()) {
+    const uint64_t strings = 4 * ((uint64_t)new_names.size() + 1);
+    uint64_t chars = 0;
+    for (auto *name : new_names) {
+      chars += name->size();
+    }
+    std::vector<char> body(align8(strings + chars), 0);
+    uint32_t *offsets = reinterpret_cast<uint32_t *>(body.data());
+    uint32_t offset = 0;
+    for (size_t i = 0; i < new_names.size(); i++) {
+      offsets[i] = offset;
+      memcpy(&body[strings + offset], new_names[i]->data(),
+             new_names[i]->size());
+      offset += new_names[i]->size();
+    }
+    offsets[new_names.size()] = offset;
+    add_record(out, NAMES, new_names.size(), body);
+  }
+  const BuildLayout layout(b);
+  std::vector<char> body(layout.body_size, 0);
+  memcpy(&body[0], &b, sizeof(b));
+  for (size_t i = 0; i < modules.size(); i++) {
+    memcpy(&body[layout.modules + 4 * i], &modules[i].first, 4);
+  }
+  for (size_t i = 0; i < primitives.size(); i++) {
+    memcpy(&body[layout.primitives + 4 * i], &primitives[i].first, 4);
+  }
+  if (!columns.empty()) {
+    memcpy(&body[layout.columns], columns.data(),
+           sizeof(HistoryColumn) * columns.size());
+  }
+  if (!column_modules.empty()) {
+    memcpy(&body[layout.column_modules], column_modules.data(),
+           4 * column_modules.size());
+    memcpy(&body[layout.column_counts], column_counts.data(),
+           4 * column_counts.size());
+  }
+  add_record(out, BUILD, 0, body);
+
+  // Drop anything left over from an append that didn't finish, and add the
+  // new records after the last complete one
+  if (ftruncate(fd, end) < 0) {
+    error = "Failed to write history store '" + path + "'";
+    return false;
+  }
+  size_t written = 0;
+  while (written < out.size()) {
+    const ssize_t n =
+        pwrite(fd, out.data() + written, out.size() - written, end + written);
+    if (n <= 0) {
+      // Readers ignore the partial record, and the next append replaces it
+      error = "Failed to write history store '" + path + "'";
+      return false;
+    }
+    written += n;
+  }
+  if (fsync(fd) < 0) {
+    error = "Failed to write history store '" + path + "'";
+    return false;
+  }
+  appended = true;
+  return true;
+#else
+  error = "History stores aren't supported on this platform";
+  return false;
+#endif
+}
+
+bool history_trend(const HistoryStore &store, const HistoryQuery &query,
+                   HistoryTrend &trend, std::string &error) {
+  trend = HistoryTrend();
+  const size_t first =
+      query.last && query.last < store.size() ? store.size() - query.last : 0;
+
+  uint32_t module = StringPool::none;
+  if (!query.module.empty()) {
+    module = store.find(query.module);
+    if (module == StringPool::none || store.is_primitive(module)) {
+      error = "Module '" + query.module + "' isn't in the history";
+      return false;
+    }
+    trend.module = query.module;
+  } else if (store.size()) {
+    trend.module = store.name(store.top(store.size() - 1));
+  }
+  auto module_of = [&](size_t i) {
+    return module != StringPool::none ? module : store.top(i);
+  };
+
+  // Columns are the primitives asked for, or else everything the module
+  // uses in the builds looked at, in name order
+  std::vector<uint32_t> primitives;
+  for (auto &name : query.primitives) {
+    const uint32_t id = store.find(name);
+    if (id == StringPool::none || !store.is_primitive(id)) {
+      error = "Primitive '" + name + "' isn't in the history";
+      return false;
+    }
+    primitives.emplace_back(id);
+  }
+  if (query.primitives.empty()) {
+    std::vector<bool> seen;
+    for (size_t i = first; i < store.size(); i++) {
+      for (const uint32_t id : store.primitives_used(i, module_of(i))) {
+        if (seen.size() <= id) {
+          seen.resize(id + 1);
+        }
+        if (!seen[id]) {
+          seen[id] = true;
+          primitives.emplace_back(id);
+        }
+      }
+    }
+    std::sort(primitives.begin(), primitives.end(),
+              [&](uint32_t a, uint32_t b) {
+                return store.name(a) < store.name(b);
+              });
+  }
+  for (const uint32_t id : primitives) {
+    trend.primitives.emplace_back(store.name(id));
+  }
+
+  uint32_t threshold = StringPool::none;
+  if (!query.threshold_primitive.empty()) {
+    threshold = store.find(query.threshold_primitive);
+    if (threshold == StringPool::none || !store.is_primitive(threshold)) {
+      error = "Primitive '" + query.threshold_primitive +
+              "' isn't in the history";
+      return false;
+    }
+  }
+
+  for (size_t i = first; i < store.size(); i++) {
+    if (threshold != StringPool::none &&
+        store.count(i, module_of(i), threshold) <= query.threshold) {
+      continue;
+    }
+    std::vector<int> counts;
+    for (const uint32_t id : primitives) {
+      counts.emplace_back(store.count(i, module_of(i), id));
+    }
+    trend.builds.emplace_back(i);
+    trend.counts.emplace_back(std::move(counts));
+    if (threshold != StringPool::none) {
+      break;
+    }
+  }
+  return true;
+}
+
+std::vector<int> history_series(const HistoryStore &store,
+                                const std::string &module,
+                                uint32_t primitive, size_t last) {
+  std::vector<int> series;
+  const uint32_t id = store.find(module);
+  const size_t first =
+      last && last < store.size() ? store.size() - last : 0;
+  for (size_t i = first; i < store.size(); i++) {
+    if (id == StringPool::none) {
+      series.emplace_back(-1);
+    } else if (primitive != StringPool::none) {
+      series.emplace_back(store.count(i, id, primitive));
+    } else {
+      // Total over every primitive the module uses
+      int total = store.has_module(i, id) ? 0 : -1;
+      for (const uint32_t p : store.primitives_used(i, id)) {
+        total += store.count(i, id, p);
+      }
+      series.emplace_back(total);
+    }
+  }
+  return series;
+}
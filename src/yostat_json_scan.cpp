@@ -0,0 +1,163 @@
+#include <cstring>
+
+#include <nlohmann/json.hpp>
+
+#include <yostat/json_scan.hpp>
+
+namespace {
+
+// Cursor over a json buffer
+class JsonScanner {
+public:
+  JsonScanner(const char *data, size_t size) : _p(data), _end(data + size) {}
+
+  const char *position() const { return _p; }
+
+  void skip_whitespace() {
+    while (_p < _end &&
+           (*_p == ' ' || *_p == '\n' || *_p == '\r' || *_p == '\t')) {
+      _p++;
+    }
+  }
+
+  bool at_end() {
+    skip_whitespace();
+    return _p == _end;
+  }
+
+  // Consume the given character, if it is next
+  bool expect(char c) {
+    skip_whitespace();
+    if (_p < _end && *_p == c) {
+      _p++;
+      return true;
+    }
+    return false;
+  }
+
+  // Skip over a complete value. Containers are skipped by bracket matching
+  // without looking at what is inside them.
+  bool skip_value() {
+    skip_whitespace();
+    if (_p == _end) {
+      return false;
+    }
+    if (*_p == '"') {
+      return skip_string();
+    }
+    if (*_p == '{' || *_p == '[') {
+      size_t depth = 0;
+      while (_p < _end) {
+        const char c = *_p;
+        if (c == '"') {
+          if (!skip_string()) {
+            return false;
+          }
+          continue;
+        }
+        _p++;
+        if (c == '{' || c == '[') {
+          depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+    // Number, bool or null
+    const char *start = _p;
+    while (_p < _end && *_p != ',' && *_p != '}' && *_p != ']' &&
+           *_p != ' ' && *_p != '\n' && *_p != '\r' && *_p != '\t') {
+      _p++;
+    }
+    return _p != start;
+  }
+
+  // Read an object key and the following colon
+  bool read_key(std::string &key) {
+    skip_whitespace();
+    const char *start = _p;
+    if (_p == _end || *_p != '"' || !skip_string()) {
+      return false;
+    }
+    if (memchr(start, '\\', _p - start)) {
+      // Let the real parser deal with escape sequences
+      try {
+        key = nlohmann::json::parse(start, _p).get<std::string>();
+      } catch (const nlohmann::json::exception &) {
+        return false;
+      }
+    } else {
+      key.assign(start + 1, _p - 1);
+    }
+    return expect(':');
+  }
+
+  // Iterate over the members of the object at the cursor. fn(key) is called
+  // with the cursor at the start of each value, and must consume the value.
+  template <typename Fn> bool for_each_member(Fn fn) {
+    if (!expect('{')) {
+      return false;
+    }
+    if (expect('}')) {
+      return true;
+    }
+    std::string key;
+    do {
+      if (!read_key(key) || !fn(key)) {
+        return false;
+      }
+    } while (expect(','));
+    return expect('}');
+  }
+
+private:
+  // Skip a string, starting at its opening quote
+  bool skip_string() {
+    _p++;
+    while (true) {
+      // Jump to the next quote, then check that it isn't escaped
+      const char *quote =
+          static_cast<const char *>(memchr(_p, '"', _end - _p));
+      if (!quote) {
+        _p = _end;
+        return false;
+      }
+      const char *escapes = quote;
+      while (escapes > _p && escapes[-1] == '\\') {
+        escapes--;
+      }
+      _p = quote + 1;
+      if ((quote - escapes) % 2 == 0) {
+        return true;
+      }
+    }
+  }
+
+  const char *_p;
+  const char *_end;
+};
+
+} // namespace
+
+bool scan_modules(const char *data, size_t size,
+                  std::vector<ModuleSpan> &modules) {
+  JsonScanner scanner(data, size);
+  bool found = false;
+  const bool ok = scanner.for_each_member([&](const std::string &key) {
+    if (key != "modules") {
+      return scanner.skip_value();
+    }
+    found = true;
+    return scanner.for_each_member([&](const std::string &name) {
+      scanner.skip_whitespace();
+      const size_t begin = scanner.position() - data;
+      if (!scanner.skip_value()) {
+        return false;
+      }
+      modules.push_back({name, begin, (size_t)(scanner.position() - data)});
+      return true;
+    });
+  });
+  return ok && found && scanner.at_end();
+}
@@ -0,0 +1,46 @@
+#include <yostat/mapped_file.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string &path) {
+  close();
+#if defined(__unix__) || defined(__APPLE__)
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  madvise(data, st.st_size, MADV_WILLNEED);
+  _data = static_cast<const char *>(data);
+  _size = st.st_size;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void MappedFile::close() {
+#if defined(__unix__) || defined(__APPLE__)
+  if (_data) {
+    munmap(const_cast<char *>(_data), _size);
+  }
+#endif
+  _data = nullptr;
+  _size = 0;
+}
@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <yostat/parallel.hpp>
+#include <yostat/stats.hpp>
+
+unsigned default_thread_count() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallel_for(size_t count, const std::function<void(size_t)> &fn,
+                  unsigned threads) {
+  if (threads == 0) {
+    threads = default_thread_count();
+  }
+  threads = std::min<size_t>(threads, count);
+
+  // Each worker pulls the next unclaimed item until there are none left
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+
+  // The calling thread does its share of the work too. The workers'
+  // allocations are counted as its own, as part of whatever it is doing.
+  std::atomic<uint64_t> worker_allocations{0};
+  std::atomic<uint64_t> worker_allocated_bytes{0};
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; i++) {
+    pool.emplace_back([&]() {
+      worker();
+      worker_allocations += allocation_count();
+      worker_allocated_bytes += allocated_bytes();
+    });
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  add_allocations(worker_allocations, worker_allocated_bytes);
+}
@@ -1,84 +1,715 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <mutex>
 
 #include <nlohmann/json.hpp>
 
+#include <yostat/cache.hpp>
+#include <yostat/decompress.hpp>
+#include <yostat/hash.hpp>
+#include <yostat/json_scan.hpp>
+#include <yostat/mapped_file.hpp>
+#include <yostat/parallel.hpp>
 #include <yostat/parse.hpp>
+#include <yostat/stats.hpp>
 
 // Determine which modules in a design are primitives
-std::set<std::string> unique_primitives_in_design(nlohmann::json &j);
+std::set<std::string>
+unique_primitives_in_design(const std::map<std::string, YosysModule> &modules);
+
+// SAX consumer for yosys json output.
+// Rather than loading the entire netlist into a json DOM, we fill in the
+// YosysModule structs directly from the token stream. The only parts of the
+// netlist we care about are:
+//   modules.<name>.attributes.{top,blackbox,whitebox}
+//   modules.<name>.cells.<cell>.type
+// Everything else (netnames, connections, port directions, parameters, bit
+// vectors) is tokenized and immediately thrown away, so peak memory depends
+// only on the number of modules and cell types.
+// Reports from yosys' 'stat -json' are read too. They already have the cell
+// counts of each module, in
+//   modules.<name>.num_cells_by_type.<type>
+// but nothing says which modules are blackboxes or the top (see
+// build_design).
+// The handler can either consume a whole file, or the body of a single module
+// (e.g. one found by scan_modules).
+class YosysSaxHandler {
+public:
+  YosysSaxHandler(std::map<std::string, YosysModule> &modules)
+      : _modules(&modules) {}
+  // Start inside the modules object, with the body of the given module next
+  YosysSaxHandler(YosysModule &module) : _module(&module), _depth(2) {}
+
+  // Optional hook that is called every so often during parsing. If it returns
+  // false, parsing is aborted.
+  std::function<bool()> poll;
+
+  bool start_object(std::size_t) { return enter(); }
+  bool end_object() { return leave(); }
+  bool start_array(std::size_t) { return enter(); }
+  bool end_array() { return leave(); }
+
+  bool key(std::string &key) {
+    if (poll && ++_keys % 4096 == 0 && !poll()) {
+      return false;
+    }
+    if (_skip_depth) {
+      return true;
+    }
+    // By default, assume we want to ignore whatever value follows this key
+    _skip_next = true;
+    if (_depth == 1) {
+      // Top level object, we only care about the module list
+      _skip_next = key != "modules";
+    } else if (_depth == 2) {
+      // Module name
+      _module = &(*_modules)[key];
+      _module->name = key;
+      _skip_next = false;
+    } else if (_depth == 3) {
+      // Module body. Note which section we are about to descend into
+      if (key == "attributes") {
+        _section = Section::Attributes;
+        _skip_next = false;
+      } else if (key == "cells") {
+        _section = Section::Cells;
+        _skip_next = false;
+      } else if (key == "num_cells_by_type") {
+        _section = Section::CellCounts;
+        _module->from_stat = true;
+        _skip_next = false;
+      }
+    } else if (_depth == 4 && _section == Section::Attributes) {
+      // Only the presence of these attributes matters, not their value
+      if (key == "top") {
+        _module->top = true;
+      } else if (key == "blackbox" || key == "whitebox") {
+        _module->blackbox = true;
+      }
+    } else if (_depth == 4 && _section == Section::Cells) {
+      // Cell name, descend into the cell body to find the type
+      _cell_name = key;
+      _skip_next = false;
+    } else if (_depth == 5 && _section == Section::Cells) {
+      _skip_next = key != "type";
+    } else if (_depth == 4 && _section == Section::CellCounts) {
+      // Cell type, with the count to follow
+      _cell_type = key;
+      _skip_next = false;
+    }
+    return true;
+  }
+
+  bool string(std::string &val) {
+    if (!consume_scalar()) {
+      return true;
+    }
+    if (_depth == 5 && _section == Section::Cells) {
+      _module->add_cell(val, _cell_name);
+    }
+    return true;
+  }
+
+  bool null() {
+    consume_scalar();
+    return true;
+  }
+  bool boolean(bool) {
+    consume_scalar();
+    return true;
+  }
+  bool number_integer(nlohmann::json::number_integer_t val) {
+    if (consume_scalar()) {
+      add_cell_count(val);
+    }
+    return true;
+  }
+  bool number_unsigned(nlohmann::json::number_unsigned_t val) {
+    if (consume_scalar()) {
+      add_cell_count(val);
+    }
+    return true;
+  }
+  bool number_float(nlohmann::json::number_float_t, const std::string &) {
+    consume_scalar();
+    return true;
+  }
+  template <typename Binary> bool binary(Binary &) {
+    consume_scalar();
+    return true;
+  }
+
+  template <typename Exception>
+  bool parse_error(std::size_t position, const std::string &last_token,
+                   const Exception &ex) {
+    fprintf(stderr, "%s\n", ex.what());
+    return false;
+  }
+
+private:
+  enum class Section { None, Attributes, Cells, CellCounts };
+
+  // Called with each number we don't ignore
+  void add_cell_count(int64_t count) {
+    if (_depth == 4 && _section == Section::CellCounts && count > 0) {
+      _module->cell_counts[_cell_type] += count;
+    }
+  }
+
+  // Called on the start of any object or array
+  bool enter() {
+    _depth++;
+    if (!_skip_depth && _skip_next) {
+      // Start ignoring everything until we leave this container again
+      _skip_depth = _depth;
+    }
+    _skip_next = false;
+    return true;
+  }
+
+  // Called on the end of any object or array
+  bool leave() {
+    if (_skip_depth == _depth) {
+      _skip_depth = 0;
+    }
+    if (!_skip_depth && _depth == 4) {
+      _section = Section::None;
+    }
+    _depth--;
+    return true;
+  }
+
+  // Returns true if a scalar value should be processed
+  bool consume_scalar() {
+    const bool wanted = !_skip_depth && !_skip_next;
+    _skip_next = false;
+    return wanted;
+  }
+
+  std::map<std::string, YosysModule> *_modules = nullptr;
+  YosysModule *_module = nullptr;
+  Section _section = Section::None;
+  // Name of the cell whose body is being read
+  std::string _cell_name;
+  // Cell type whose count is next, in a stat report
+  std::string _cell_type;
+  // Current container nesting depth
+  std::size_t _depth = 0;
+  // If nonzero, the depth of the container we are currently ignoring
+  std::size_t _skip_depth = 0;
+  // Whether the value following the last key should be ignored
+  bool _skip_next = false;
+  // Number of keys seen, used to rate limit calls to poll
+  std::size_t _keys = 0;
+};
+
+// Parse a compressed file with a single SAX pass, decompressing it on another
+// thread as we go
+static bool
+parse_modules_compressed(const std::string &path, Compression compression,
+                         const LoadOptions &options,
+                         std::map<std::string, YosysModule> &modules) {
+  if (!compression_supported(compression)) {
+    fprintf(stderr, "Can't read '%s': this build doesn't support %s files\n",
+            path.c_str(), compression_name(compression));
+    return false;
+  }
+  DecompressStream stream(path, compression);
+  YosysSaxHandler handler(modules);
+  if (options.progress) {
+    // Progress is measured through the compressed file
+    handler.poll = [&]() {
+      return options.progress(stream.compressed_done(),
+                              stream.compressed_size());
+    };
+  }
+  const bool parsed = nlohmann::json::sax_parse(stream, &handler);
+  // A parse error is likely to be a symptom of a decompression error
+  if (stream.failed()) {
+    fprintf(stderr, "%s\n", stream.error().c_str());
+    return false;
+  }
+  return parsed;
+}
+
+// Parse a whole file with a single SAX pass
+static bool parse_modules_stream(const std::string &path,
+                                 const LoadOptions &options,
+                                 std::map<std::string, YosysModule> &modules) {
+  const Compression compression = detect_compression(path);
+  if (compression != Compression::None) {
+    return parse_modules_compressed(path, compression, options, modules);
+  }
 
-Design *read_json(std::string path) {
   // Try and open the input file
   std::ifstream file_ifstream;
   file_ifstream.open(path);
 
   // Check if we failed to open the file
   if (file_ifstream.fail()) {
-    return nullptr;
+    return false;
+  }
+
+  // Stream the json straight into our module structs
+  YosysSaxHandler handler(modules);
+  size_t file_size = 0;
+  if (options.progress) {
+    // Work out the file size so that we can report progress through it
+    file_ifstream.seekg(0, std::ios::end);
+    file_size = file_ifstream.tellg();
+    file_ifstream.seekg(0, std::ios::beg);
+    handler.poll = [&]() {
+      return options.progress(file_ifstream.tellg(), file_size);
+    };
+  }
+  return nlohmann::json::sax_parse(file_ifstream, &handler);
+}
+
+// Outcome of trying to parse a file's modules in parallel
+enum class ParallelParse { Done, Failed, Unsupported };
+
+// Memory map a file, find where each module is with a quick structural scan,
+// then parse the modules on a pool of threads. Each module gets its own SAX
+// pass, which collects both its attributes and its cell counts.
+// If state is given, modules are parsed into state->modules, and only those
+// whose json differs from the last parse are parsed again. The state is left
+// untouched if parsing fails.
+// Returns Unsupported if the file can't be mapped or scanned, in which case
+// it should be streamed instead.
+static ParallelParse
+parse_modules_parallel(const std::string &path, const LoadOptions &options,
+                       std::map<std::string, YosysModule> &modules,
+                       IngestState *state, size_t &parsed_modules) {
+  MappedFile file;
+  std::vector<ModuleSpan> spans;
+  // Compressed files have to be streamed
+  if (!file.open(path) ||
+      detect_compression(file.data(), file.size()) != Compression::None ||
+      !scan_modules(file.data(), file.size(), spans)) {
+    return ParallelParse::Unsupported;
+  }
+
+  size_t total_bytes = 0;
+  for (auto &span : spans) {
+    total_bytes += span.end - span.begin;
+  }
+
+  std::vector<YosysModule> parsed(spans.size());
+  // Fingerprints are only needed when there is a state to compare them with
+  std::vector<uint64_t> fingerprints(state ? spans.size() : 0);
+  std::vector<char> unchanged(spans.size(), false);
+  std::atomic<bool> failed{false};
+  std::atomic<size_t> done_bytes{0};
+  // Serializes calls to the progress callback, which needn't be thread safe
+  std::mutex progress_mutex;
+  parallel_for(
+      spans.size(),
+      [&](size_t i) {
+        if (failed) {
+          return;
+        }
+        const char *begin = file.data() + spans[i].begin;
+        const char *end = file.data() + spans[i].end;
+        if (state) {
+          // Skip modules whose json is exactly as it was last time
+          fingerprints[i] = hash_words(begin, end - begin);
+          auto last = state->fingerprints.find(spans[i].name);
+          unchanged[i] = last != state->fingerprints.end() &&
+                         last->second == fingerprints[i] &&
+                         state->modules.count(spans[i].name);
+        }
+        if (!unchanged[i]) {
+          YosysSaxHandler handler(parsed[i]);
+          handler.poll = [&]() { return !failed; };
+          if (!nlohmann::json::sax_parse(begin, end, &handler)) {
+            failed = true;
+            return;
+          }
+        }
+        const size_t done = done_bytes += spans[i].end - spans[i].begin;
+        if (options.progress) {
+          std::lock_guard<std::mutex> lock(progress_mutex);
+          if (!options.progress(done, total_bytes)) {
+            failed = true;
+          }
+        }
+      },
+      options.threads);
+  if (failed) {
+    return ParallelParse::Failed;
+  }
+
+  // Merge into the module map
+  parsed_modules = 0;
+  for (size_t i = 0; i < spans.size(); i++) {
+    if (unchanged[i]) {
+      continue;
+    }
+    YosysModule &module = modules[spans[i].name];
+    module = std::move(parsed[i]);
+    module.name = spans[i].name;
+    parsed_modules++;
+    if (state) {
+      state->changed.emplace(spans[i].name);
+    }
+  }
+
+  // Forget modules that are no longer in the file
+  if (state) {
+    state->fingerprints.clear();
+    for (size_t i = 0; i < spans.size(); i++) {
+      state->fingerprints[spans[i].name] = fingerprints[i];
+    }
+    for (auto it = modules.begin(); it != modules.end();) {
+      if (state->fingerprints.count(it->first)) {
+        ++it;
+      } else {
+        state->changed.emplace(it->first);
+        it = modules.erase(it);
+      }
+    }
+  }
+  return ParallelParse::Done;
+}
+
+// Parse the modules of a file into a state, reusing whatever is unchanged
+static bool parse_modules_incremental(const std::string &path,
+                                      const LoadOptions &options,
+                                      IngestState &state,
+                                      size_t &parsed_modules) {
+  const ParallelParse result =
+      options.threads == 1
+          ? ParallelParse::Unsupported
+          : parse_modules_parallel(path, options, state.modules, &state,
+                                   parsed_modules);
+  if (result != ParallelParse::Unsupported) {
+    return result == ParallelParse::Done;
+  }
+
+  // Streaming can't tell which modules changed, so start again from scratch
+  state = IngestState();
+  if (!parse_modules_stream(path, options, state.modules)) {
+    return false;
+  }
+  parsed_modules = state.modules.size();
+  return true;
+}
+
+// Drop the names of cells that aren't instances of modules the design
+// defines. Primitive cells far outnumber instances, and their names are never
+// shown. A module that only gains a definition in a later reload keeps
+// unnamed instances until the modules instantiating it are parsed again.
+static void prune_cell_names(std::map<std::string, YosysModule> &modules) {
+  for (auto &module : modules) {
+    auto &cell_names = module.second.cell_names;
+    for (auto it = cell_names.begin(); it != cell_names.end();) {
+      auto search = modules.find(it->first);
+      if (search == modules.end() || search->second.blackbox) {
+        it = cell_names.erase(it);
+      } else {
+        ++it;
+      }
+    }
   }
+}
 
-  // Parse to a json object
-  nlohmann::json j;
-  file_ifstream >> j;
+Design *read_json(std::string path, const LoadOptions &options) {
+  // Reuse the results of the last load if the file hasn't changed since. The
+  // key is taken before parsing, so that if the file changes while we are
+  // reading it, the cache we write is already stale.
+  LoadStats stats;
+  CacheKey key;
+  bool use_cache = false;
+  if (options.cache) {
+    ScopedPhase phase(&stats, "cache read");
+    use_cache = cache_key(path, key);
+    // The same file gives a different design with different primitives
+    for (auto &primitive : options.primitives) {
+      hash_combine(key.content_hash, hash_string(primitive));
+    }
+    if (options.family) {
+      hash_combine(key.content_hash, hash_string(options.family->name()));
+    }
+    if (use_cache) {
+      if (Design *d = read_cache(path, key)) {
+        phase.finish();
+        stats.from_cache = true;
+        stats.file_size = key.size;
+        stats.summaries = d->summaries.size();
+        stats.primitives = d->primitives.size();
+        d->stats = std::move(stats);
+        d->family = options.family;
+        return d;
+      }
+    }
+  }
 
-  // Extract the primitives used in this design
-  std::set<std::string> device_primitives = unique_primitives_in_design(j);
+  IngestState *state = options.previous.get();
+  std::map<std::string, YosysModule> fresh_modules;
+  const std::map<std::string, YosysModule> &modules =
+      state ? state->modules : fresh_modules;
+  {
+    ScopedPhase phase(&stats, "parse");
+    if (state) {
+      if (!parse_modules_incremental(path, options, *state,
+                                     stats.parsed_modules)) {
+        return nullptr;
+      }
+    } else {
+      if (!read_json_modules(path, options, fresh_modules)) {
+        return nullptr;
+      }
+      stats.parsed_modules = fresh_modules.size();
+    }
+    prune_cell_names(state ? state->modules : fresh_modules);
+  }
+  Design *d = build_design(modules, &stats, state, &options.primitives,
+                           options.family);
+
+  // Failing to write the cache just means the next load parses again
+  if (use_cache) {
+    ScopedPhase phase(&stats, "cache write");
+    write_cache(path, key, *d);
+  }
+
+  stats.file_size = key.size;
+  if (!use_cache) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    stats.file_size = std::max<std::streamoff>(file.tellg(), 0);
+  }
+  stats.modules = modules.size();
+  stats.summaries = d->summaries.size();
+  stats.primitives = d->primitives.size();
+  d->stats = std::move(stats);
+  return d;
+}
 
-  // Now pull out all our useful data
-  std::string top_module = "top";
-  std::map<std::string, YosysModule> modules;
-  for (auto module_it = j["modules"].begin(); module_it != j["modules"].end();
-       ++module_it) {
-    // Create a struct for this module
-    YosysModule mod;
-    mod.name = module_it.key();
+bool read_json_modules(const std::string &path, const LoadOptions &options,
+                       std::map<std::string, YosysModule> &modules) {
+  size_t parsed_modules = 0;
+  const ParallelParse result =
+      options.threads == 1
+          ? ParallelParse::Unsupported
+          : parse_modules_parallel(path, options, modules, nullptr,
+                                   parsed_modules);
+  if (result == ParallelParse::Unsupported) {
+    return parse_modules_stream(path, options, modules);
+  }
+  return result == ParallelParse::Done;
+}
+
+// Find the top module of a design: the one with the top attribute, or failing
+// that the one called "top", or failing that whichever module that nothing
+// else instantiates has the most modules below it
+static std::string
+find_top_module(const std::map<std::string, YosysModule> &modules,
+                const std::set<std::string> &primitives) {
+  std::string top_module;
+  for (auto &module : modules) {
+    if (module.second.top) {
+      top_module = module.first;
+    }
+  }
+  if (!top_module.empty()) {
+    return top_module;
+  }
+  if (modules.count("top")) {
+    return "top";
+  }
 
-    // Check if this is the top module?
-    auto &attributes = module_it.value()["attributes"];
-    auto attr_top = attributes.find("top");
-    if (attr_top != attributes.end()) {
-      top_module = mod.name;
+  std::set<std::string> instantiated;
+  for (auto &module : modules) {
+    for (auto &cell : module.second.cell_counts) {
+      instantiated.emplace(cell.first);
+    }
+  }
+  top_module = "top";
+  bool found = false;
+  size_t most_below = 0;
+  for (auto &module : modules) {
+    if (instantiated.count(module.first) || primitives.count(module.first)) {
+      continue;
+    }
+    std::set<std::string> below;
+    std::vector<const YosysModule *> pending = {&module.second};
+    while (!pending.empty()) {
+      const YosysModule *m = pending.back();
+      pending.pop_back();
+      for (auto &cell : m->cell_counts) {
+        auto search = modules.find(cell.first);
+        if (search != modules.end() && !primitives.count(cell.first) &&
+            below.emplace(cell.first).second) {
+          pending.emplace_back(&search->second);
+        }
+      }
+    }
+    if (!found || below.size() > most_below) {
+      top_module = module.first;
+      most_below = below.size();
+      found = true;
     }
+  }
+  return top_module;
+}
 
-    // Load the number of cells used by the module
-    auto &cells = module_it.value()["cells"];
-    for (auto cells_it = cells.begin(); cells_it != cells.end(); ++cells_it) {
-      mod.increment_celltype(cells_it.value()["type"]);
+Design *build_design(const std::map<std::string, YosysModule> &modules,
+                     LoadStats *stats, IngestState *state,
+                     const std::set<std::string> *primitives,
+                     const PrimitiveFamily *family) {
+  ScopedPhase primitives_phase(stats, "primitives");
+
+  // Extract the primitives used in this design. Stat reports never mark
+  // blackboxes, and don't define the cell types they count, so there every
+  // cell type that isn't defined as a module counts as well as any listed
+  // ones. The same goes for a netlist without any blackboxes, a list of
+  // primitives or a family to go on.
+  std::set<std::string> device_primitives =
+      unique_primitives_in_design(modules);
+  if (primitives) {
+    device_primitives.insert(primitives->begin(), primitives->end());
+  }
+  if (family) {
+    for (auto &module : modules) {
+      for (auto &cell : module.second.cell_counts) {
+        if (family->find(cell.first) < 0) {
+          continue;
+        }
+        auto search = modules.find(cell.first);
+        if (search == modules.end() || search->second.blackbox) {
+          device_primitives.emplace(cell.first);
+        }
+      }
+    }
+  }
+  const bool from_stat =
+      std::any_of(modules.begin(), modules.end(),
+                  [](const std::pair<const std::string, YosysModule> &module) {
+                    return module.second.from_stat;
+                  });
+  if (from_stat || device_primitives.empty()) {
+    for (auto &module : modules) {
+      for (auto &cell : module.second.cell_counts) {
+        if (!modules.count(cell.first)) {
+          device_primitives.emplace(cell.first);
+        }
+      }
     }
-    modules[mod.name] = mod;
   }
 
-  Module *tree =
-      generate_module_tree(modules, device_primitives, nullptr, top_module);
+  const std::string top_module = find_top_module(modules, device_primitives);
+
+  // Assign dense ids to the primitives that are actually used
   Design *d = new Design;
-  d->top = tree;
-  d->primitives = unique_primitives_in_tree(tree);
+  d->family = family;
+  d->primitives =
+      unique_primitives_in_tree(modules, device_primitives, top_module);
+  for (unsigned i = 0; i < d->primitives.size(); i++) {
+    d->primitive_ids[d->primitives[i]] = i;
+  }
+  primitives_phase.finish();
+
+  // Summarize each module once, then create the root of the display tree.
+  // Everything below the root is generated on demand. Summaries from the last
+  // build can only be reused if the primitive ids are the same.
+  ScopedPhase summarize_phase(stats, "summarize");
+  SummaryReuse reuse;
+  const bool reusing = state && state->primitives == d->primitives;
+  if (reusing) {
+    reuse.previous = &state->summaries;
+    reuse.changed = &state->changed;
+  }
+  const ModuleSummary *top_summary =
+      summarize_module(modules, d->primitive_ids, d->summaries, d->names,
+                       top_module, reusing ? &reuse : nullptr);
+  uint32_t id = 0;
+  for (auto &summary : d->summaries) {
+    summary.second.id = id++;
+  }
+  d->top = d->nodes.create(nullptr, Module::Kind::Instance, top_summary);
+
+  // Remember the new summaries for next time. Reused ones are already there.
+  if (state) {
+    if (!reusing) {
+      state->summaries.clear();
+      state->primitives = d->primitives;
+    }
+    for (auto &summary : d->summaries) {
+      if (reuse.reused.count(summary.first)) {
+        continue;
+      }
+      ModuleSummary &copy = state->summaries[summary.first];
+      copy.name = summary.second.name;
+      copy.self_primitives = summary.second.self_primitives;
+      copy.total_primitives = summary.second.total_primitives;
+      copy.has_self = summary.second.has_self;
+      copy.hash = summary.second.hash;
+    }
+    for (auto it = state->summaries.begin(); it != state->summaries.end();) {
+      if (d->summaries.count(it->first)) {
+        ++it;
+      } else {
+        it = state->summaries.erase(it);
+      }
+    }
+    state->changed.clear();
+  }
   return d;
 }
 
-bool YosysModule::all_cells_are_primitives(std::set<std::string> primitives) {
+std::vector<Design *> read_json_files(const std::vector<std::string> &paths,
+                                      const LoadOptions &options,
+                                      unsigned threads) {
+  // Each file is loaded independently, so there is nothing to synchronize
+  // beyond handing out the paths. Unless told otherwise, share the cores out
+  // between the files being loaded at once.
+  LoadOptions file_options = options;
+  if (paths.size() > 1) {
+    // A state only describes one file
+    file_options.previous.reset();
+  }
+  if (file_options.threads == 0 && !paths.empty()) {
+    const size_t concurrent_files =
+        std::min<size_t>(threads ? threads : default_thread_count(),
+                         paths.size());
+    file_options.threads =
+        std::max<size_t>(1, default_thread_count() / concurrent_files);
+  }
+  // Loads running side by side share the process's peak RSS
+  std::unique_ptr<SharedPeakRss> shared_rss;
+  if (paths.size() > 1 && threads != 1) {
+    shared_rss.reset(new SharedPeakRss());
+  }
+  std::vector<Design *> designs(paths.size(), nullptr);
+  parallel_for(
+      paths.size(),
+      [&](size_t i) { designs[i] = read_json(paths[i], file_options); },
+      threads);
+  return designs;
+}
+
+bool YosysModule::all_cells_are_primitives(
+    const std::unordered_map<std::string, int> &primitive_ids) const {
   for (auto &cell : cell_counts) {
-    if (primitives.find(cell.first) == primitives.end()) {
+    if (primitive_ids.find(cell.first) == primitive_ids.end()) {
       return false;
     }
   }
   return true;
 }
 
-std::set<std::string> unique_primitives_in_design(nlohmann::json &j) {
+std::set<std::string>
+unique_primitives_in_design(const std::map<std::string, YosysModule> &modules) {
   std::set<std::string> primitives;
 
-  // Iterate all modules and check the 'blackbox'/'whitebox' attribute as a
-  // proxy for them being a device primitive
-  for (auto module_it = j["modules"].begin(); module_it != j["modules"].end();
-       ++module_it) {
-    auto &attributes = module_it.value()["attributes"];
-    auto blackbox = attributes.find("blackbox");
-    auto whitebox = attributes.find("whitebox");
-    // Does the blackbox/whitebox attribute exist?
-    if (blackbox != attributes.end() || whitebox != attributes.end()) {
-      primitives.emplace(module_it.key());
+  // Use the 'blackbox'/'whitebox' attribute as a proxy for modules being a
+  // device primitive
+  for (auto &module : modules) {
+    if (module.second.blackbox) {
+      primitives.emplace(module.first);
     }
   }
 
@@ -87,98 +718,342 @@ std::set<std::string> unique_primitives_in_design(nlohmann::json &j) {
 
 // Get the primitives that actually showed up in the design so that we don't
 // display a bunch of empty columns
-std::vector<std::string> unique_primitives_in_tree(Module *tree) {
-  // Create quick lambda to do the recursive work for us
-  std::function<void(const Module *, std::set<std::string> &)> visitor =
-      [&visitor](const Module *m, std::set<std::string> &uniq_primitives) {
-        for (auto &prim : m->primitives) {
-          uniq_primitives.emplace(prim.first);
+std::vector<std::string>
+unique_primitives_in_tree(const std::map<std::string, YosysModule> &modules,
+                          const std::set<std::string> &primitive_names,
+                          const std::string &top_module) {
+  // Walk each module reachable from the top once
+  std::set<std::string> uniq_primitives;
+  std::set<std::string> visited;
+  std::function<void(const std::string &)> visitor =
+      [&](const std::string &module_name) {
+        if (!visited.emplace(module_name).second) {
+          return;
         }
-        for (const Module *child : m->submodules) {
-          visitor(child, uniq_primitives);
+        auto search = modules.find(module_name);
+        if (search == modules.end()) {
+          return;
+        }
+        for (auto &cell : search->second.cell_counts) {
+          if (primitive_names.find(cell.first) != primitive_names.end()) {
+            uniq_primitives.emplace(cell.first);
+          } else {
+            visitor(cell.first);
+          }
         }
       };
+  visitor(top_module);
 
-  // Iterate all modules in the tree
-  std::set<std::string> uniq_primitives;
-  visitor(tree, uniq_primitives);
+  // Convert to vector. The set is already sorted by name.
+  return std::vector<std::string>(uniq_primitives.begin(),
+                                  uniq_primitives.end());
+}
+
+static_assert(std::is_trivially_destructible<Module>::value,
+              "Module nodes are never destroyed individually");
+
+Module *ModulePool::create(Module *parent, Module::Kind kind,
+                           const ModuleSummary *summary, int instances) {
+  // Reuse a released slot if there is one, otherwise take the next one from
+  // the current block, starting a new block if it is full
+  Slot *slot;
+  if (!_free_slots.empty()) {
+    slot = _free_slots.back();
+    _free_slots.pop_back();
+  } else {
+    if (_block_used == block_size) {
+      _blocks.emplace_back(new Slot[block_size]);
+      _block_used = 0;
+    }
+    slot = &_blocks.back()[_block_used++];
+  }
+  _size++;
+  return new (slot) Module(parent, kind, summary, instances);
+}
+
+void ModulePool::set_children(Module *m,
+                              const std::vector<Module *> &children) {
+  // Keep the existing range if the length is unchanged, otherwise release it
+  // and take a released range of the new length, or append a new range to the
+  // end of the link array. Ranges are always exactly as long as the list in
+  // them, so that release_children can free them by the list length.
+  if (children.size() != m->num_children) {
+    if (m->num_children) {
+      _free_ranges[m->num_children].emplace_back(m->first_child);
+    }
+    auto free_range = _free_ranges.find(children.size());
+    if (children.empty()) {
+      m->first_child = 0;
+    } else if (free_range != _free_ranges.end() &&
+               !free_range->second.empty()) {
+      m->first_child = free_range->second.back();
+      free_range->second.pop_back();
+    } else {
+      m->first_child = _links.size();
+      _links.resize(_links.size() + children.size());
+    }
+  }
+  std::copy(children.begin(), children.end(), _links.begin() + m->first_child);
+  m->num_children = children.size();
+  for (Module *child : children) {
+    child->parent = m;
+  }
+}
+
+size_t ModulePool::release_children(Module *m) {
+  size_t released = 0;
+  std::vector<Module *> pending = {m};
+  while (!pending.empty()) {
+    Module *node = pending.back();
+    pending.pop_back();
+    for (unsigned i = 0; i < node->num_children; i++) {
+      pending.emplace_back(child(node, i));
+    }
+    if (node->num_children) {
+      _free_ranges[node->num_children].emplace_back(node->first_child);
+    }
+    if (node != m) {
+      _free_slots.emplace_back(reinterpret_cast<Slot *>(node));
+      released++;
+    }
+  }
+  _size -= released;
+  m->num_children = 0;
+  m->expanded = m->kind == Module::Kind::Self;
+  return released;
+}
 
-  // Convert to vector
-  std::vector<std::string> ret(uniq_primitives.begin(), uniq_primitives.end());
-  std::sort(ret.begin(), ret.end());
-  return ret;
+size_t ModulePool::release(Module *m) {
+  const size_t released = release_children(m) + 1;
+  _free_slots.emplace_back(reinterpret_cast<Slot *>(m));
+  _size--;
+  return released;
 }
 
-void delete_module_tree(Module *m) {
-  // Recursively delete the children, then ourselves
-  for (auto submodule : m->submodules) {
-    delete_module_tree(submodule);
+Module *ModulePool::adopt(const ModulePool &other, const Module *m,
+                          Module *parent) {
+  Module *root = create(parent, m->kind, m->summary, m->instances);
+  root->instance_name = m->instance_name;
+  root->expanded = m->expanded;
+
+  // Copy any generated children, using an explicit stack rather than
+  // recursing so that deep hierarchies can't overflow the stack
+  std::vector<std::pair<const Module *, Module *>> pending = {{m, root}};
+  while (!pending.empty()) {
+    const Module *from = pending.back().first;
+    Module *to = pending.back().second;
+    pending.pop_back();
+
+    std::vector<Module *> children;
+    for (unsigned i = 0; i < from->num_children; i++) {
+      const Module *child = other.child(from, i);
+      Module *copy = create(to, child->kind, child->summary, child->instances);
+      copy->instance_name = child->instance_name;
+      copy->expanded = child->expanded;
+      children.emplace_back(copy);
+      pending.emplace_back(child, copy);
+    }
+    set_children(to, children);
   }
-  delete (m);
+  return root;
 }
 
-Module *generate_module_tree(std::map<std::string, YosysModule> modules,
-                             std::set<std::string> primitive_names,
-                             Module *parent, std::string module_name) {
-  // Look up the data we pulled from the json earlier
-  auto yosys_mod = modules[module_name];
+// Leave a summary's instance name list empty if none of them are named
+static void compact_instance_names(ModuleSummary &summary) {
+  for (const uint32_t name : summary.instance_names) {
+    if (name != StringPool::none) {
+      return;
+    }
+  }
+  summary.instance_names.clear();
+}
 
-  // Instantiate the module for the wx data tree
-  Module *mod = new Module(parent, module_name);
+// Add the instance names of a module's cells of one type to its summary, or
+// none for each if they weren't named
+static void add_instance_names(const YosysModule &module,
+                               const std::string &cell_type, int count,
+                               StringPool &names, ModuleSummary &summary) {
+  auto search = module.cell_names.find(cell_type);
+  int added = 0;
+  if (search != module.cell_names.end()) {
+    const std::string &list = search->second;
+    for (size_t start = 0; start < list.size() && added < count; added++) {
+      const size_t end = list.find('\0', start);
+      summary.instance_names.emplace_back(
+          names.intern(list.data() + start, end - start));
+      start = end + 1;
+    }
+  }
+  for (; added < count; added++) {
+    summary.instance_names.emplace_back(StringPool::none);
+  }
+}
 
-  // In order to differentiate logic used by a module and logic used by
-  // submodules of that module, create a special 'self' submodule for modules
-  // that do not consist entirely of primitives
-  Module *mod_self_primitives = nullptr;
-  if (!yosys_mod.all_cells_are_primitives(primitive_names)) {
-    mod_self_primitives = new Module(mod, " (self)");
+const ModuleSummary *
+summarize_module(const std::map<std::string, YosysModule> &modules,
+                 const std::unordered_map<std::string, int> &primitive_ids,
+                 std::map<std::string, ModuleSummary> &summaries,
+                 StringPool &names, const std::string &module_name,
+                 SummaryReuse *reuse) {
+  // If we've already summarized this module, reuse that
+  auto memo = summaries.find(module_name);
+  if (memo != summaries.end()) {
+    return &memo->second;
   }
+  ModuleSummary &summary = summaries[module_name];
+  summary.name = module_name;
+  summary.hash = hash_string(module_name);
+  summary.self_primitives.assign(primitive_ids.size(), 0);
+  summary.total_primitives.assign(primitive_ids.size(), 0);
 
-  // For each cell this module contains, recurse to build them out
-  for (auto &cell : yosys_mod.cell_counts) {
-    // If it isn't a primitive, recurse and build it out properly
-    // For non-primitives with multiple instances, we generate two hierarchy
-    // levels - one the counts all instantiations as one line item, and then
-    // each individual instantiation below that. This way, we can easily see
-    // both the individual and combined weight of the modules.
-    const bool is_primitive =
-        primitive_names.find(cell.first) != primitive_names.end();
-    if (!is_primitive) {
-      if (cell.second > 1) {
-        // Multi-instance case
-        // Create the multi-instance holder
-        Module *holder = new Module(mod, "[" + std::to_string(cell.second) +
-                                             "x] " + cell.first);
-        // Generate each individual instance tree using the holder as a parent
-        for (int i = 0; i < cell.second; i++) {
-          generate_module_tree(modules, primitive_names, holder, cell.first);
-        }
-        // Tally the holder primitive counts
-        for (auto *submod : holder->submodules) {
-          for (auto &prim : submod->primitives) {
-            holder->increment_primitive_count(prim.first, prim.second);
-          }
+  // Look up the data we pulled from the json earlier. Modules that aren't
+  // defined in the json are treated as empty.
+  auto yosys_mod_it = modules.find(module_name);
+  if (yosys_mod_it == modules.end()) {
+    return &summary;
+  }
+  const YosysModule &yosys_mod = yosys_mod_it->second;
+
+  // Copy the earlier summary of a module that hasn't changed, as long as
+  // everything below it could be copied too
+  if (reuse && !reuse->changed->count(module_name)) {
+    auto previous = reuse->previous->find(module_name);
+    if (previous != reuse->previous->end()) {
+      bool reusable = true;
+      for (auto &cell : yosys_mod.cell_counts) {
+        if (primitive_ids.count(cell.first)) {
+          continue;
         }
-      } else {
-        generate_module_tree(modules, primitive_names, mod, cell.first);
+        const ModuleSummary *submodule = summarize_module(
+            modules, primitive_ids, summaries, names, cell.first, reuse);
+        summary.submodules.emplace_back(submodule, cell.second);
+        add_instance_names(yosys_mod, cell.first, cell.second, names, summary);
+        reusable = reusable && reuse->reused.count(cell.first);
       }
-    } else {
+      if (reusable) {
+        compact_instance_names(summary);
+        summary.self_primitives = previous->second.self_primitives;
+        summary.total_primitives = previous->second.total_primitives;
+        summary.has_self = previous->second.has_self;
+        summary.hash = previous->second.hash;
+        reuse->reused.emplace(module_name);
+        return &summary;
+      }
+      summary.submodules.clear();
+      summary.instance_names.clear();
+    }
+  }
+
+  summary.has_self = !yosys_mod.all_cells_are_primitives(primitive_ids);
+
+  for (auto &cell : yosys_mod.cell_counts) {
+    auto primitive = primitive_ids.find(cell.first);
+    if (primitive != primitive_ids.end()) {
       // If it is a primitive, just update the counter for it
-      if (mod_self_primitives) {
-        mod_self_primitives->set_primitive_count(cell.first, cell.second);
-      } else {
-        mod->set_primitive_count(cell.first, cell.second);
+      summary.self_primitives[primitive->second] = cell.second;
+    } else {
+      // If it isn't, summarize the submodule and add its resources once per
+      // instance
+      const ModuleSummary *submodule = summarize_module(
+          modules, primitive_ids, summaries, names, cell.first, reuse);
+      summary.submodules.emplace_back(submodule, cell.second);
+      add_instance_names(yosys_mod, cell.first, cell.second, names, summary);
+      for (unsigned i = 0; i < submodule->total_primitives.size(); i++) {
+        summary.total_primitives[i] +=
+            submodule->total_primitives[i] * cell.second;
       }
     }
   }
 
-  // Now that we have built the children for this node, iterate them and sum
-  // their primitive counts to get our own primitive count
-  for (auto *submod : mod->submodules) {
-    for (auto &prim : submod->primitives) {
-      mod->increment_primitive_count(prim.first, prim.second);
+  // Our own primitives count towards the total too
+  for (unsigned i = 0; i < summary.self_primitives.size(); i++) {
+    summary.total_primitives[i] += summary.self_primitives[i];
+  }
+
+  // Hash everything that ends up in the display tree
+  hash_combine(summary.hash, summary.has_self);
+  for (unsigned i = 0; i < summary.self_primitives.size(); i++) {
+    if (summary.self_primitives[i]) {
+      hash_combine(summary.hash, i);
+      hash_combine(summary.hash, summary.self_primitives[i]);
     }
   }
+  for (auto &submodule : summary.submodules) {
+    hash_combine(summary.hash, submodule.first->hash);
+    hash_combine(summary.hash, submodule.second);
+  }
+  compact_instance_names(summary);
+
+  return &summary;
+}
+
+// Get the name of the i'th instance in a summary's submodule list
+static uint32_t instance_name(const ModuleSummary *summary, size_t i) {
+  return i < summary->instance_names.size() ? summary->instance_names[i]
+                                            : StringPool::none;
+}
+
+void expand_module(ModulePool &pool, Module *mod) {
+  if (mod->expanded) {
+    return;
+  }
+  mod->expanded = true;
 
-  return mod;
+  std::vector<Module *> children;
+  if (mod->kind == Module::Kind::Holder) {
+    // Generate each individual instance using the holder as a parent. Their
+    // names follow those of the instances before them in the parent's list.
+    const ModuleSummary *parent = mod->parent->summary;
+    size_t first_name = 0;
+    for (auto &submodule : parent->submodules) {
+      if (submodule.first == mod->summary) {
+        break;
+      }
+      first_name += submodule.second;
+    }
+    for (int i = 0; i < mod->instances; i++) {
+      children.emplace_back(
+          pool.create(mod, Module::Kind::Instance, mod->summary));
+      children.back()->instance_name =
+          instance_name(parent, first_name + i);
+    }
+  } else {
+    // Logic used by the module itself
+    if (mod->summary->has_self) {
+      children.emplace_back(
+          pool.create(mod, Module::Kind::Self, mod->summary));
+    }
+
+    // Submodules, grouped under a holder if there are multiple instances
+    size_t name = 0;
+    for (auto &submodule : mod->summary->submodules) {
+      if (submodule.second > 1) {
+        children.emplace_back(pool.create(mod, Module::Kind::Holder,
+                                          submodule.first, submodule.second));
+      } else {
+        children.emplace_back(
+            pool.create(mod, Module::Kind::Instance, submodule.first));
+        children.back()->instance_name = instance_name(mod->summary, name);
+      }
+      name += submodule.second;
+    }
+  }
+  pool.set_children(mod, children);
+}
+
+std::string instance_path(const StringPool &names, const Module *m) {
+  std::vector<const Module *> chain;
+  for (const Module *node = m; node; node = node->parent) {
+    if (node == m || node->kind != Module::Kind::Holder) {
+      chain.emplace_back(node);
+    }
+  }
+  std::string path;
+  for (size_t i = chain.size(); i-- > 0;) {
+    if (!path.empty()) {
+      path += "/";
+    }
+    path += chain[i]->path_name(names);
+  }
+  return path;
 }
@@ -0,0 +1,241 @@
+#include <algorithm>
+
+#include <yostat/query.hpp>
+
+namespace {
+
+const char *format_name(ReportFormat format) {
+  switch (format) {
+  case ReportFormat::Csv:
+    return "csv";
+  case ReportFormat::Json:
+    return "json";
+  default:
+    return "text";
+  }
+}
+
+// Read an optional field of a request, checking its type
+template <typename T, typename Check>
+bool read_field(const nlohmann::json &json, const char *key, Check check,
+                T &value, std::string &error) {
+  auto search = json.find(key);
+  if (search == json.end()) {
+    return true;
+  }
+  if (!check(*search)) {
+    error = std::string("Invalid value for \"") + key + "\"";
+    return false;
+  }
+  value = search->template get<T>();
+  return true;
+}
+
+bool is_bool(const nlohmann::json &json) { return json.is_boolean(); }
+bool is_int(const nlohmann::json &json) { return json.is_number_integer(); }
+bool is_string(const nlohmann::json &json) { return json.is_string(); }
+bool is_strings(const nlohmann::json &json) {
+  if (!json.is_array()) {
+    return false;
+  }
+  for (auto &item : json) {
+    if (!item.is_string()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+std::vector<std::string> Query::inputs() const {
+  std::vector<std::string> paths = files;
+  if (!baseline.empty()) {
+    paths.insert(paths.begin(), baseline);
+  }
+  return paths;
+}
+
+bool check_query(const Query &query, std::string &error) {
+  if (query.files.empty()) {
+    error = "No json files given";
+    return false;
+  }
+  if (!query.baseline.empty() && query.files.size() != 1) {
+    error = "--baseline takes exactly one other json file";
+    return false;
+  }
+  if (query.rank && query.inputs().size() != 1) {
+    error = "--top takes a single json file";
+    return false;
+  }
+  if (!query.labels.empty() && query.labels.size() != query.inputs().size()) {
+    error = "Expected a label for each file";
+    return false;
+  }
+  if (!query.subtree.empty() && query.inputs().size() != 1) {
+    error = "--subtree takes a single json file";
+    return false;
+  }
+  return true;
+}
+
+bool run_query(const Query &query,
+               const std::vector<std::shared_ptr<Design>> &designs,
+               std::ostream &os, std::string &error) {
+  if (!check_query(query, error)) {
+    return false;
+  }
+  ReportOptions options = query.options;
+  CostModel cost_model;
+  options.cost_model = nullptr;
+  if (!query.cost_model.empty()) {
+    if (!read_cost_model(query.cost_model, cost_model, error)) {
+      return false;
+    }
+    options.cost_model = &cost_model;
+  }
+  options.subtree = nullptr;
+  if (!query.subtree.empty()) {
+    options.subtree = find_instance_path(*designs[0], query.subtree);
+    if (!options.subtree) {
+      error = "No instance '" + query.subtree + "' in the design";
+      return false;
+    }
+  }
+
+  if (query.rank) {
+    Design &design = *designs[0];
+    RankQuery rank_query = query.rank_query;
+    rank_query.weights.clear();
+    if (query.rank_weights.empty() && options.cost_model) {
+      rank_query.weights = cost_model.weights(design);
+      if (rank_query.weights.empty()) {
+        error = "The cost model doesn't cost any primitive in the design";
+        return false;
+      }
+    } else if (query.rank_weights.empty()) {
+      for (size_t i = 0; i < design.primitives.size(); i++) {
+        rank_query.weights.emplace_back(i, 1);
+      }
+    } else if (!parse_rank_weights(design, query.rank_weights,
+                                   rank_query.weights, error)) {
+      return false;
+    }
+    write_rank_report(os, design, rank_query,
+                      rank_contributors(design, rank_query),
+                      options.format);
+  } else if (designs.size() == 1) {
+    if (options.categories && !designs[0]->family) {
+      error = "Category columns need the design to be loaded with --family";
+      return false;
+    }
+    write_report(os, *designs[0], options);
+  } else {
+    DesignComparison comparison(designs, query.labels.empty()
+                                             ? query.inputs()
+                                             : query.labels);
+    if (!query.baseline.empty()) {
+      write_delta_report(os, comparison, options);
+    } else {
+      write_comparison_report(os, comparison, options);
+    }
+  }
+  return true;
+}
+
+nlohmann::json query_json(const Query &query) {
+  nlohmann::json json;
+  json["files"] = query.files;
+  if (!query.baseline.empty()) {
+    json["baseline"] = query.baseline;
+  }
+  if (!query.labels.empty()) {
+    json["labels"] = query.labels;
+  }
+  const ReportOptions &options = query.options;
+  json["format"] = format_name(options.format);
+  if (options.max_depth >= 0) {
+    json["depth"] = options.max_depth;
+  }
+  if (!options.primitives.empty()) {
+    json["primitives"] = options.primitives;
+  }
+  if (options.all_instances) {
+    json["all_instances"] = true;
+  }
+  if (options.changed_only) {
+    json["changed_only"] = true;
+  }
+  if (options.sort_by_delta) {
+    json["sort_delta"] = true;
+  }
+  if (!options.search.empty()) {
+    json["search"] = options.search;
+  }
+  if (!query.subtree.empty()) {
+    json["subtree"] = query.subtree;
+  }
+  if (!query.cost_model.empty()) {
+    json["cost_model"] = query.cost_model;
+  }
+  if (options.categories) {
+    json["categories"] = true;
+  }
+  if (query.rank) {
+    json["top"] = query.rank_query.count;
+    if (!query.rank_weights.empty()) {
+      json["rank"] = query.rank_weights;
+    }
+    if (query.rank_query.self) {
+      json["self"] = true;
+    }
+    if (query.rank_query.modules) {
+      json["modules"] = true;
+    }
+  }
+  return json;
+}
+
+bool parse_query(const nlohmann::json &json, Query &query, std::string &error) {
+  if (!json.is_object()) {
+    error = "Expected a json object";
+    return false;
+  }
+  ReportOptions &options = query.options;
+  std::string format;
+  int top = -1;
+  if (!read_field(json, "files", is_strings, query.files, error) ||
+      !read_field(json, "baseline", is_string, query.baseline, error) ||
+      !read_field(json, "labels", is_strings, query.labels, error) ||
+      !read_field(json, "format", is_string, format, error) ||
+      !read_field(json, "depth", is_int, options.max_depth, error) ||
+      !read_field(json, "primitives", is_strings, options.primitives,
+                  error) ||
+      !read_field(json, "all_instances", is_bool, options.all_instances,
+                  error) ||
+      !read_field(json, "changed_only", is_bool, options.changed_only,
+                  error) ||
+      !read_field(json, "sort_delta", is_bool, options.sort_by_delta,
+                  error) ||
+      !read_field(json, "search", is_string, options.search, error) ||
+      !read_field(json, "subtree", is_string, query.subtree, error) ||
+      !read_field(json, "cost_model", is_string, query.cost_model, error) ||
+      !read_field(json, "categories", is_bool, options.categories, error) ||
+      !read_field(json, "top", is_int, top, error) ||
+      !read_field(json, "rank", is_string, query.rank_weights, error) ||
+      !read_field(json, "self", is_bool, query.rank_query.self, error) ||
+      !read_field(json, "modules", is_bool, query.rank_query.modules,
+                  error)) {
+    return false;
+  }
+  if (!format.empty() && !parse_report_format(format, options.format)) {
+    error = "Unknown report format '" + format + "'";
+    return false;
+  }
+  if (json.count("top")) {
+    query.rank = true;
+    query.rank_query.count = std::max(0, top);
+  }
+  return true;
+}
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+#include <yostat/rank.hpp>
+
+namespace {
+
+// Weighted score of a count array
+double weighted(const std::vector<int> &counts,
+                const std::vector<std::pair<int, double>> &weights) {
+  double score = 0;
+  for (auto &weight : weights) {
+    if (weight.first >= 0 && weight.first < (int)counts.size()) {
+      score += counts[weight.first] * weight.second;
+    }
+  }
+  return score;
+}
+
+// Order of paths for breaking ties between equal scores, so that which tied
+// entries make the cut doesn't depend on the count asked for: by module name
+// at each level, then summary id, with a path before everything below it
+bool path_before(const std::vector<const ModuleSummary *> &a,
+                 const std::vector<const ModuleSummary *> &b) {
+  return std::lexicographical_compare(
+      a.begin(), a.end(), b.begin(), b.end(),
+      [](const ModuleSummary *x, const ModuleSummary *y) {
+        return x->name != y->name ? x->name < y->name : x->id < y->id;
+      });
+}
+
+// Whether one entry ranks ahead of another
+bool ranks_before(const RankEntry &a, const RankEntry &b,
+                  const RankQuery &query) {
+  const double a_score = a.rank_score(query);
+  const double b_score = b.rank_score(query);
+  if (a_score != b_score) {
+    return a_score > b_score;
+  }
+  return path_before(a.path, b.path);
+}
+
+// Keeps the best count entries seen so far, with the worst of them on top
+class BestEntries {
+public:
+  BestEntries(const RankQuery &query) : _query(query) {}
+
+  bool full() const { return _entries.size() >= _query.count; }
+  // Entry that another needs to rank ahead of to get in
+  const RankEntry &worst() const { return _entries.front(); }
+
+  void add(RankEntry entry) {
+    if (_query.count == 0 || entry.rank_score(_query) <= 0) {
+      return;
+    }
+    if (full()) {
+      if (!ranks_before(entry, worst(), _query)) {
+        return;
+      }
+      std::pop_heap(_entries.begin(), _entries.end(), worse());
+      _entries.pop_back();
+    }
+    _entries.emplace_back(std::move(entry));
+    std::push_heap(_entries.begin(), _entries.end(), worse());
+  }
+
+  // Take the entries, best first
+  std::vector<RankEntry> take() {
+    std::sort_heap(_entries.begin(), _entries.end(), worse());
+    return std::move(_entries);
+  }
+
+private:
+  // Heap order that puts the worst entry on top
+  std::function<bool(const RankEntry &, const RankEntry &)> worse() const {
+    const RankQuery &query = _query;
+    return [&query](const RankEntry &a, const RankEntry &b) {
+      return ranks_before(a, b, query);
+    };
+  }
+
+  const RankQuery &_query;
+  std::vector<RankEntry> _entries;
+};
+
+std::vector<RankEntry> rank_modules(const Design &design,
+                                    const RankQuery &query) {
+  // Order the modules so that every module comes after all of its parents,
+  // by reversing a depth first postorder from the top
+  const ModuleSummary *top = design.top->summary;
+  std::vector<const ModuleSummary *> order;
+  std::unordered_map<const ModuleSummary *, uint64_t> instances;
+  std::vector<std::pair<const ModuleSummary *, size_t>> pending = {{top, 0}};
+  instances[top] = 0;
+  while (!pending.empty()) {
+    const ModuleSummary *summary = pending.back().first;
+    const size_t next = pending.back().second++;
+    if (next < summary->submodules.size()) {
+      const ModuleSummary *submodule = summary->submodules[next].first;
+      if (instances.emplace(submodule, 0).second) {
+        pending.emplace_back(submodule, 0);
+      }
+    } else {
+      order.emplace_back(summary);
+      pending.pop_back();
+    }
+  }
+  std::reverse(order.begin(), order.end());
+
+  // Count the instances of each module, then score them
+  instances[top] = 1;
+  BestEntries best(query);
+  for (const ModuleSummary *summary : order) {
+    for (auto &submodule : summary->submodules) {
+      instances[submodule.first] += instances[summary] * submodule.second;
+    }
+    RankEntry entry;
+    entry.path = {summary};
+    entry.instances = instances[summary];
+    entry.score = weighted(query.self ? summary->self_primitives
+                                      : summary->total_primitives,
+                           query.weights);
+    best.add(std::move(entry));
+  }
+  return best.take();
+}
+
+std::vector<RankEntry> rank_instances(const Design &design,
+                                      const RankQuery &query) {
+  // Paths still to be looked at, as a tree of (module, parent) links so that
+  // sharing a prefix is free
+  struct Step {
+    const ModuleSummary *summary;
+    int64_t parent;
+    uint64_t instances;
+    // Hierarchical total, which nothing at or below this step can exceed
+    double bound;
+  };
+  std::vector<Step> steps;
+  auto path_of = [&](int64_t i) {
+    std::vector<const ModuleSummary *> path;
+    for (; i >= 0; i = steps[i].parent) {
+      path.emplace_back(steps[i].summary);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+  };
+  // Highest bound first, ties in path order like the results
+  auto by_bound = [&](size_t a, size_t b) {
+    if (steps[a].bound != steps[b].bound) {
+      return steps[a].bound < steps[b].bound;
+    }
+    return path_before(path_of(b), path_of(a));
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(by_bound)>
+      frontier(by_bound);
+
+  auto visit = [&](const ModuleSummary *summary, int64_t parent,
+                   uint64_t instances) {
+    const double bound = weighted(summary->total_primitives, query.weights);
+    if (bound > 0) {
+      steps.push_back({summary, parent, instances, bound});
+      frontier.push(steps.size() - 1);
+    }
+  };
+  visit(design.top->summary, -1, 1);
+
+  BestEntries best(query);
+  while (!frontier.empty()) {
+    const size_t i = frontier.top();
+    frontier.pop();
+
+    // Everything left scores at most this bound, and on a tie comes after
+    // this path, so stop once that can't rank ahead of the worst kept entry
+    RankEntry entry;
+    entry.instances = steps[i].instances;
+    entry.score = steps[i].bound;
+    entry.path = path_of(i);
+    if (best.full() && !ranks_before(entry, best.worst(), query)) {
+      break;
+    }
+    if (query.self) {
+      entry.score = weighted(steps[i].summary->self_primitives, query.weights);
+    }
+    best.add(std::move(entry));
+
+    const ModuleSummary *summary = steps[i].summary;
+    const uint64_t instances = steps[i].instances;
+    for (auto &submodule : summary->submodules) {
+      visit(submodule.first, i, instances * submodule.second);
+    }
+  }
+  return best.take();
+}
+
+} // namespace
+
+std::string RankEntry::path_name() const {
+  std::string name;
+  for (const ModuleSummary *summary : path) {
+    if (!name.empty()) {
+      name += "/";
+    }
+    name += summary->name;
+  }
+  return name;
+}
+
+bool parse_rank_weights(const Design &design, const std::string &list,
+                        std::vector<std::pair<int, double>> &weights,
+                        std::string &error) {
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    const std::string item = list.substr(start, end - start);
+    start = end + 1;
+    if (item.empty()) {
+      continue;
+    }
+
+    // Split off the weight, if there is one
+    std::string primitive = item;
+    double weight = 1;
+    const size_t equals = item.find('=');
+    if (equals != std::string::npos) {
+      primitive = item.substr(0, equals);
+      const std::string value = item.substr(equals + 1);
+      char *value_end = nullptr;
+      weight = strtod(value.c_str(), &value_end);
+      if (value.empty() || *value_end || weight < 0) {
+        error = "Invalid weight '" + value + "' for " + primitive;
+        return false;
+      }
+    }
+    auto search = design.primitive_ids.find(primitive);
+    if (search == design.primitive_ids.end()) {
+      error = "Unknown primitive '" + primitive + "'";
+      return false;
+    }
+    weights.emplace_back(search->second, weight);
+  }
+  if (weights.empty()) {
+    error = "No primitives to rank by";
+    return false;
+  }
+  return true;
+}
+
+std::vector<RankEntry> rank_contributors(const Design &design,
+                                         const RankQuery &query) {
+  return query.modules ? rank_modules(design, query)
+                       : rank_instances(design, query);
+}
+
+Module *find_instance(Design &design,
+                      const std::vector<const ModuleSummary *> &path) {
+  if (path.empty() || design.top->summary != path[0]) {
+    return nullptr;
+  }
+  // Follow the path down, looking through holders to their first instance
+  Module *m = design.top;
+  for (size_t i = 1; i < path.size(); i++) {
+    expand_module(design.nodes, m);
+    Module *next = nullptr;
+    for (unsigned c = 0; c < m->num_children && !next; c++) {
+      Module *child = design.nodes.child(m, c);
+      if (child->kind != Module::Kind::Self && child->summary == path[i]) {
+        next = child;
+      }
+    }
+    if (!next) {
+      return nullptr;
+    }
+    if (next->kind == Module::Kind::Holder) {
+      expand_module(design.nodes, next);
+      if (!next->num_children) {
+        return nullptr;
+      }
+      next = design.nodes.child(next, 0);
+    }
+    m = next;
+  }
+  return m;
+}
+
+// Find the child instance of a node with a given instance name, looking
+// through holders. Failing that, find the first instance of the module with
+// that name.
+static Module *find_child(Design &design, Module *m, const std::string &name) {
+  expand_module(design.nodes, m);
+  Module *first_of_module = nullptr;
+  for (unsigned c = 0; c < m->num_children; c++) {
+    Module *child = design.nodes.child(m, c);
+    if (child->kind == Module::Kind::Self) {
+      continue;
+    }
+    std::vector<Module *> instances = {child};
+    if (child->kind == Module::Kind::Holder) {
+      expand_module(design.nodes, child);
+      instances = design.nodes.children(child);
+    }
+    for (Module *instance : instances) {
+      if (instance->path_name(design.names) == name) {
+        return instance;
+      }
+      if (!first_of_module && instance->summary->name == name) {
+        first_of_module = instance;
+      }
+    }
+  }
+  return first_of_module;
+}
+
+Module *find_instance_path(Design &design, const std::string &path) {
+  Module *m = nullptr;
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    const std::string name = path.substr(start, end - start);
+    if (!m) {
+      if (design.top->summary->name != name) {
+        return nullptr;
+      }
+      m = design.top;
+    } else if (!(m = find_child(design, m, name))) {
+      return nullptr;
+    }
+    start = end + 1;
+  }
+  return m;
+}
@@ -0,0 +1,700 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <memory>
+
+#include <nlohmann/json.hpp>
+
+#include <yostat/report.hpp>
+#include <yostat/search.hpp>
+
+namespace {
+
+// One line of the report
+struct ReportRow {
+  int depth;
+  std::string name;
+  // Hierarchical path, with each level separated by '/'
+  std::string path;
+  // One value per column of each column group
+  std::vector<double> values;
+};
+
+// A group of primitive columns
+struct ReportGroup {
+  std::string name;
+  // Whether the values are percentages rather than counts
+  bool percent = false;
+};
+
+// A column worked out from the counts of a row, reported after the groups
+struct ReportDerived {
+  std::string name;
+  // Key the column is nested under in json output
+  std::string key;
+  // Whether the value is a percentage, or a whole count
+  bool percent = false;
+  bool count = false;
+};
+
+// Everything that goes into a report, independent of output format
+struct ReportTable {
+  // Column groups, e.g. one per input design. A report on a single design has
+  // a single unnamed group.
+  std::vector<ReportGroup> groups;
+  // Key that named groups are nested under in json output
+  std::string group_key = "inputs";
+  // Primitive names, repeated for each group
+  std::vector<std::string> columns;
+  // Derived columns
+  std::vector<ReportDerived> derived;
+  std::vector<ReportRow> rows;
+};
+
+// Display names are padded for the GUI (' (self)'), which we don't want in
+// paths or structured output
+std::string report_name(const std::string &display_name) {
+  std::string name = display_name;
+  name.erase(0, name.find_first_not_of(' '));
+  return name;
+}
+
+// Quote a CSV field if it needs it
+std::string csv_escape(const std::string &field) {
+  if (field.find_first_of(",\"\n") == std::string::npos) {
+    return field;
+  }
+  std::string escaped = "\"";
+  for (const char c : field) {
+    if (c == '"') {
+      escaped += '"';
+    }
+    escaped += c;
+  }
+  return escaped + "\"";
+}
+
+// Format a count or percentage for text or CSV output
+std::string format_value(double value, bool percent) {
+  if (!percent) {
+    return std::to_string((long)value);
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "+inf%" : "-inf%";
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%+.1f%%", value);
+  return buf;
+}
+
+// Format a derived value for text or CSV output
+std::string format_derived(double value, const ReportDerived &derived) {
+  if (derived.count) {
+    return std::to_string((long)value);
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), derived.percent ? "%.1f%%" : "%.1f", value);
+  return buf;
+}
+
+// Format a history timestamp as UTC, e.g. "2026-10-01T02:00:00Z"
+std::string format_time(int64_t timestamp) {
+  const time_t t = timestamp;
+  struct tm utc;
+  char buf[32];
+  if (!gmtime_r(&t, &utc) ||
+      !strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &utc)) {
+    return std::to_string(timestamp);
+  }
+  return buf;
+}
+
+// Format a history count for text or CSV output. Builds without the module
+// have no count.
+std::string format_history_count(int count) {
+  return count < 0 ? "-" : std::to_string(count);
+}
+
+// Flatten a tree into report rows, depth first, down to the depth limit.
+// children(node, list) fills in the children of a node to report, name(node)
+// gets the display name of a node and values(node, row) fills in the values
+// for a row.
+template <typename Node, typename ChildrenFn, typename NameFn,
+          typename ValuesFn>
+void flatten_tree(Node *top, const ReportOptions &options, ChildrenFn children,
+                  NameFn name, ValuesFn values, ReportTable &table) {
+  struct Pending {
+    int depth;
+    std::string path;
+    Node *node;
+  };
+  const std::string top_name = report_name(name(top));
+  std::vector<Pending> pending = {{0, top_name, top}};
+  std::vector<Node *> child_list;
+  while (!pending.empty()) {
+    Pending p = pending.back();
+    pending.pop_back();
+
+    ReportRow row;
+    row.depth = p.depth;
+    row.name = report_name(name(p.node));
+    row.path = p.path;
+    values(p.node, row);
+    table.rows.emplace_back(std::move(row));
+    if (options.max_depth >= 0 && p.depth >= options.max_depth) {
+      continue;
+    }
+
+    // Push in reverse so that children come out in order
+    child_list.clear();
+    children(p.node, child_list);
+    for (size_t i = child_list.size(); i-- > 0;) {
+      Node *child = child_list[i];
+      pending.push_back(
+          {p.depth + 1, p.path + "/" + report_name(name(child)), child});
+    }
+  }
+}
+
+// Resolve the primitives to report against a list of available primitives
+std::vector<int> report_columns(const std::vector<std::string> &available,
+                                const ReportOptions &options) {
+  std::vector<int> columns;
+  if (options.primitives.empty()) {
+    for (unsigned i = 0; i < available.size(); i++) {
+      columns.emplace_back(i);
+    }
+  } else {
+    for (auto &primitive : options.primitives) {
+      auto search = std::find(available.begin(), available.end(), primitive);
+      if (search != available.end()) {
+        columns.emplace_back(search - available.begin());
+      }
+    }
+  }
+  return columns;
+}
+
+// Column header for a given group and column
+std::string column_title(const ReportTable &table, size_t group,
+                         size_t column) {
+  if (table.groups[group].name.empty()) {
+    return table.columns[column];
+  }
+  return table.groups[group].name + ":" + table.columns[column];
+}
+
+void write_table(std::ostream &os, const ReportTable &table,
+                 ReportFormat format) {
+  const size_t num_columns = table.groups.size() * table.columns.size();
+  auto is_percent = [&](size_t i) {
+    return table.groups[i / table.columns.size()].percent;
+  };
+
+  switch (format) {
+  case ReportFormat::Text: {
+    // Size the name column to fit the deepest, longest name, and each value
+    // column to fit its title
+    size_t name_width = 6;
+    for (auto &row : table.rows) {
+      name_width = std::max(name_width, row.depth * 2 + row.name.size());
+    }
+    std::vector<size_t> widths;
+    os << std::left << std::setw(name_width) << "Module";
+    for (size_t g = 0; g < table.groups.size(); g++) {
+      for (size_t c = 0; c < table.columns.size(); c++) {
+        const std::string title = column_title(table, g, c);
+        widths.emplace_back(std::max<size_t>(title.size(), 8));
+        os << "  " << std::right << std::setw(widths.back()) << title;
+      }
+    }
+    for (auto &derived : table.derived) {
+      widths.emplace_back(std::max<size_t>(derived.name.size(), 8));
+      os << "  " << std::right << std::setw(widths.back()) << derived.name;
+    }
+    os << "\n";
+    for (auto &row : table.rows) {
+      os << std::left << std::setw(name_width)
+         << std::string(row.depth * 2, ' ') + row.name;
+      for (size_t i = 0; i < num_columns; i++) {
+        os << "  " << std::right << std::setw(widths[i])
+           << format_value(row.values[i], is_percent(i));
+      }
+      for (size_t i = 0; i < table.derived.size(); i++) {
+        os << "  " << std::right << std::setw(widths[num_columns + i])
+           << format_derived(row.values[num_columns + i], table.derived[i]);
+      }
+      os << "\n";
+    }
+    break;
+  }
+
+  case ReportFormat::Csv: {
+    os << "path,depth";
+    for (size_t g = 0; g < table.groups.size(); g++) {
+      for (size_t c = 0; c < table.columns.size(); c++) {
+        os << "," << csv_escape(column_title(table, g, c));
+      }
+    }
+    for (auto &derived : table.derived) {
+      os << "," << csv_escape(derived.name);
+    }
+    os << "\n";
+    for (auto &row : table.rows) {
+      os << csv_escape(row.path) << "," << row.depth;
+      for (size_t i = 0; i < num_columns; i++) {
+        os << "," << format_value(row.values[i], is_percent(i));
+      }
+      for (size_t i = 0; i < table.derived.size(); i++) {
+        os << ","
+           << format_derived(row.values[num_columns + i], table.derived[i]);
+      }
+      os << "\n";
+    }
+    break;
+  }
+
+  case ReportFormat::Json: {
+    // Rows are in depth first order, so the parent of each row is the most
+    // recent row one level up
+    const bool grouped =
+        table.groups.size() != 1 || !table.groups[0].name.empty();
+    nlohmann::json root;
+    std::vector<nlohmann::json *> stack;
+    for (auto &row : table.rows) {
+      nlohmann::json node;
+      node["name"] = row.name;
+      for (size_t g = 0; g < table.groups.size(); g++) {
+        nlohmann::json &counts =
+            grouped ? node[table.group_key][table.groups[g].name]
+                    : node["primitives"];
+        counts = nlohmann::json::object();
+        for (size_t c = 0; c < table.columns.size(); c++) {
+          // Infinite percentages come out as null
+          const double value = row.values[g * table.columns.size() + c];
+          if (table.groups[g].percent) {
+            counts[table.columns[c]] = value;
+          } else {
+            counts[table.columns[c]] = (long)value;
+          }
+        }
+      }
+      for (size_t i = 0; i < table.derived.size(); i++) {
+        const ReportDerived &derived = table.derived[i];
+        const double value = row.values[num_columns + i];
+        if (derived.count) {
+          node[derived.key][derived.name] = (long)value;
+        } else {
+          node[derived.key][derived.name] = value;
+        }
+      }
+      node["children"] = nlohmann::json::array();
+
+      stack.resize(row.depth);
+      nlohmann::json *slot;
+      if (stack.empty()) {
+        root = std::move(node);
+        slot = &root;
+      } else {
+        auto &children = (*stack.back())["children"];
+        children.emplace_back(std::move(node));
+        slot = &children.back();
+      }
+      stack.emplace_back(slot);
+    }
+    os << root.dump(2) << "\n";
+    break;
+  }
+  }
+}
+
+// Get the children of an aligned node to report
+void comparison_children(DesignComparison &comparison, AlignedNode *node,
+                         const ReportOptions &options,
+                         std::vector<AlignedNode *> &children) {
+  comparison.expand(node);
+  // Only holders in every design that has this node can be trimmed
+  bool is_holder = true;
+  for (const Module *m : node->modules) {
+    if (m && m->kind != Module::Kind::Holder) {
+      is_holder = false;
+    }
+  }
+  size_t num_children = node->children.size();
+  if (is_holder && !options.all_instances) {
+    num_children = std::min<size_t>(num_children, 1);
+  }
+  for (size_t i = 0; i < num_children; i++) {
+    // Unchanged subtrees are dropped without being walked
+    if (!options.changed_only || !comparison.unchanged(node->children[i])) {
+      children.emplace_back(node->children[i]);
+    }
+  }
+}
+
+} // namespace
+
+bool parse_report_format(const std::string &name, ReportFormat &format) {
+  if (name == "text") {
+    format = ReportFormat::Text;
+  } else if (name == "csv") {
+    format = ReportFormat::Csv;
+  } else if (name == "json") {
+    format = ReportFormat::Json;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void write_report(std::ostream &os, Design &design,
+                  const ReportOptions &options) {
+  ReportTable table;
+  table.groups.resize(1);
+  const std::vector<int> columns = report_columns(design.primitives, options);
+  for (int col : columns) {
+    table.columns.emplace_back(design.primitives[col]);
+  }
+
+  // Category of each primitive, and the categories that columns are reported
+  // for: those of every primitive in the design, whichever are reported
+  std::vector<PrimitiveCategory> primitive_categories;
+  std::vector<PrimitiveCategory> categories;
+  if (options.categories && design.family) {
+    bool used[num_primitive_categories] = {};
+    for (auto &primitive : design.primitives) {
+      primitive_categories.emplace_back(design.family->category(primitive));
+      used[(size_t)primitive_categories.back()] = true;
+    }
+    for (size_t c = 0; c < num_primitive_categories; c++) {
+      if (used[c]) {
+        categories.emplace_back((PrimitiveCategory)c);
+        table.derived.push_back(
+            {category_name(categories.back()), "categories", false, true});
+      }
+    }
+  }
+
+  std::unique_ptr<CostColumns> costs;
+  if (options.cost_model) {
+    costs.reset(new CostColumns(design, *options.cost_model));
+    table.derived.push_back({"cost", "cost_model", false, false});
+    table.derived.push_back({"device%", "cost_model", true, false});
+  }
+
+  std::unique_ptr<SearchIndex> index;
+  std::unique_ptr<SearchResult> search;
+  if (!options.search.empty()) {
+    index.reset(new SearchIndex(design));
+    search.reset(new SearchResult(*index, design, options.search));
+  }
+
+  flatten_tree(
+      options.subtree ? options.subtree : design.top, options,
+      [&](Module *m, std::vector<Module *> &children) {
+        expand_module(design.nodes, m);
+        // Holders only show their first instance, or when searching, their
+        // first instance with a match
+        for (unsigned i = 0; i < m->num_children; i++) {
+          Module *child = design.nodes.child(m, i);
+          if (search && !search->visible(child)) {
+            continue;
+          }
+          children.emplace_back(child);
+          if (m->kind == Module::Kind::Holder && !options.all_instances) {
+            break;
+          }
+        }
+      },
+      [&](Module *m) { return m->name(design.names); },
+      [&](Module *m, ReportRow &row) {
+        // Name rows by their real instance path rather than the display
+        // names of the rows above them
+        row.path = instance_path(design.names, m);
+        for (int col : columns) {
+          row.values.emplace_back(m->get_primitive_count(col));
+        }
+        for (PrimitiveCategory category : categories) {
+          int total = 0;
+          for (size_t i = 0; i < primitive_categories.size(); i++) {
+            if (primitive_categories[i] == category) {
+              total += m->get_primitive_count(i);
+            }
+          }
+          row.values.emplace_back(total);
+        }
+        if (costs) {
+          row.values.emplace_back(costs->cost(m));
+          row.values.emplace_back(costs->device(m));
+        }
+      },
+      table);
+  write_table(os, table, options.format);
+}
+
+void write_comparison_report(std::ostream &os, DesignComparison &comparison,
+                             const ReportOptions &options) {
+  ReportTable table;
+  for (size_t i = 0; i < comparison.num_designs(); i++) {
+    table.groups.emplace_back();
+    table.groups.back().name = comparison.label(i);
+  }
+  const std::vector<int> columns =
+      report_columns(comparison.primitives(), options);
+  for (int col : columns) {
+    table.columns.emplace_back(comparison.primitives()[col]);
+  }
+
+  flatten_tree(
+      comparison.top(), options,
+      [&](AlignedNode *node, std::vector<AlignedNode *> &children) {
+        comparison_children(comparison, node, options, children);
+      },
+      [](AlignedNode *node) { return node->name; },
+      [&](AlignedNode *node, ReportRow &row) {
+        for (size_t i = 0; i < comparison.num_designs(); i++) {
+          for (int col : columns) {
+            row.values.emplace_back(
+                comparison.get_primitive_count(node, i, col));
+          }
+        }
+      },
+      table);
+  write_table(os, table, options.format);
+}
+
+void write_delta_report(std::ostream &os, DesignComparison &comparison,
+                        const ReportOptions &options) {
+  ReportTable table;
+  table.group_key = "delta";
+  for (const char *name : {"baseline", "candidate", "delta", "delta%"}) {
+    table.groups.emplace_back();
+    table.groups.back().name = name;
+  }
+  table.groups.back().percent = true;
+  const std::vector<int> columns =
+      report_columns(comparison.primitives(), options);
+  for (int col : columns) {
+    table.columns.emplace_back(comparison.primitives()[col]);
+  }
+
+  // Total increase across the reported primitives, for ordering regressions
+  auto growth = [&](const AlignedNode *node) {
+    long total = 0;
+    for (int col : columns) {
+      total += comparison.get_delta(node, col).delta();
+    }
+    return total;
+  };
+
+  flatten_tree(
+      comparison.top(), options,
+      [&](AlignedNode *node, std::vector<AlignedNode *> &children) {
+        comparison_children(comparison, node, options, children);
+        if (options.sort_by_delta) {
+          std::vector<std::pair<long, AlignedNode *>> keyed;
+          for (AlignedNode *child : children) {
+            keyed.emplace_back(growth(child), child);
+          }
+          std::stable_sort(keyed.begin(), keyed.end(),
+                           [](const std::pair<long, AlignedNode *> &a,
+                              const std::pair<long, AlignedNode *> &b) {
+                             return a.first > b.first;
+                           });
+          for (size_t i = 0; i < keyed.size(); i++) {
+            children[i] = keyed[i].second;
+          }
+        }
+      },
+      [](AlignedNode *node) { return node->name; },
+      [&](AlignedNode *node, ReportRow &row) {
+        std::vector<PrimitiveDelta> deltas;
+        for (int col : columns) {
+          deltas.emplace_back(comparison.get_delta(node, col));
+        }
+        for (auto &d : deltas) {
+          row.values.emplace_back(d.baseline);
+        }
+        for (auto &d : deltas) {
+          row.values.emplace_back(d.candidate);
+        }
+        for (auto &d : deltas) {
+          row.values.emplace_back(d.delta());
+        }
+        for (auto &d : deltas) {
+          row.values.emplace_back(d.percent());
+        }
+      },
+      table);
+  write_table(os, table, options.format);
+}
+
+void write_rank_report(std::ostream &os, const Design &design,
+                       const RankQuery &query,
+                       const std::vector<RankEntry> &entries,
+                       ReportFormat format) {
+  // Counts come from the (self) row or the hierarchical total, whichever was
+  // ranked
+  auto count = [&](const RankEntry &entry, int primitive) {
+    const ModuleSummary *summary = entry.path.back();
+    return query.self ? summary->self_primitives[primitive]
+                      : summary->total_primitives[primitive];
+  };
+  auto name = [&](const RankEntry &entry) {
+    const std::string name =
+        query.modules ? entry.path.back()->name : entry.path_name();
+    return query.self ? name + " (self)" : name;
+  };
+  const char *what = query.modules ? "Module" : "Instance";
+
+  switch (format) {
+  case ReportFormat::Text: {
+    size_t name_width = 8;
+    for (auto &entry : entries) {
+      name_width = std::max(name_width, name(entry).size());
+    }
+    std::vector<size_t> widths;
+    os << std::right << std::setw(4) << "Rank" << "  " << std::left
+       << std::setw(name_width) << what << "  " << std::right << std::setw(10)
+       << "Instances" << "  " << std::setw(12) << "Score";
+    for (auto &weight : query.weights) {
+      const std::string &title = design.primitives[weight.first];
+      widths.emplace_back(std::max<size_t>(title.size(), 8));
+      os << "  " << std::setw(widths.back()) << title;
+    }
+    os << "\n";
+    for (size_t i = 0; i < entries.size(); i++) {
+      os << std::right << std::setw(4) << i + 1 << "  " << std::left
+         << std::setw(name_width) << name(entries[i]) << "  " << std::right
+         << std::setw(10) << entries[i].instances << "  " << std::setw(12)
+         << entries[i].rank_score(query);
+      for (size_t w = 0; w < query.weights.size(); w++) {
+        os << "  " << std::setw(widths[w])
+           << count(entries[i], query.weights[w].first);
+      }
+      os << "\n";
+    }
+    break;
+  }
+
+  case ReportFormat::Csv: {
+    os << "rank," << (query.modules ? "module" : "path")
+       << ",self,instances,score";
+    for (auto &weight : query.weights) {
+      os << "," << csv_escape(design.primitives[weight.first]);
+    }
+    os << "\n";
+    for (size_t i = 0; i < entries.size(); i++) {
+      os << i + 1 << ","
+         << csv_escape(query.modules ? entries[i].path.back()->name
+                                     : entries[i].path_name())
+         << "," << (query.self ? 1 : 0) << "," << entries[i].instances << ","
+         << entries[i].rank_score(query);
+      for (auto &weight : query.weights) {
+        os << "," << count(entries[i], weight.first);
+      }
+      os << "\n";
+    }
+    break;
+  }
+
+  case ReportFormat::Json: {
+    nlohmann::json root = nlohmann::json::array();
+    for (auto &entry : entries) {
+      nlohmann::json item;
+      if (query.modules) {
+        item["module"] = entry.path.back()->name;
+      } else {
+        item["path"] = nlohmann::json::array();
+        for (const ModuleSummary *summary : entry.path) {
+          item["path"].emplace_back(summary->name);
+        }
+      }
+      item["self"] = query.self;
+      item["instances"] = entry.instances;
+      item["score"] = entry.rank_score(query);
+      item["primitives"] = nlohmann::json::object();
+      for (auto &weight : query.weights) {
+        item["primitives"][design.primitives[weight.first]] =
+            count(entry, weight.first);
+      }
+      root.emplace_back(item);
+    }
+    os << root.dump(2) << "\n";
+    break;
+  }
+  }
+}
+
+void write_history_report(std::ostream &os, const HistoryStore &store,
+                          const HistoryTrend &trend, ReportFormat format) {
+  switch (format) {
+  case ReportFormat::Text: {
+    size_t label_width = 5;
+    for (const size_t i : trend.builds) {
+      label_width = std::max(label_width, store.build(i).label.size());
+    }
+    std::vector<size_t> widths;
+    os << std::left << std::setw(label_width) << "Build" << "  "
+       << std::setw(20) << "Time";
+    for (auto &primitive : trend.primitives) {
+      widths.emplace_back(std::max<size_t>(primitive.size(), 8));
+      os << "  " << std::right << std::setw(widths.back()) << primitive;
+    }
+    os << "\n";
+    for (size_t b = 0; b < trend.builds.size(); b++) {
+      const HistoryBuild &build = store.build(trend.builds[b]);
+      os << std::left << std::setw(label_width) << build.label << "  "
+         << std::setw(20) << format_time(build.timestamp);
+      for (size_t p = 0; p < trend.primitives.size(); p++) {
+        os << "  " << std::right << std::setw(widths[p])
+           << format_history_count(trend.counts[b][p]);
+      }
+      os << "\n";
+    }
+    break;
+  }
+
+  case ReportFormat::Csv: {
+    os << "build,time";
+    for (auto &primitive : trend.primitives) {
+      os << "," << csv_escape(primitive);
+    }
+    os << "\n";
+    for (size_t b = 0; b < trend.builds.size(); b++) {
+      const HistoryBuild &build = store.build(trend.builds[b]);
+      os << csv_escape(build.label) << "," << format_time(build.timestamp);
+      for (const int count : trend.counts[b]) {
+        os << "," << format_history_count(count);
+      }
+      os << "\n";
+    }
+    break;
+  }
+
+  case ReportFormat::Json: {
+    nlohmann::json root;
+    root["module"] = trend.module;
+    root["builds"] = nlohmann::json::array();
+    for (size_t b = 0; b < trend.builds.size(); b++) {
+      const HistoryBuild &build = store.build(trend.builds[b]);
+      nlohmann::json item;
+      item["label"] = build.label;
+      item["time"] = format_time(build.timestamp);
+      item["timestamp"] = build.timestamp;
+      // Builds without the module have null counts
+      item["primitives"] = nlohmann::json::object();
+      for (size_t p = 0; p < trend.primitives.size(); p++) {
+        const int count = trend.counts[b][p];
+        item["primitives"][trend.primitives[p]] =
+            count < 0 ? nlohmann::json() : nlohmann::json(count);
+      }
+      root["builds"].emplace_back(item);
+    }
+    os << root.dump(2) << "\n";
+    break;
+  }
+  }
+}
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cctype>
+
+#include <yostat/search.hpp>
+
+// Number of fragments that fit in a SearchResult state
+static constexpr size_t max_fragments = 63;
+
+static std::string to_lower(const std::string &s) {
+  std::string lower = s;
+  for (char &c : lower) {
+    c = std::tolower((unsigned char)c);
+  }
+  return lower;
+}
+
+static uint32_t trigram(const std::string &s, size_t i) {
+  return (uint8_t)s[i] << 16 | (uint8_t)s[i + 1] << 8 | (uint8_t)s[i + 2];
+}
+
+// Get the name of the i'th instance in a summary's submodule list
+static uint32_t instance_name(const ModuleSummary *summary, size_t i) {
+  return i < summary->instance_names.size() ? summary->instance_names[i]
+                                            : StringPool::none;
+}
+
+void SearchIndex::Trigrams::add(const std::string &name) {
+  // Names are added in order, so each posting list stays sorted as long as a
+  // name's repeated trigrams are only added once
+  const uint32_t id = names.size();
+  names.emplace_back(to_lower(name));
+  const std::string &lower = names.back();
+  for (size_t i = 0; i + 3 <= lower.size(); i++) {
+    std::vector<uint32_t> &ids = postings[trigram(lower, i)];
+    if (ids.empty() || ids.back() != id) {
+      ids.emplace_back(id);
+    }
+  }
+}
+
+std::vector<uint32_t>
+SearchIndex::Trigrams::find(const std::string &needle) const {
+  std::vector<uint32_t> found;
+
+  // Short fragments have no trigrams to look up, so check every name
+  if (needle.size() < 3) {
+    for (size_t i = 0; i < names.size(); i++) {
+      if (names[i].find(needle) != std::string::npos) {
+        found.emplace_back(i);
+      }
+    }
+    return found;
+  }
+
+  // Intersect the posting lists of every trigram in the fragment, smallest
+  // first, then check the survivors, since having all the trigrams doesn't
+  // mean they are in the right order
+  std::vector<const std::vector<uint32_t> *> lists;
+  for (size_t i = 0; i + 3 <= needle.size(); i++) {
+    auto search = postings.find(trigram(needle, i));
+    if (search == postings.end()) {
+      return found;
+    }
+    lists.emplace_back(&search->second);
+  }
+  std::sort(lists.begin(), lists.end(),
+            [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b) {
+              return a->size() < b->size();
+            });
+  std::vector<uint32_t> candidates = *lists[0];
+  std::vector<uint32_t> next;
+  for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+    next.clear();
+    std::set_intersection(candidates.begin(), candidates.end(),
+                          lists[i]->begin(), lists[i]->end(),
+                          std::back_inserter(next));
+    candidates.swap(next);
+  }
+  for (uint32_t id : candidates) {
+    if (names[id].find(needle) != std::string::npos) {
+      found.emplace_back(id);
+    }
+  }
+  return found;
+}
+
+SearchIndex::SearchIndex(const Design &design) {
+  for (auto &summary : design.summaries) {
+    _modules.emplace_back(&summary.second);
+    _module_names.add(summary.first);
+  }
+  // Ids are dense, so an instance name's index is its id
+  for (uint32_t id = 0; id < design.names.size(); id++) {
+    _instance_names.add(design.names.str(id));
+  }
+}
+
+std::vector<const ModuleSummary *>
+SearchIndex::find(const std::string &text) const {
+  std::vector<const ModuleSummary *> found;
+  for (uint32_t i : _module_names.find(to_lower(text))) {
+    found.emplace_back(_modules[i]);
+  }
+  return found;
+}
+
+std::vector<uint32_t>
+SearchIndex::find_instances(const std::string &text) const {
+  return _instance_names.find(to_lower(text));
+}
+
+SearchResult::SearchResult(const SearchIndex &index, const Design &design,
+                           const std::string &query)
+    : _top(design.top->summary) {
+  // Split the query into fragments, ignoring empty ones
+  size_t start = 0;
+  while (start <= query.size() && _fragments.size() < max_fragments) {
+    size_t end = query.find('/', start);
+    if (end == std::string::npos) {
+      end = query.size();
+    }
+    if (end > start) {
+      _fragments.emplace_back(query.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  for (auto &fragment : _fragments) {
+    const std::vector<const ModuleSummary *> found = index.find(fragment);
+    _fragment_modules.emplace_back(found.begin(), found.end());
+    const std::vector<uint32_t> names = index.find_instances(fragment);
+    _fragment_names.emplace_back(names.begin(), names.end());
+    _matched_names.insert(names.begin(), names.end());
+  }
+
+  // Count the matches up front. This visits each module once per distinct
+  // state it can be reached in, which is bounded by the number of fragments.
+  const State top_state = advance(0, _top, design.top->instance_name);
+  if (is_match(top_state)) {
+    _instances++;
+    _matched_modules.emplace(_top);
+  }
+  _instances += below(_top, top_state);
+}
+
+SearchResult::State SearchResult::advance(State state,
+                                          const ModuleSummary *summary,
+                                          uint32_t name) const {
+  // Any instance can start a match, so fragment 0 is always a candidate
+  state |= 1;
+  State next = 0;
+  for (size_t j = 0; j < _fragments.size(); j++) {
+    if ((state >> j) & 1 &&
+        (_fragment_modules[j].count(summary) ||
+         (name != StringPool::none && _fragment_names[j].count(name)))) {
+      next |= State(1) << (j + 1);
+    }
+  }
+  return next;
+}
+
+SearchResult::State SearchResult::state_of(const Module *m) const {
+  // Collect the instances on the path to the node, then replay them from the
+  // top
+  std::vector<const Module *> path;
+  for (; m; m = m->parent) {
+    if (m->kind == Module::Kind::Instance) {
+      path.emplace_back(m);
+    }
+  }
+  State state = 0;
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    state = advance(state, (*it)->summary, (*it)->instance_name);
+  }
+  return state;
+}
+
+uint64_t SearchResult::below(const ModuleSummary *summary, State state) const {
+  auto memo = _below.find({summary, state});
+  if (memo != _below.end()) {
+    return memo->second;
+  }
+  uint64_t count = 0;
+  // Instances whose names don't match any fragment all step into the same
+  // state, so only the ones that do are stepped into one by one
+  size_t first_name = 0;
+  for (auto &submodule : summary->submodules) {
+    int unnamed = submodule.second;
+    for (int i = 0; i < submodule.second; i++) {
+      const uint32_t name = instance_name(summary, first_name + i);
+      if (name == StringPool::none || !_matched_names.count(name)) {
+        continue;
+      }
+      unnamed--;
+      const State next = advance(state, submodule.first, name);
+      if (is_match(next)) {
+        count++;
+        _matched_modules.emplace(submodule.first);
+      }
+      count += below(submodule.first, next);
+    }
+    first_name += submodule.second;
+    if (!unnamed) {
+      continue;
+    }
+    const State next = advance(state, submodule.first, StringPool::none);
+    if (is_match(next)) {
+      count += unnamed;
+      _matched_modules.emplace(submodule.first);
+    }
+    count += unnamed * below(submodule.first, next);
+  }
+  _below[{summary, state}] = count;
+  return count;
+}
+
+bool SearchResult::matches(const Module *m) const {
+  return m->kind == Module::Kind::Instance && is_match(state_of(m));
+}
+
+bool SearchResult::visible(const Module *m) const {
+  if (!m->parent) {
+    return true;
+  }
+  if (m->kind == Module::Kind::Self) {
+    return false;
+  }
+  if (m->kind == Module::Kind::Instance) {
+    const State state = state_of(m);
+    return is_match(state) || below(m->summary, state) > 0;
+  }
+
+  // A holder stands for its instances, which all step into the same module
+  // under the same parent, so it is shown if any of them would be
+  const ModuleSummary *parent = m->parent->summary;
+  const State parent_state = state_of(m->parent);
+  size_t first_name = 0;
+  for (auto &submodule : parent->submodules) {
+    if (submodule.first == m->summary) {
+      break;
+    }
+    first_name += submodule.second;
+  }
+  auto shown = [&](uint32_t name) {
+    const State state = advance(parent_state, m->summary, name);
+    return is_match(state) || below(m->summary, state) > 0;
+  };
+  int unnamed = m->instances;
+  for (int i = 0; i < m->instances; i++) {
+    const uint32_t name = instance_name(parent, first_name + i);
+    if (name == StringPool::none || !_matched_names.count(name)) {
+      continue;
+    }
+    unnamed--;
+    if (shown(name)) {
+      return true;
+    }
+  }
+  return unnamed > 0 && shown(StringPool::none);
+}
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <yostat/parse.hpp>
+#include <yostat/stats.hpp>
+
+namespace {
+
+// Allocation counters for each thread. Only their own thread touches them,
+// so that phases on other threads don't show up in each other's counts.
+// Plain integers, so that operator new can bump them at any point in a
+// thread's life without waiting on construction.
+thread_local uint64_t thread_allocations = 0;
+thread_local uint64_t thread_allocated_bytes = 0;
+
+// Number of phases and SharedPeakRss scopes running, and of those ever
+// started. A phase's peak RSS is only its own if it started with nothing
+// else running, and nothing else started before it finished.
+std::atomic<unsigned> rss_users{0};
+std::atomic<uint64_t> rss_phases{0};
+
+// Read a field from /proc/self/status, in KiB
+long read_status_kib(const char *field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  const size_t field_len = strlen(field);
+  while (std::getline(status, line)) {
+    if (line.compare(0, field_len, field) == 0 && line[field_len] == ':') {
+      return atol(line.c_str() + field_len + 1);
+    }
+  }
+  return -1;
+}
+
+std::string format_ms(double ms) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), ms < 10 ? "%.2f ms" : "%.0f ms", ms);
+  return buf;
+}
+
+std::string format_count(uint64_t count) {
+  char buf[32];
+  if (count >= 1000000) {
+    snprintf(buf, sizeof(buf), "%.1fM", count / 1e6);
+  } else if (count >= 1000) {
+    snprintf(buf, sizeof(buf), "%.1fk", count / 1e3);
+  } else {
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)count);
+  }
+  return buf;
+}
+
+std::string format_kib(long kib) {
+  if (kib < 0) {
+    return "unknown";
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.1f MiB", kib / 1024.0);
+  return buf;
+}
+
+} // namespace
+
+uint64_t allocation_count() { return thread_allocations; }
+
+uint64_t allocated_bytes() { return thread_allocated_bytes; }
+
+void count_allocation(size_t size) {
+  thread_allocations++;
+  thread_allocated_bytes += size;
+}
+
+void add_allocations(uint64_t count, uint64_t bytes) {
+  thread_allocations += count;
+  thread_allocated_bytes += bytes;
+}
+
+long current_rss_kib() { return read_status_kib("VmRSS"); }
+
+long peak_rss_kib() { return read_status_kib("VmHWM"); }
+
+void reset_peak_rss() {
+#ifdef __linux__
+  // Writing 5 to clear_refs resets VmHWM to the current RSS
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+#endif
+}
+
+SharedPeakRss::SharedPeakRss() {
+  rss_phases++;
+  if (rss_users++ == 0) {
+    reset_peak_rss();
+  }
+}
+
+SharedPeakRss::~SharedPeakRss() { rss_users--; }
+
+double LoadStats::total_ms() const {
+  double total = 0;
+  for (auto &phase : phases) {
+    total += phase.ms;
+  }
+  return total;
+}
+
+uint64_t LoadStats::total_allocations() const {
+  uint64_t total = 0;
+  for (auto &phase : phases) {
+    total += phase.allocations;
+  }
+  return total;
+}
+
+long LoadStats::peak_rss_kib() const {
+  long peak = -1;
+  for (auto &phase : phases) {
+    peak = std::max(peak, phase.peak_rss_kib);
+  }
+  return peak;
+}
+
+TreeStats tree_stats(const Design &design) {
+  TreeStats stats;
+  std::vector<const Module *> pending = {design.top};
+  while (!pending.empty()) {
+    const Module *m = pending.back();
+    pending.pop_back();
+    stats.nodes++;
+    if (m->parent && m->parent->kind == Module::Kind::Holder) {
+      stats.instances++;
+    }
+    if (m->expanded && m->kind != Module::Kind::Self) {
+      stats.expanded++;
+    }
+    for (unsigned i = 0; i < m->num_children; i++) {
+      pending.emplace_back(design.nodes.child(m, i));
+    }
+  }
+  return stats;
+}
+
+ScopedPhase::ScopedPhase(LoadStats *stats, const char *name)
+    : _stats(stats), _name(name) {
+  if (!_stats) {
+    return;
+  }
+  const uint64_t phase = ++rss_phases;
+  if (rss_users++ == 0) {
+    reset_peak_rss();
+    _rss_phase = phase;
+  }
+  _allocations = allocation_count();
+  _allocated_bytes = allocated_bytes();
+  _start = std::chrono::steady_clock::now();
+}
+
+void ScopedPhase::finish() {
+  if (!_stats) {
+    return;
+  }
+  PhaseStats phase;
+  phase.name = _name;
+  phase.ms = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - _start)
+                 .count();
+  phase.allocations = allocation_count() - _allocations;
+  phase.allocated_bytes = allocated_bytes() - _allocated_bytes;
+  if (_rss_phase) {
+    const long peak = ::peak_rss_kib();
+    if (rss_phases == _rss_phase) {
+      phase.peak_rss_kib = peak;
+    }
+  }
+  rss_users--;
+  _stats->phases.emplace_back(phase);
+  _stats = nullptr;
+}
+
+nlohmann::json stats_json(const PhaseStats &phase) {
+  nlohmann::json j;
+  j["name"] = phase.name;
+  j["ms"] = phase.ms;
+  j["allocations"] = phase.allocations;
+  j["allocated_bytes"] = phase.allocated_bytes;
+  j["peak_rss_kib"] = phase.peak_rss_kib;
+  return j;
+}
+
+nlohmann::json stats_json(const LoadStats &stats) {
+  nlohmann::json j;
+  j["from_cache"] = stats.from_cache;
+  j["file_size"] = stats.file_size;
+  j["modules"] = stats.modules;
+  j["parsed_modules"] = stats.parsed_modules;
+  j["summaries"] = stats.summaries;
+  j["primitives"] = stats.primitives;
+  j["total_ms"] = stats.total_ms();
+  j["allocations"] = stats.total_allocations();
+  j["peak_rss_kib"] = stats.peak_rss_kib();
+  j["phases"] = nlohmann::json::array();
+  for (auto &phase : stats.phases) {
+    j["phases"].emplace_back(stats_json(phase));
+  }
+  return j;
+}
+
+nlohmann::json stats_json(const TreeStats &tree) {
+  nlohmann::json j;
+  j["nodes"] = tree.nodes;
+  j["expanded"] = tree.expanded;
+  j["instances"] = tree.instances;
+  return j;
+}
+
+std::string format_stats_summary(const LoadStats &stats) {
+  std::string summary = std::string(stats.from_cache ? "Loaded from cache"
+                                                     : "Loaded") +
+                        " in " + format_ms(stats.total_ms());
+  // Name the slowest phase, which is usually what people want to know
+  auto slowest = std::max_element(
+      stats.phases.begin(), stats.phases.end(),
+      [](const PhaseStats &a, const PhaseStats &b) { return a.ms < b.ms; });
+  if (slowest != stats.phases.end()) {
+    summary += " (" + slowest->name + " " + format_ms(slowest->ms) + ")";
+  }
+  summary += ", " + format_count(stats.total_allocations()) +
+             " allocations, peak RSS " + format_kib(stats.peak_rss_kib());
+  return summary;
+}
+
+std::string format_stats_report(const LoadStats &stats,
+                                const TreeStats &tree) {
+  std::string report;
+  char line[160];
+  snprintf(line, sizeof(line), "%-16s %12s %12s %12s\n", "Phase", "Time",
+           "Allocations", "Peak RSS");
+  report += line;
+  for (auto &phase : stats.phases) {
+    snprintf(line, sizeof(line), "%-16s %12s %12s %12s\n", phase.name.c_str(),
+             format_ms(phase.ms).c_str(),
+             format_count(phase.allocations).c_str(),
+             format_kib(phase.peak_rss_kib).c_str());
+    report += line;
+  }
+  snprintf(line, sizeof(line), "%-16s %12s %12s %12s\n\n", "Total",
+           format_ms(stats.total_ms()).c_str(),
+           format_count(stats.total_allocations()).c_str(),
+           format_kib(stats.peak_rss_kib()).c_str());
+  report += line;
+
+  report += std::string("Source: ") +
+            (stats.from_cache ? "cache" : "json") + ", " +
+            format_count(stats.file_size) + " bytes\n";
+  if (!stats.from_cache) {
+    report += "Modules in file: " + std::to_string(stats.modules);
+    if (stats.parsed_modules != stats.modules) {
+      report += " (" + std::to_string(stats.parsed_modules) +
+                " changed since the last load)";
+    }
+    report += "\n";
+  }
+  report += "Modules in hierarchy: " + std::to_string(stats.summaries) + "\n";
+  report += "Primitive types: " + std::to_string(stats.primitives) + "\n";
+  report += "Tree nodes generated: " + std::to_string(tree.nodes) + " (" +
+            std::to_string(tree.expanded) + " expanded, " +
+            std::to_string(tree.instances) + " holder instances)\n";
+  return report;
+}
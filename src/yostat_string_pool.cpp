@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstring>
+
+#include <yostat/hash.hpp>
+#include <yostat/string_pool.hpp>
+
+constexpr uint32_t StringPool::none;
+
+uint32_t StringPool::intern(const char *data, size_t count) {
+  if ((size() + 1) * 2 > _index.size()) {
+    grow();
+  }
+  const size_t s = slot(data, count);
+  if (_index[s] != none) {
+    return _index[s];
+  }
+  const uint32_t id = size();
+  _chars.insert(_chars.end(), data, data + count);
+  _offsets.emplace_back(_chars.size());
+  _index[s] = id;
+  return id;
+}
+
+uint32_t StringPool::find(const std::string &s) const {
+  if (_index.empty()) {
+    return none;
+  }
+  return _index[slot(s.data(), s.size())];
+}
+
+size_t StringPool::slot(const char *data, size_t count) const {
+  const size_t mask = _index.size() - 1;
+  size_t s = hash_bytes(data, count) & mask;
+  while (_index[s] != none) {
+    const uint32_t id = _index[s];
+    if (length(id) == count &&
+        (count == 0 ||
+         memcmp(_chars.data() + _offsets[id], data, count) == 0)) {
+      break;
+    }
+    s = (s + 1) & mask;
+  }
+  return s;
+}
+
+void StringPool::grow() {
+  _index.assign(std::max<size_t>(_index.size() * 2, 64), none);
+  for (uint32_t id = 0; id < size(); id++) {
+    _index[slot(_chars.data() + _offsets[id], length(id))] = id;
+  }
+}
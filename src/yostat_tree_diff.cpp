@@ -0,0 +1,272 @@
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <yostat/tree_diff.hpp>
+
+// Get the summaries that the children of a node with the given kind and
+// summary are generated from, in order. Mirrors expand_module.
+static void child_summaries(Module::Kind kind, const ModuleSummary *summary,
+                            int instances,
+                            std::vector<const ModuleSummary *> &out) {
+  out.clear();
+  if (kind == Module::Kind::Holder) {
+    out.assign(instances, summary);
+    return;
+  }
+  if (kind == Module::Kind::Self) {
+    return;
+  }
+  if (summary->has_self) {
+    out.emplace_back(summary);
+  }
+  for (auto &submodule : summary->submodules) {
+    out.emplace_back(submodule.first);
+  }
+}
+
+bool same_subtree(const Module *a, const Module *b) {
+  if (a->kind != b->kind || a->instances != b->instances) {
+    return false;
+  }
+  if (a->kind == Module::Kind::Self) {
+    return a->summary->self_primitives == b->summary->self_primitives;
+  }
+  return a->summary->hash == b->summary->hash;
+}
+
+// Get the instance names of the children of a node, in the new design's
+// string pool, once the node and its parent point at the new summaries.
+// Mirrors expand_module.
+static void child_names(const Module *m, std::vector<uint32_t> &out) {
+  out.clear();
+  if (m->kind == Module::Kind::Self) {
+    return;
+  }
+  const ModuleSummary *summary =
+      m->kind == Module::Kind::Holder ? m->parent->summary : m->summary;
+  auto name = [&](size_t i) {
+    return i < summary->instance_names.size() ? summary->instance_names[i]
+                                              : StringPool::none;
+  };
+  size_t first = 0;
+  if (m->kind == Module::Kind::Holder) {
+    for (auto &submodule : summary->submodules) {
+      if (submodule.first == m->summary) {
+        break;
+      }
+      first += submodule.second;
+    }
+    for (int i = 0; i < m->instances; i++) {
+      out.emplace_back(name(first + i));
+    }
+    return;
+  }
+  if (summary->has_self) {
+    out.emplace_back(StringPool::none);
+  }
+  for (auto &submodule : summary->submodules) {
+    out.emplace_back(submodule.second > 1 ? StringPool::none : name(first));
+    first += submodule.second;
+  }
+}
+
+// Whether an instance name in one string pool is the same as one in another
+static bool same_name(const StringPool &a_names, uint32_t a,
+                      const StringPool &b_names, uint32_t b) {
+  if (a == StringPool::none || b == StringPool::none) {
+    return a == b;
+  }
+  return a_names.length(a) == b_names.length(b) &&
+         a_names.str(a) == b_names.str(b);
+}
+
+// Point an unchanged subtree at the equivalent summaries and instance names
+// of a new design. Since the subtree is identical, the generated children line
+// up one to one with the children the new summary would generate. Only the
+// instance names can differ, and nodes whose names did are added to renamed.
+static void rebind_subtree(const ModulePool &pool, const StringPool &old_names,
+                           const StringPool &new_names, Module *m,
+                           const ModuleSummary *summary,
+                           std::vector<Module *> &renamed) {
+  std::vector<std::pair<Module *, const ModuleSummary *>> pending = {
+      {m, summary}};
+  std::vector<const ModuleSummary *> summaries;
+  std::vector<uint32_t> names;
+  while (!pending.empty()) {
+    Module *node = pending.back().first;
+    node->summary = pending.back().second;
+    pending.pop_back();
+    if (!node->expanded) {
+      continue;
+    }
+    child_summaries(node->kind, node->summary, node->instances, summaries);
+    child_names(node, names);
+    for (unsigned i = 0; i < node->num_children; i++) {
+      Module *child = pool.child(node, i);
+      if (!same_name(old_names, child->instance_name, new_names, names[i])) {
+        renamed.emplace_back(child);
+      }
+      child->instance_name = names[i];
+      pending.emplace_back(child, summaries[i]);
+    }
+  }
+}
+
+// Name that children are matched up by. Instances go by their module, as
+// generated instance names change from one synthesis run to the next.
+static std::string match_name(const Module *m, const StringPool &names) {
+  return m->kind == Module::Kind::Instance ? m->summary->name
+                                           : m->name(names);
+}
+
+TreeDiffStats update_design(Design &dst, Design &src,
+                            TreeDiffListener &listener) {
+  TreeDiffStats stats;
+
+  // Structure hashes refer to primitives by id, so they can only be compared
+  // if both designs use the same primitives
+  const bool can_skip = dst.primitives == src.primitives;
+
+  // The root is never added or deleted, but it may have changed
+  const bool top_changed = !can_skip || !same_subtree(dst.top, src.top);
+
+  // Subtrees that are no longer in the tree. They are only freed once the
+  // walk is done, so that nodes copied over from src can't take their slots
+  // while the listener may still be holding on to them.
+  std::vector<Module *> released;
+
+  // Walk the tree without recursing, so that deep hierarchies are safe
+  std::vector<std::pair<Module *, Module *>> pending = {{dst.top, src.top}};
+  while (!pending.empty()) {
+    Module *m_old = pending.back().first;
+    Module *m_new = pending.back().second;
+    pending.pop_back();
+    stats.visited++;
+
+    // If the subtree is identical, there's nothing to do but point it at the
+    // new summaries
+    if (can_skip && same_subtree(m_old, m_new)) {
+      m_old->instance_name = m_new->instance_name;
+      std::vector<Module *> renamed;
+      rebind_subtree(dst.nodes, dst.names, src.names, m_old, m_new->summary,
+                     renamed);
+      if (!renamed.empty()) {
+        listener.items_changed(renamed);
+        stats.changed += renamed.size();
+      }
+      stats.skipped++;
+      continue;
+    }
+
+    // Point the node at the new module summary, which updates its name and
+    // primitive counts
+    m_old->kind = m_new->kind;
+    m_old->instance_name = m_new->instance_name;
+    m_old->summary = m_new->summary;
+    m_old->instances = m_new->instances;
+
+    // If the children of this node were never generated, there's nothing to
+    // compare against. They will be generated from the new summary on demand.
+    if (!m_old->expanded) {
+      continue;
+    }
+    expand_module(src.nodes, m_new);
+
+    // For the submodules, there are three cases:
+    // - Submodule on m_new present on m_old
+    //  -> Recurse directly
+    // - Submodule on m_new not present on m_old
+    //  -> Copy submodule from m_new and attach to m_old
+    // - Submodule on m_old not present on m_new
+    //  -> Delete submodule from m_old
+
+    // Index the old submodules by name. Multiple instances of the same module
+    // under a holder share a name, and are matched up in order.
+    std::unordered_map<std::string, std::pair<std::vector<Module *>, size_t>>
+        by_name;
+    for (unsigned i = 0; i < m_old->num_children; i++) {
+      Module *old_submodule = dst.nodes.child(m_old, i);
+      by_name[match_name(old_submodule, dst.names)].first.emplace_back(
+          old_submodule);
+    }
+
+    // Build the new submodule list for m_old
+    std::vector<Module *> submodules;
+    std::vector<Module *> added;
+    std::vector<Module *> changed;
+    for (unsigned i = 0; i < m_new->num_children; i++) {
+      Module *new_submodule = src.nodes.child(m_new, i);
+      auto search = by_name.find(match_name(new_submodule, src.names));
+      // Views can't turn a leaf into a container or back, so such nodes are
+      // replaced rather than updated
+      if (search != by_name.end() &&
+          search->second.second < search->second.first.size() &&
+          search->second.first[search->second.second]->has_children() ==
+              new_submodule->has_children()) {
+        // Direct match. Keep the old node and recurse on it
+        Module *old_submodule =
+            search->second.first[search->second.second++];
+        submodules.emplace_back(old_submodule);
+        if (!can_skip || !same_subtree(old_submodule, new_submodule) ||
+            old_submodule->path_name(dst.names) !=
+                new_submodule->path_name(src.names)) {
+          changed.emplace_back(old_submodule);
+        }
+        pending.emplace_back(old_submodule, new_submodule);
+      } else {
+        // If we didn't update in place, copy the new node over from the
+        // input design
+        Module *adopted = dst.nodes.adopt(src.nodes, new_submodule, m_old);
+        submodules.emplace_back(adopted);
+        added.emplace_back(adopted);
+      }
+    }
+
+    // Anything that wasn't matched is gone. Since matches are taken in order,
+    // that's everything past the matched prefix of each name.
+    std::vector<Module *> deleted;
+    for (auto &name : by_name) {
+      auto &old_submodules = name.second.first;
+      deleted.insert(deleted.end(), old_submodules.begin() + name.second.second,
+                     old_submodules.end());
+    }
+    dst.nodes.set_children(m_old, submodules);
+
+    // Let the listener know
+    if (!added.empty()) {
+      listener.items_added(m_old, added);
+      stats.added += added.size();
+    }
+    if (!deleted.empty()) {
+      listener.items_deleted(m_old, deleted);
+      stats.deleted += deleted.size();
+      released.insert(released.end(), deleted.begin(), deleted.end());
+    }
+    if (!changed.empty()) {
+      listener.items_changed(changed);
+      stats.changed += changed.size();
+    }
+  }
+
+  if (top_changed) {
+    listener.items_changed({dst.top});
+    stats.changed++;
+  }
+
+  // Return the deleted subtrees to the pool, so that repeated reloads don't
+  // keep growing it
+  for (Module *m : released) {
+    dst.nodes.release(m);
+  }
+
+  // All the nodes we kept now refer to the summaries and instance names of
+  // the new design, so take ownership of them. The old ones go away with the
+  // input design.
+  std::swap(dst.summaries, src.summaries);
+  std::swap(dst.names, src.names);
+  dst.primitives = src.primitives;
+  dst.primitive_ids = src.primitive_ids;
+  dst.family = src.family;
+  return stats;
+}
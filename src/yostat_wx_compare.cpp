@@ -0,0 +1,277 @@
+#include <cmath>
+#include <cstdio>
+
+#include <yostat/yostat_wx_compare.hpp>
+
+enum CompareIds {
+  HIDE_UNCHANGED = 200,
+};
+
+/* clang-format off */
+BEGIN_EVENT_TABLE(YostatCompareFrame, wxFrame)
+EVT_DATAVIEW_ITEM_ACTIVATED(wxID_ANY, YostatCompareFrame::on_dataview_item_activated)
+EVT_MENU(CompareIds::HIDE_UNCHANGED, YostatCompareFrame::toggle_hide_unchanged)
+END_EVENT_TABLE()
+/* clang-format on */
+
+void YostatCompareFrame::on_dataview_item_activated(wxDataViewEvent &evt) {
+  // On doubleclick / enter, toggle expansion of container items
+  wxDataViewItem item = evt.GetItem();
+  if (!item.IsOk())
+    return;
+  if (evt.GetModel()->IsContainer(item)) {
+    if (_dataview->IsExpanded(item)) {
+      _dataview->Collapse(item);
+    } else {
+      _dataview->Expand(item);
+    }
+  }
+}
+
+void YostatCompareFrame::toggle_hide_unchanged(wxCommandEvent &evt) {
+  _datamodel->set_hide_unchanged(evt.IsChecked());
+  _datamodel->Cleared();
+}
+
+bool YostatCompareModel::HasContainerColumns(
+    const wxDataViewItem &item) const {
+  return true;
+}
+
+bool YostatCompareModel::IsContainer(const wxDataViewItem &item) const {
+  AlignedNode *node = reinterpret_cast<AlignedNode *>(item.GetID());
+  if (!node) {
+    return true;
+  }
+  // A node has children if it has them in any design
+  for (const Module *m : node->modules) {
+    if (m && m->has_children()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+wxDataViewItem
+YostatCompareModel::GetParent(const wxDataViewItem &item) const {
+  if (!item.IsOk()) {
+    // Invisible root has no parent
+    return wxDataViewItem(nullptr);
+  }
+
+  AlignedNode *node = reinterpret_cast<AlignedNode *>(item.GetID());
+  return wxDataViewItem((void *)node->parent);
+}
+
+unsigned int YostatCompareModel::GetColumnCount() const {
+  if (_delta) {
+    return DELTA_COLUMNS * _comparison->primitives().size() + 1;
+  }
+  return _comparison->num_designs() * _comparison->primitives().size() + 1;
+}
+
+wxString YostatCompareModel::GetColumnType(unsigned int col) const {
+  // Percentages are formatted by GetValue and sorted by Compare
+  if (col == 0 || (_delta && (col - 1) % DELTA_COLUMNS == 3)) {
+    return wxT("string");
+  }
+  return wxT("long");
+}
+
+unsigned int
+YostatCompareModel::GetChildren(const wxDataViewItem &item,
+                                wxDataViewItemArray &children) const {
+  // If the item is the root, return the aligned top modules
+  AlignedNode *node = reinterpret_cast<AlignedNode *>(item.GetID());
+  if (!node) {
+    children.Add(wxDataViewItem((void *)_comparison->top()));
+    return 1;
+  }
+
+  // Otherwise merge the children of each design, generating them if this is
+  // the first time they have been asked for
+  _comparison->expand(node);
+  unsigned int count = 0;
+  for (AlignedNode *child : node->children) {
+    // Unchanged subtrees are recognised by hash, so are never expanded
+    if (_hide_unchanged && _comparison->unchanged(child)) {
+      continue;
+    }
+    children.Add(wxDataViewItem((void *)child));
+    count++;
+  }
+  return count;
+}
+
+void YostatCompareModel::GetValue(wxVariant &variant,
+                                  const wxDataViewItem &item,
+                                  unsigned int col) const {
+  AlignedNode *node = reinterpret_cast<AlignedNode *>(item.GetID());
+  if (col == 0) {
+    variant = node->name;
+    return;
+  }
+
+  if (_delta) {
+    // Columns are grouped by primitive, then ordered baseline, candidate,
+    // change, percentage change
+    const int primitive = (col - 1) / DELTA_COLUMNS;
+    const PrimitiveDelta delta = _comparison->get_delta(node, primitive);
+    switch ((col - 1) % DELTA_COLUMNS) {
+    case 0:
+      variant = (long)delta.baseline;
+      break;
+    case 1:
+      variant = (long)delta.candidate;
+      break;
+    case 2:
+      variant = (long)delta.delta();
+      break;
+    default: {
+      const double percent = delta.percent();
+      char buf[32];
+      if (std::isinf(percent)) {
+        snprintf(buf, sizeof(buf), "%s", percent > 0 ? "+inf%" : "-inf%");
+      } else {
+        snprintf(buf, sizeof(buf), "%+.1f%%", percent);
+      }
+      variant = wxString(buf);
+      break;
+    }
+    }
+    return;
+  }
+
+  // Columns are grouped by design, then ordered by primitive
+  const size_t num_primitives = _comparison->primitives().size();
+  const size_t design = (col - 1) / num_primitives;
+  const size_t primitive = (col - 1) % num_primitives;
+  variant = (long)_comparison->get_primitive_count(node, design, primitive);
+}
+
+bool YostatCompareModel::SetValue(const wxVariant &variant,
+                                  const wxDataViewItem &item,
+                                  unsigned int col) {
+  return false;
+}
+
+int YostatCompareModel::Compare(const wxDataViewItem &item1,
+                                const wxDataViewItem &item2,
+                                unsigned int column, bool ascending) const {
+  if (!_delta || column == 0 || (column - 1) % DELTA_COLUMNS != 3) {
+    return wxDataViewModel::Compare(item1, item2, column, ascending);
+  }
+
+  // Order percentage changes numerically rather than as text
+  const int primitive = (column - 1) / DELTA_COLUMNS;
+  const double a =
+      _comparison
+          ->get_delta(reinterpret_cast<AlignedNode *>(item1.GetID()), primitive)
+          .percent();
+  const double b =
+      _comparison
+          ->get_delta(reinterpret_cast<AlignedNode *>(item2.GetID()), primitive)
+          .percent();
+  if (a == b) {
+    return wxDataViewModel::Compare(item1, item2, 0, ascending);
+  }
+  return (a < b) == ascending ? -1 : 1;
+}
+
+YostatCompareFrame::YostatCompareFrame(DesignComparison *comparison,
+                                       bool delta)
+    : wxFrame(nullptr, wxID_ANY, "Yostat", wxPoint(-1, -1), wxSize(-1, -1)),
+      _comparison(comparison), _delta(delta) {
+
+  // Create a parent panel and sizer
+  wxPanel *parent = new wxPanel(this, wxID_ANY);
+  wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
+
+  // Create a dataview and add it to our sizer
+  _dataview =
+      new wxDataViewCtrl(parent, wxID_ANY, wxPoint(-1, -1), wxSize(-1, -1));
+  hbox->Add(_dataview, -1, wxEXPAND);
+
+  // Create our data model over the aligned designs
+  _datamodel = new YostatCompareModel(comparison, delta);
+  _dataview->AssociateModel(_datamodel);
+  _datamodel->DecRef();
+
+  create_columns();
+
+  // Add a menu bar
+  wxMenuBar *menubar = new wxMenuBar();
+  wxMenu *menu = new wxMenu();
+  menu->AppendCheckItem(CompareIds::HIDE_UNCHANGED,
+                        "&Hide unchanged\tCTRL+U",
+                        "Hide modules that are the same in every design");
+  menubar->Append(menu, "Yo&stat");
+  SetMenuBar(menubar);
+
+  // Status bar
+  CreateStatusBar();
+  if (delta) {
+    GetStatusBar()->SetStatusText("Comparing " + comparison->label(1) +
+                                  " against " + comparison->label(0));
+  } else {
+    GetStatusBar()->SetStatusText("Comparing " +
+                                  std::to_string(comparison->num_designs()) +
+                                  " designs");
+  }
+
+  // Finalize layout
+  parent->SetSizer(hbox);
+  parent->SetAutoLayout(true);
+}
+
+void YostatCompareFrame::create_columns() {
+  // Create the first column, which is the module names
+  wxDataViewTextRenderer *string_renderer =
+      new wxDataViewTextRenderer("string", wxDATAVIEW_CELL_ACTIVATABLE);
+  wxDataViewColumn *col_module =
+      new wxDataViewColumn("Module Name", string_renderer, 0, 300, wxALIGN_LEFT,
+                           wxDATAVIEW_COL_SORTABLE | wxDATAVIEW_COL_RESIZABLE);
+  _dataview->AppendColumn(col_module);
+
+  // In delta mode, create a group of columns for each primitive
+  int col = 1;
+  if (_delta) {
+    static const char *titles[YostatCompareModel::DELTA_COLUMNS] = {
+        "base", "new", "\u0394", "\u0394%"};
+    for (auto &cell : _comparison->primitives()) {
+      for (unsigned i = 0; i < YostatCompareModel::DELTA_COLUMNS; i++) {
+        const bool percent = i == 3;
+        wxDataViewTextRenderer *renderer = new wxDataViewTextRenderer(
+            percent ? "string" : "long", wxDATAVIEW_CELL_INERT);
+        wxDataViewColumn *cell_col = new wxDataViewColumn(
+            wxString(cell) + " " + wxString::FromUTF8(titles[i]), renderer,
+            col++, 80, wxALIGN_RIGHT,
+            wxDATAVIEW_COL_SORTABLE | wxDATAVIEW_COL_RESIZABLE |
+                wxDATAVIEW_COL_REORDERABLE);
+        _dataview->AppendColumn(cell_col);
+      }
+    }
+    col_module->SetSortOrder(true);
+    _datamodel->Resort();
+    return;
+  }
+
+  // Otherwise create a group of primitive columns for each design, titled
+  // with the design's label
+  for (size_t i = 0; i < _comparison->num_designs(); i++) {
+    for (auto &cell : _comparison->primitives()) {
+      wxDataViewTextRenderer *long_renderer =
+          new wxDataViewTextRenderer("long", wxDATAVIEW_CELL_INERT);
+      wxDataViewColumn *cell_col = new wxDataViewColumn(
+          _comparison->label(i) + ": " + cell, long_renderer, col++, 100,
+          wxALIGN_LEFT,
+          wxDATAVIEW_COL_SORTABLE | wxDATAVIEW_COL_RESIZABLE |
+              wxDATAVIEW_COL_REORDERABLE);
+      _dataview->AppendColumn(cell_col);
+    }
+  }
+
+  // Order by module name initially
+  col_module->SetSortOrder(true);
+  _datamodel->Resort();
+}
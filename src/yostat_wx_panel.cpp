@@ -1,18 +1,40 @@
+#include <algorithm>
+#include <cmath>
 #include <functional>
 #include <map>
+#include <numeric>
 #include <string>
 #include <vector>
 
+#include <yostat/tree_diff.hpp>
 #include <yostat/yostat_wx_panel.hpp>
 
 enum Ids {
   RELOAD_FILE = 100,
+  WATCH_FILE,
+  LOAD_STATS,
+  SEARCH,
+  TOP_CONTRIBUTORS,
+  LOAD_COST_MODEL,
+  NO_COST_MODEL,
+  // One per loaded cost model
+  FIRST_COST_MODEL = 1000,
+  LAST_COST_MODEL = FIRST_COST_MODEL + 99,
 };
 
 /* clang-format off */
 BEGIN_EVENT_TABLE(YostatWxPanel, wxFrame)
 EVT_DATAVIEW_ITEM_ACTIVATED(wxID_ANY, YostatWxPanel::on_dataview_item_activated)
+EVT_DATAVIEW_ITEM_COLLAPSED(wxID_ANY, YostatWxPanel::on_dataview_item_collapsed)
+EVT_DATAVIEW_COLUMN_SORTED(wxID_ANY, YostatWxPanel::on_dataview_column_sorted)
 EVT_MENU(Ids::RELOAD_FILE, YostatWxPanel::reload)
+EVT_MENU(Ids::WATCH_FILE, YostatWxPanel::toggle_watch)
+EVT_MENU(Ids::LOAD_STATS, YostatWxPanel::show_load_stats)
+EVT_MENU(Ids::TOP_CONTRIBUTORS, YostatWxPanel::show_top_contributors)
+EVT_MENU(Ids::LOAD_COST_MODEL, YostatWxPanel::load_cost_model)
+EVT_MENU(Ids::NO_COST_MODEL, YostatWxPanel::select_cost_model)
+EVT_MENU_RANGE(Ids::FIRST_COST_MODEL, Ids::LAST_COST_MODEL, YostatWxPanel::select_cost_model)
+EVT_TEXT(Ids::SEARCH, YostatWxPanel::on_search)
 END_EVENT_TABLE()
 /* clang-format on */
 
@@ -39,9 +61,8 @@ bool YostatDataModel::IsContainer(const wxDataViewItem &item) const {
   if (!node) {
     return true;
   }
-  // To work around some strange wx behaviour, lie and say that everything is a
-  // container
-  return true;
+  // Answered from the summary, so that asking doesn't generate anything
+  return node->has_children();
 }
 
 wxDataViewItem YostatDataModel::GetParent(const wxDataViewItem &item) const {
@@ -55,13 +76,22 @@ wxDataViewItem YostatDataModel::GetParent(const wxDataViewItem &item) const {
 }
 
 unsigned int YostatDataModel::GetColumnCount() const {
-  return _design->primitives.size() + 1;
+  if (_history) {
+    return trend_column() + 1;
+  }
+  return first_cost_column() + (_costs ? cost_columns : 0);
 }
 
 wxString YostatDataModel::GetColumnType(unsigned int col) const {
   if (col == 0) {
     return wxT("string");
   }
+  if (_history && col == trend_column()) {
+    return wxT("list");
+  }
+  if (_costs && col == first_cost_column()) {
+    return wxT("double");
+  }
   return wxT("long");
 }
 
@@ -74,22 +104,34 @@ unsigned int YostatDataModel::GetChildren(const wxDataViewItem &item,
     return 1;
   }
 
-  // Otherwise, get the actual node children
-  for (auto *submodule : node->submodules) {
-    children.Add(wxDataViewItem((void *)submodule));
+  // Otherwise, get the actual node children, generating them if this is the
+  // first time they have been asked for. When filtering, leave out anything
+  // without a match at or below it.
+  expand_module(_design->nodes, node);
+  unsigned int count = 0;
+  for (unsigned i = 0; i < node->num_children; i++) {
+    Module *child = _design->nodes.child(node, i);
+    if (_filter && !_filter->visible(child)) {
+      continue;
+    }
+    children.Add(wxDataViewItem((void *)child));
+    count++;
   }
-  return node->submodules.size();
+  return count;
 }
 
 void YostatDataModel::GetValue(wxVariant &variant, const wxDataViewItem &item,
                                unsigned int col) const {
   Module *node = reinterpret_cast<Module *>(item.GetID());
   if (col == 0) {
-    variant = node->name;
-    return;
+    variant = node->name(_design->names);
+  } else if (_history && col == trend_column()) {
+    get_trend(variant, node);
+  } else if (_costs && col == first_cost_column()) {
+    variant = get_number(node, col);
+  } else {
+    variant = (long)get_number(node, col);
   }
-
-  variant = (long)node->get_primitive_count(_design->primitives[col - 1]);
 }
 
 bool YostatDataModel::SetValue(const wxVariant &variant,
@@ -97,96 +139,338 @@ bool YostatDataModel::SetValue(const wxVariant &variant,
   return false;
 }
 
-Design *YostatDataModel::get_design() { return _design; }
+int YostatDataModel::Compare(const wxDataViewItem &item1,
+                             const wxDataViewItem &item2, unsigned int column,
+                             bool ascending) const {
+  const Module *a = reinterpret_cast<Module *>(item1.GetID());
+  const Module *b = reinterpret_cast<Module *>(item2.GetID());
+  // The view only sorts siblings, but leave anything else to wx
+  if (!a || !b || !a->parent || a->parent != b->parent ||
+      column >= GetColumnCount() || (_history && column == trend_column())) {
+    return wxDataViewModel::Compare(item1, item2, column, ascending);
+  }
+  if (a == b) {
+    return 0;
+  }
+  const ChildOrder &order = sorted_children(a->parent, column);
+  auto index_a = order.index.find(a);
+  auto index_b = order.index.find(b);
+  if (index_a == order.index.end() || index_b == order.index.end()) {
+    return wxDataViewModel::Compare(item1, item2, column, ascending);
+  }
+  const uint32_t rank_a = order.ranks[column][index_a->second];
+  const uint32_t rank_b = order.ranks[column][index_b->second];
+  return (rank_a < rank_b) == ascending ? -1 : 1;
+}
 
-void YostatDataModel::set_design(Design *d) {
-  // Need to iteratively compare new design and old design and try to update in
-  // place as much as possible to preserve current view state
-  std::function<void(Module *, Module *)> update_module = [&](Module *m_old,
-                                                              Module *m_new) {
-    // Update the name and primitive counts directly
-    m_old->name = m_new->name;
-    m_old->primitives = m_new->primitives;
-
-    // For the submodules, there are three cases:
-    // - Submodule on m_new present on m_old
-    //  -> Recurse directly
-    // - Submodule on m_new not present on m_old
-    //  -> Detatch submodule from m_new and attach to m_old
-    // - Submodule on m_old not present on m_new
-    //  -> Delete submodule from m_old
-
-    // Take a copy of the old submodules
-    std::vector<Module *> old_submodules = m_old->submodules;
-    // Then clear the list so that we can readd as necessary
-    m_old->submodules.clear();
-    for (auto new_it = m_new->submodules.begin();
-         new_it != m_new->submodules.end();) {
-      Module *new_submodule = *new_it;
-
-      // Try and match this submodule against the old submodules list
-      bool did_update_in_place = false;
-      for (auto old_it = old_submodules.begin();
-           old_it != old_submodules.end();) {
-        if (new_submodule->name == (*old_it)->name) {
-          // Direct match. Add this module back to the submodule list, and
-          // recurse on it
-          Module *old_submodule = *old_it;
-          m_old->submodules.emplace_back(old_submodule);
-          update_module(old_submodule, new_submodule);
-          // Remove from the old_submodules list so we don't delete it later
-          old_it = old_submodules.erase(old_it);
-          // Notify that we changed this node
-          ItemChanged(wxDataViewItem(old_submodule));
-          did_update_in_place = true;
-          break;
-        } else {
-          ++old_it;
-        }
+double YostatDataModel::get_number(const Module *node, unsigned col) const {
+  // Category columns come after the primitives, then cost model columns
+  const unsigned num_primitives = _design->primitives.size();
+  if (col <= num_primitives) {
+    return node->get_primitive_count(col - 1);
+  }
+  const unsigned first_cost = first_cost_column();
+  if (col < first_cost) {
+    const PrimitiveCategory category = _categories[col - num_primitives - 1];
+    int total = 0;
+    for (size_t i = 0; i < _primitive_categories.size(); i++) {
+      if (_primitive_categories[i] == category) {
+        total += node->get_primitive_count(i);
       }
+    }
+    return total;
+  }
+  if (!_costs) {
+    return 0;
+  }
+  if (col == first_cost) {
+    return std::round(_costs->cost(node) * 10) / 10;
+  }
+  return std::ceil(_costs->device(node));
+}
 
-      // If we didn't update in place, we need to just add this node
-      if (!did_update_in_place) {
-        // Add it to the submodule list
-        m_old->submodules.emplace_back(new_submodule);
-        // Reparent the module
-        new_submodule->parent = m_old;
-        // Notify wx about it
-        ItemAdded(wxDataViewItem(m_old), wxDataViewItem(new_submodule));
-        // Detach it from the input design
-        new_it = m_new->submodules.erase(new_it);
-      } else {
-        ++new_it;
-      }
+void YostatDataModel::get_trend(wxVariant &variant, const Module *node) const {
+  // (self) rows aren't modules, so have no history
+  variant.NullList();
+  if (node->kind == Module::Kind::Self) {
+    return;
+  }
+  uint32_t primitive = StringPool::none;
+  if (!_trend_primitive.empty()) {
+    primitive = _history->find(_trend_primitive);
+    if (primitive == StringPool::none) {
+      return;
+    }
+  }
+  for (const int count : history_series(*_history, node->summary->name,
+                                        primitive, trend_builds)) {
+    variant.Append(wxVariant((long)count));
+  }
+}
+
+const YostatDataModel::ChildOrder &
+YostatDataModel::sorted_children(const Module *node, unsigned col) const {
+  ChildOrder &order = _orders[node];
+  const unsigned count = node->num_children;
+  if (order.index.empty()) {
+    order.index.reserve(count);
+    for (unsigned i = 0; i < count; i++) {
+      order.index.emplace(_design->nodes.child(node, i), i);
+    }
+  }
+  if (order.ranks.size() <= col) {
+    order.ranks.resize(col + 1);
+  }
+  std::vector<uint32_t> &ranks = order.ranks[col];
+  if (!ranks.empty() || count == 0) {
+    return order;
+  }
+
+  // Sort the child positions by the column's value, fetching each value only
+  // once. Equal values keep the order of the netlist.
+  std::vector<uint32_t> sorted(count);
+  std::iota(sorted.begin(), sorted.end(), 0);
+  if (col == 0) {
+    std::vector<std::string> names(count);
+    for (unsigned i = 0; i < count; i++) {
+      names[i] = _design->nodes.child(node, i)->name(_design->names);
+    }
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t x, uint32_t y) {
+      const int c = names[x].compare(names[y]);
+      return c != 0 ? c < 0 : x < y;
+    });
+  } else {
+    std::vector<double> values(count);
+    for (unsigned i = 0; i < count; i++) {
+      values[i] = get_number(_design->nodes.child(node, i), col);
+    }
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t x, uint32_t y) {
+      return values[x] != values[y] ? values[x] < values[y] : x < y;
+    });
+  }
+  ranks.resize(count);
+  for (unsigned rank = 0; rank < count; rank++) {
+    ranks[sorted[rank]] = rank;
+  }
+  return order;
+}
+
+void YostatDataModel::forget_orders_below(const Module *node) {
+  std::vector<const Module *> pending = {node};
+  while (!pending.empty()) {
+    const Module *m = pending.back();
+    pending.pop_back();
+    if (!m->expanded) {
+      continue;
     }
+    _orders.erase(m);
+    for (unsigned i = 0; i < m->num_children; i++) {
+      pending.emplace_back(_design->nodes.child(m, i));
+    }
+  }
+}
 
-    // At this point, we've handled cases 1 and 2. For the final case we
-    // just need to take everything left in old_submodules that wasn't
-    // readded and tell wx it's gone
-    for (auto mod : old_submodules) {
-      ItemDeleted(wxDataViewItem(m_old), wxDataViewItem(mod));
-      delete_module_tree(mod);
+Design *YostatDataModel::get_design() { return _design; }
+
+void YostatDataModel::update_categories() {
+  _primitive_categories.clear();
+  _categories.clear();
+  if (!_design->family) {
+    return;
+  }
+  bool used[num_primitive_categories] = {};
+  for (auto &primitive : _design->primitives) {
+    _primitive_categories.emplace_back(_design->family->category(primitive));
+    used[(size_t)_primitive_categories.back()] = true;
+  }
+  for (size_t c = 0; c < num_primitive_categories; c++) {
+    if (used[c]) {
+      _categories.emplace_back((PrimitiveCategory)c);
     }
-  };
+  }
+}
+
+void YostatDataModel::set_cost_model(const CostModel *model) {
+  _cost_model = model;
+  _costs.reset(model ? new CostColumns(*_design, *model) : nullptr);
 
-  // Recursively update
-  update_module(_design->top, d->top);
+  // Orders by the old model's columns no longer apply
+  const size_t first_cost_col = first_cost_column();
+  for (auto &order : _orders) {
+    if (order.second.ranks.size() > first_cost_col) {
+      order.second.ranks.resize(first_cost_col);
+    }
+  }
+}
+
+void YostatDataModel::set_filter(const std::string &query) {
+  _query = query;
+  apply_filter();
+  Cleared();
+}
+
+void YostatDataModel::apply_filter() {
+  if (_query.empty()) {
+    _filter.reset();
+    return;
+  }
+  if (!_index) {
+    _index.reset(new SearchIndex(*_design));
+  }
+  _filter.reset(new SearchResult(*_index, *_design, _query));
+}
+
+void YostatDataModel::item_collapsed(const wxDataViewItem &item) {
+  Module *node = reinterpret_cast<Module *>(item.GetID());
+  if (!node || !node->expanded || _design->nodes.size() <= node_budget) {
+    return;
+  }
+
+  // Over budget, so free the subtree that was just hidden. It will be
+  // generated again if the node is expanded.
+  wxDataViewItemArray children;
+  GetChildren(item, children);
+  ItemsDeleted(item, children);
+  forget_orders_below(node);
+  _design->nodes.release_children(node);
+}
+
+// Collects the changes made by update_design, and forwards them to wx in
+// batches once the diff is complete
+class YostatDiffListener : public TreeDiffListener {
+public:
+  YostatDiffListener(YostatDataModel &model) : _model(model) {}
+
+  void items_added(Module *parent,
+                   const std::vector<Module *> &items) override {
+    added.emplace_back(parent, to_array(items));
+  }
+  void items_deleted(Module *parent,
+                     const std::vector<Module *> &items) override {
+    deleted.emplace_back(parent, to_array(items));
+    // The nodes are freed once the diff is done, and their slots can go to
+    // new nodes, so their orders have to go while they can still be walked
+    for (Module *item : items) {
+      _model.forget_orders_below(item);
+    }
+  }
+  void items_changed(const std::vector<Module *> &items) override {
+    for (Module *item : items) {
+      changed.Add(wxDataViewItem((void *)item));
+    }
+  }
+
+  static wxDataViewItemArray to_array(const std::vector<Module *> &items) {
+    wxDataViewItemArray array;
+    array.Alloc(items.size());
+    for (Module *item : items) {
+      array.Add(wxDataViewItem((void *)item));
+    }
+    return array;
+  }
+
+  std::vector<std::pair<Module *, wxDataViewItemArray>> added;
+  std::vector<std::pair<Module *, wxDataViewItemArray>> deleted;
+  wxDataViewItemArray changed;
+
+private:
+  YostatDataModel &_model;
+};
+
+void YostatDataModel::set_design(Design *d) {
+  // The search index refers to the old summaries, which are about to go
+  _filter.reset();
+  _index.reset();
+
+  // Need to compare new design and old design and try to update in place as
+  // much as possible to preserve current view state
+  YostatDiffListener listener(*this);
+  const bool same_columns =
+      _design->primitives == d->primitives && _design->family == d->family;
+  TreeDiffStats stats = update_design(*_design, *d, listener);
+  update_categories();
+
+  // Cost columns are per summary, so they need redoing for the new ones. The
+  // values of nodes that didn't change are the same as before.
+  _costs.reset(_cost_model ? new CostColumns(*_design, *_cost_model)
+                           : nullptr);
+
+  // Child orders only need working out again where children were added or
+  // deleted, or changed their values. If the columns moved, they all do.
+  if (!same_columns) {
+    _orders.clear();
+  } else {
+    for (auto &batch : listener.added) {
+      forget_order(batch.first);
+    }
+    for (auto &batch : listener.deleted) {
+      forget_order(batch.first);
+    }
+    for (const wxDataViewItem &item : listener.changed) {
+      const Module *node = reinterpret_cast<Module *>(item.GetID());
+      forget_order(node);
+      forget_order(node->parent);
+    }
+  }
+
+  // Which rows a filter shows can change anywhere in the tree, so just have
+  // wx start again
+  if (!_query.empty()) {
+    apply_filter();
+    Cleared();
+    return;
+  }
+
+  // If most of what wx knows about changed, it's cheaper to have it rebuild
+  // everything than to apply the changes one batch at a time
+  const size_t notifications = stats.added + stats.deleted + stats.changed;
+  if (notifications >= clear_threshold &&
+      notifications * 2 >= stats.visited) {
+    Cleared();
+    return;
+  }
+  // Deleted nodes have been freed, and wx may generate new nodes in their
+  // slots while it takes in the added ones, so it has to drop them first
+  for (auto &batch : listener.deleted) {
+    ItemsDeleted(wxDataViewItem((void *)batch.first), batch.second);
+  }
+  for (auto &batch : listener.added) {
+    ItemsAdded(wxDataViewItem((void *)batch.first), batch.second);
+  }
+  if (!listener.changed.empty()) {
+    ItemsChanged(listener.changed);
+  }
 }
 
 YostatDataModel::~YostatDataModel() { delete _design; }
 
-YostatWxPanel::YostatWxPanel(std::string filename, Design *design)
+YostatWxPanel::YostatWxPanel(std::string filename, Design *design, bool watch,
+                             const LoadOptions &options)
     : wxFrame(nullptr, wxID_ANY, "Yostat", wxPoint(-1, -1), wxSize(-1, -1)),
       _filename(filename) {
+  // Reloads use the same options as the initial load. They only need to
+  // parse the modules that changed since the last one.
+  LoadOptions reload_options = options;
+  if (!reload_options.previous) {
+    reload_options.previous = std::make_shared<IngestState>();
+  }
+  _loader.set_options(reload_options);
+  _load_stats = design->stats;
 
   // Create a parent panel and sizer
   wxPanel *parent = new wxPanel(this, wxID_ANY);
-  wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
+  wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
+
+  // Search box above the tree
+  _search = new wxSearchCtrl(parent, Ids::SEARCH);
+  _search->SetDescriptiveText("Search instances, e.g. cpu/alu");
+  _search->ShowCancelButton(true);
+  vbox->Add(_search, 0, wxEXPAND);
 
   // Create a dataview and add it to our sizer
   _dataview =
       new wxDataViewCtrl(parent, wxID_ANY, wxPoint(-1, -1), wxSize(-1, -1));
-  hbox->Add(_dataview, -1, wxEXPAND);
+  vbox->Add(_dataview, 1, wxEXPAND);
 
   // Create our data model using the parsed yosys design
   _datamodel = new YostatDataModel(design);
@@ -200,19 +484,113 @@ YostatWxPanel::YostatWxPanel(std::string filename, Design *design)
   wxMenuBar *menubar = new wxMenuBar();
   wxMenu *menu = new wxMenu();
   menu->Append(Ids::RELOAD_FILE, "&Reload\tCTRL+R", "Reload current json file");
+  menu->AppendCheckItem(Ids::WATCH_FILE, "&Watch for changes\tCTRL+W",
+                        "Reload automatically when the json file changes");
+  menu->AppendSeparator();
+  menu->Append(Ids::TOP_CONTRIBUTORS, "&Top contributors...\tCTRL+T",
+               "List the instances or modules using the most primitives");
+  menu->Append(Ids::LOAD_STATS, "&About this load...",
+               "Show where the time and memory went when loading the design");
   menubar->Append(menu, "Yo&stat");
+
+  // Cost models are listed after the load item as they are loaded
+  _cost_menu = new wxMenu();
+  _cost_menu->Append(Ids::LOAD_COST_MODEL, "&Load cost model...\tCTRL+M",
+                     "Add cost and device use columns from a cost model file");
+  _cost_menu->AppendSeparator();
+  _cost_menu->AppendRadioItem(Ids::NO_COST_MODEL, "&None",
+                              "Hide the cost model columns");
+  menubar->Append(_cost_menu, "&Cost");
   SetMenuBar(menubar);
 
   // Status bar
   CreateStatusBar();
-  GetStatusBar()->SetStatusText("Ready");
+  GetStatusBar()->SetStatusText(format_stats_summary(_load_stats));
+
+  // Start watching the input file if requested
+  if (watch) {
+    menu->Check(Ids::WATCH_FILE, true);
+    set_watching(true);
+  }
 
   // Finalize layout
-  parent->SetSizer(hbox);
+  parent->SetSizer(vbox);
   parent->SetAutoLayout(true);
 }
 
+// Draws a list of counts as a line, oldest first, scaled to fit between the
+// smallest and largest count. Negative counts are builds without the module,
+// which leave a gap.
+class YostatSparklineRenderer : public wxDataViewCustomRenderer {
+public:
+  YostatSparklineRenderer()
+      : wxDataViewCustomRenderer("list", wxDATAVIEW_CELL_INERT) {}
+
+  bool SetValue(const wxVariant &value) override {
+    _counts.clear();
+    for (size_t i = 0; i < value.GetCount(); i++) {
+      _counts.emplace_back(value[i].GetLong());
+    }
+    return true;
+  }
+
+  bool GetValue(wxVariant &value) const override {
+    value.NullList();
+    for (const long count : _counts) {
+      value.Append(wxVariant(count));
+    }
+    return true;
+  }
+
+  wxSize GetSize() const override { return wxSize(120, 16); }
+
+  bool Render(wxRect cell, wxDC *dc, int state) override {
+    long low = -1, high = -1;
+    for (const long count : _counts) {
+      if (count >= 0) {
+        low = low < 0 ? count : std::min(low, count);
+        high = std::max(high, count);
+      }
+    }
+    if (high < 0) {
+      return true;
+    }
+    cell.Deflate(2);
+    const double step =
+        _counts.size() > 1 ? (cell.width - 1.0) / (_counts.size() - 1) : 0;
+    auto point = [&](size_t i) {
+      const double scale = high > low ? (double)(_counts[i] - low) /
+                                            (high - low)
+                                      : 0.5;
+      return wxPoint(cell.x + std::lround(i * step),
+                     cell.GetBottom() - std::lround(scale * (cell.height - 1)));
+    };
+    dc->SetPen(wxPen(wxSystemSettings::GetColour(
+        state & wxDATAVIEW_CELL_SELECTED ? wxSYS_COLOUR_HIGHLIGHTTEXT
+                                         : wxSYS_COLOUR_WINDOWTEXT)));
+    for (size_t i = 0; i < _counts.size(); i++) {
+      if (_counts[i] < 0) {
+        continue;
+      }
+      // Builds on their own between gaps are drawn as a dot
+      const bool joined = i + 1 < _counts.size() && _counts[i + 1] >= 0;
+      const bool after_gap = i == 0 || _counts[i - 1] < 0;
+      if (joined) {
+        dc->DrawLine(point(i), point(i + 1));
+      } else if (after_gap) {
+        dc->DrawPoint(point(i));
+      }
+    }
+    return true;
+  }
+
+private:
+  std::vector<long> _counts;
+};
+
 void YostatWxPanel::create_columns_for_design(Design *design, bool sort) {
+  ScopedPhase columns_phase(&_load_stats, "columns");
+
   // Create the first column, which is the module names
   wxDataViewTextRenderer *string_renderer =
       new wxDataViewTextRenderer("string", wxDATAVIEW_CELL_ACTIVATABLE);
@@ -232,24 +610,349 @@ void YostatWxPanel::create_columns_for_design(Design *design, bool sort) {
             wxDATAVIEW_COL_REORDERABLE);
     _dataview->AppendColumn(cell_col);
   }
+  // Then the category totals, if the design's family is known
+  for (unsigned i = 0; i < _datamodel->num_categories(); i++) {
+    wxDataViewTextRenderer *long_renderer =
+        new wxDataViewTextRenderer("long", wxDATAVIEW_CELL_INERT);
+    _dataview->AppendColumn(new wxDataViewColumn(
+        category_name(_datamodel->category(i)), long_renderer, col++, 100,
+        wxALIGN_LEFT,
+        wxDATAVIEW_COL_SORTABLE | wxDATAVIEW_COL_RESIZABLE |
+            wxDATAVIEW_COL_REORDERABLE));
+  }
+  if (_cost_model >= 0) {
+    append_cost_columns();
+  }
+  if (_history) {
+    append_trend_column();
+  }
+
+  columns_phase.finish();
 
   // Order by module name initially
   if (sort) {
+    ScopedPhase sort_phase(&_load_stats, "sort");
     col_module->SetSortOrder(true);
     _datamodel->Resort();
   }
 }
 
-void YostatWxPanel::reload(wxCommandEvent &evt) {
-  // Reread the json
+void YostatWxPanel::append_cost_columns() {
+  const unsigned col = _datamodel->first_cost_column();
+  wxDataViewTextRenderer *cost_renderer =
+      new wxDataViewTextRenderer("double", wxDATAVIEW_CELL_INERT);
+  _dataview->AppendColumn(new wxDataViewColumn(
+      cost_column_title(), cost_renderer, col, 100, wxALIGN_LEFT,
+      wxDATAVIEW_COL_SORTABLE | wxDATAVIEW_COL_RESIZABLE |
+          wxDATAVIEW_COL_REORDERABLE));
+  _dataview->AppendColumn(new wxDataViewColumn(
+      "Device %", new wxDataViewProgressRenderer(), col + 1, 100,
+      wxALIGN_LEFT,
+      wxDATAVIEW_COL_SORTABLE | wxDATAVIEW_COL_RESIZABLE |
+          wxDATAVIEW_COL_REORDERABLE));
+}
+
+void YostatWxPanel::append_trend_column() {
+  _dataview->AppendColumn(new wxDataViewColumn(
+      "Trend", new YostatSparklineRenderer(), _datamodel->trend_column(), 120,
+      wxALIGN_LEFT, wxDATAVIEW_COL_RESIZABLE | wxDATAVIEW_COL_REORDERABLE));
+}
+
+void YostatWxPanel::update_trend_column() {
+  wxDataViewColumn *trend = find_column(_datamodel->trend_column());
+  if (!trend) {
+    return;
+  }
+  Design *design = _datamodel->get_design();
+  wxDataViewColumn *sort_col = _dataview->GetSortingColumn();
+  const unsigned col = sort_col ? sort_col->GetModelColumn() : 0;
+  if (col > 0 && col <= design->primitives.size()) {
+    _datamodel->set_trend_primitive(design->primitives[col - 1]);
+    trend->SetTitle("Trend (" + design->primitives[col - 1] + ")");
+  } else {
+    _datamodel->set_trend_primitive("");
+    trend->SetTitle("Trend (all)");
+  }
+  _dataview->Refresh();
+}
+
+wxDataViewColumn *YostatWxPanel::find_column(unsigned model_column) const {
+  for (unsigned i = 0; i < _dataview->GetColumnCount(); i++) {
+    wxDataViewColumn *column = _dataview->GetColumn(i);
+    if (column->GetModelColumn() == model_column) {
+      return column;
+    }
+  }
+  return nullptr;
+}
+
+void YostatWxPanel::set_history(const std::string &path,
+                                std::unique_ptr<HistoryStore> history) {
+  const bool had_column = _history != nullptr;
+  _history_path = path;
+  _history = std::move(history);
+  _datamodel->set_history(_history.get());
+  if (!had_column) {
+    append_trend_column();
+  }
+  update_trend_column();
+}
+
+wxString YostatWxPanel::cost_column_title() const {
+  return "Cost (" + _cost_models[_cost_model]->name + ")";
+}
+
+void YostatWxPanel::add_cost_model(const CostModel &model) {
+  const int index = _cost_models.size();
+  if (Ids::FIRST_COST_MODEL + index > Ids::LAST_COST_MODEL) {
+    wxMessageBox("Too many cost models loaded", "Yostat", wxOK | wxICON_ERROR,
+                 this);
+    return;
+  }
+  _cost_models.emplace_back(new CostModel(model));
+  _cost_menu->AppendRadioItem(Ids::FIRST_COST_MODEL + index, model.name,
+                              "Use the " + model.name + " cost model");
+  _cost_menu->Check(Ids::FIRST_COST_MODEL + index, true);
+  use_cost_model(index);
+}
+
+void YostatWxPanel::use_cost_model(int index) {
+  const bool had_columns = _cost_model >= 0;
+
+  // The trend column comes after the cost columns, so it moves when they are
+  // added or removed
+  wxDataViewColumn *trend = nullptr;
+  if (_history && had_columns != (index >= 0)) {
+    trend = find_column(_datamodel->trend_column());
+  }
+  if (trend) {
+    _dataview->DeleteColumn(trend);
+  }
+
+  _cost_model = index;
+  _datamodel->set_cost_model(index >= 0 ? _cost_models[index].get()
+                                        : nullptr);
+
+  // Switching between models only changes the values, which wx asks for as
+  // it draws, so the columns can stay. They may not be the last columns in
+  // the view, so they are found by their model columns.
+  const unsigned col = _datamodel->first_cost_column();
+  if (had_columns && index >= 0) {
+    find_column(col)->SetTitle(cost_column_title());
+  } else if (had_columns) {
+    _dataview->DeleteColumn(find_column(col + 1));
+    _dataview->DeleteColumn(find_column(col));
+  } else if (index >= 0) {
+    append_cost_columns();
+  }
+  if (trend) {
+    append_trend_column();
+    update_trend_column();
+  }
+  _datamodel->Resort();
+  _dataview->Refresh();
+}
+
+void YostatWxPanel::load_cost_model(wxCommandEvent &evt) {
+  wxFileDialog dialog(this, "Load cost model", "", "",
+                      "Cost models (*.json)|*.json|All files|*",
+                      wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+  if (dialog.ShowModal() != wxID_OK) {
+    return;
+  }
+  CostModel model;
+  std::string error;
+  if (!read_cost_model(dialog.GetPath().ToStdString(), model, error)) {
+    wxMessageBox(error, "Yostat", wxOK | wxICON_ERROR, this);
+    return;
+  }
+  add_cost_model(model);
+}
+
+void YostatWxPanel::select_cost_model(wxCommandEvent &evt) {
+  if (evt.GetId() == Ids::NO_COST_MODEL) {
+    use_cost_model(-1);
+  } else {
+    use_cost_model(evt.GetId() - Ids::FIRST_COST_MODEL);
+  }
+}
+
+void YostatWxPanel::on_dataview_item_collapsed(wxDataViewEvent &evt) {
+  _datamodel->item_collapsed(evt.GetItem());
+}
+
+void YostatWxPanel::on_dataview_column_sorted(wxDataViewEvent &evt) {
+  update_trend_column();
+}
+
+void YostatWxPanel::on_search(wxCommandEvent &evt) {
+  _datamodel->set_filter(_search->GetValue().ToStdString());
+  expand_matches();
+  update_status();
+}
+
+void YostatWxPanel::expand_matches() {
+  if (!_datamodel->get_filter()) {
+    return;
+  }
+  // Expand breadth first, so that parents are always expanded before their
+  // children, and stop once enough rows are showing
+  static constexpr size_t max_rows = 200;
+  size_t rows = 0;
+  std::vector<wxDataViewItem> pending = {wxDataViewItem(nullptr)};
+  for (size_t i = 0; i < pending.size() && rows < max_rows; i++) {
+    wxDataViewItemArray children;
+    _datamodel->GetChildren(pending[i], children);
+    if (children.empty()) {
+      continue;
+    }
+    if (pending[i].IsOk()) {
+      _dataview->Expand(pending[i]);
+    }
+    rows += children.size();
+    pending.insert(pending.end(), children.begin(), children.end());
+  }
+}
+
+void YostatWxPanel::show_instance(const RankEntry &entry) {
+  Module *m = find_instance(*_datamodel->get_design(), entry.path);
+  if (!m) {
+    return;
+  }
+  // Stop filtering if the filter hides the instance
+  const SearchResult *filter = _datamodel->get_filter();
+  if (filter && !filter->visible(m)) {
+    _search->SetValue("");
+  }
+  const wxDataViewItem item((void *)m);
+  _dataview->EnsureVisible(item);
+  _dataview->Select(item);
+  _dataview->SetFocus();
+}
+
+void YostatWxPanel::update_status() {
+  const SearchResult *filter = _datamodel->get_filter();
+  if (!filter) {
+    GetStatusBar()->SetStatusText(format_stats_summary(_load_stats));
+  } else if (filter->instances() == 0) {
+    GetStatusBar()->SetStatusText("No matches");
+  } else {
+    GetStatusBar()->SetStatusText(
+        std::to_string(filter->instances()) + " matching instances of " +
+        std::to_string(filter->modules()) + " modules");
+  }
+}
+
+void YostatWxPanel::reload(wxCommandEvent &evt) { start_reload(); }
+
+void YostatWxPanel::toggle_watch(wxCommandEvent &evt) {
+  set_watching(evt.IsChecked());
+}
+
+void YostatWxPanel::show_top_contributors(wxCommandEvent &evt) {
+  // Created on first use and then kept, hidden when closed
+  if (!_rank_dialog) {
+    _rank_dialog = new YostatRankDialog(
+        this, _datamodel->get_design(),
+        [this](const RankEntry &entry) { show_instance(entry); });
+  }
+  _rank_dialog->Show();
+  _rank_dialog->Raise();
+}
+
+void YostatWxPanel::show_load_stats(wxCommandEvent &evt) {
+  const std::string report = format_stats_report(
+      _load_stats, tree_stats(*_datamodel->get_design()));
+
+  // Show the report in a fixed width font, since it is laid out as a table
+  wxDialog dialog(this, wxID_ANY, "About this load");
+  wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
+  wxTextCtrl *text = new wxTextCtrl(
+      &dialog, wxID_ANY, report, wxDefaultPosition, wxSize(600, 320),
+      wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP);
+  text->SetFont(wxFont(wxFontInfo().Family(wxFONTFAMILY_TELETYPE)));
+  vbox->Add(text, 1, wxEXPAND | wxALL, 8);
+  if (wxSizer *buttons = dialog.CreateButtonSizer(wxOK)) {
+    vbox->Add(buttons, 0, wxEXPAND | wxALL, 8);
+  }
+  dialog.SetSizerAndFit(vbox);
+  dialog.ShowModal();
+}
+
+void YostatWxPanel::set_watching(bool watch) {
+  if (!watch) {
+    _watcher.reset();
+    return;
+  }
+  _watcher.reset(new FileWatcher(
+      _filename,
+      // As soon as the file starts changing, whatever we were loading is
+      // stale
+      [this]() {
+        _loader.cancel();
+        CallAfter([this]() {
+          GetStatusBar()->SetStatusText(_filename + " changed, waiting...");
+        });
+      },
+      // Once it's finished changing, reload it
+      [this]() { CallAfter([this]() { start_reload(); }); }));
+}
+
+void YostatWxPanel::start_reload() {
+  // Reread the json on a background thread. Progress and the final design are
+  // handed back to the GUI thread as they come in.
   GetStatusBar()->SetStatusText("Re-reading " + _filename);
-  Design *d = read_json(_filename);
+  int last_percent = -1;
+  _loader.load(
+      _filename,
+      [this, last_percent](size_t done, size_t total) mutable {
+        const int percent = total ? done * 100 / total : 0;
+        if (percent == last_percent) {
+          return;
+        }
+        last_percent = percent;
+        CallAfter([this, percent]() {
+          GetStatusBar()->SetStatusText("Re-reading " + _filename + "... " +
+                                        std::to_string(percent) + "%");
+        });
+      },
+      [this](Design *d, uint64_t generation) {
+        CallAfter([this, d, generation]() { finish_reload(d, generation); });
+      });
+}
+
+void YostatWxPanel::finish_reload(Design *d, uint64_t generation) {
+  // Another reload may have started since this one finished
+  if (!_loader.is_current(generation)) {
+    delete d;
+    return;
+  }
+  if (!d) {
+    GetStatusBar()->SetStatusText("Failed to parse " + _filename);
+    return;
+  }
+
+  // Carry on measuring from where the load left off
+  _load_stats = d->stats;
 
   // Get the name of the column we were previously sorted by
   wxDataViewColumn *sort_col = _dataview->GetSortingColumn();
-  const unsigned sort_col_idx = sort_col->GetModelColumn();
-  const bool sorted_by_primitive = sort_col_idx > 0;
-  const bool sort_order = sort_col->IsSortOrderAscending();
+  const unsigned sort_col_idx = sort_col ? sort_col->GetModelColumn() : 0;
+  const unsigned num_primitives = _datamodel->get_design()->primitives.size();
+  const unsigned first_cost_col = _datamodel->first_cost_column();
+  const bool sorted_by_primitive =
+      sort_col_idx > 0 && sort_col_idx <= num_primitives;
+  // Category and cost model columns come after the primitives, and the
+  // primitives may change, so remember which one
+  const bool sorted_by_category =
+      sort_col_idx > num_primitives && sort_col_idx < first_cost_col;
+  PrimitiveCategory sort_category = PrimitiveCategory::Other;
+  if (sorted_by_category) {
+    sort_category = _datamodel->category(sort_col_idx - num_primitives - 1);
+  }
+  const unsigned sort_cost_col =
+      sort_col_idx >= first_cost_col ? sort_col_idx - first_cost_col + 1 : 0;
+  const bool sort_order = sort_col ? sort_col->IsSortOrderAscending() : true;
   std::string sort_primitive;
   if (sorted_by_primitive) {
     // Get the name of the sort primitive so we can re-sort by it
@@ -260,27 +963,54 @@ void YostatWxPanel::reload(wxCommandEvent &evt) {
   _dataview->ClearColumns();
 
   // Create a model with the new data
+  ScopedPhase update_phase(&_load_stats, "update view");
   _datamodel->set_design(d);
+  update_phase.finish();
+
+  // Pick up any builds recorded in the history store since it was opened.
+  // If it can't be read any more, keep showing what was read before.
+  if (_history) {
+    std::unique_ptr<HistoryStore> history(new HistoryStore);
+    std::string error;
+    if (history->open(_history_path, error)) {
+      _history = std::move(history);
+      _datamodel->set_history(_history.get());
+    }
+  }
 
   // Regenerate the dataview columns to match the new primitive data
   create_columns_for_design(d, /*sort*/ false);
 
   // Re-apply the sort if possible
+  ScopedPhase sort_phase(&_load_stats, "sort");
   if (sorted_by_primitive) {
     // Try and match the primitive to a new column index
-    for (unsigned i = 0; i < d->primitives.size(); i++) {
-      if (sort_primitive == d->primitives[i]) {
-        // Matched, sory by this colindex
-        _dataview->GetColumn(i + 1)->SetSortOrder(sort_order);
-        break;
+    auto search = d->primitive_ids.find(sort_primitive);
+    if (search != d->primitive_ids.end()) {
+      // Matched, sort by this colindex
+      _dataview->GetColumn(search->second + 1)->SetSortOrder(sort_order);
+    }
+  } else if (sorted_by_category) {
+    for (unsigned i = 0; i < _datamodel->num_categories(); i++) {
+      if (_datamodel->category(i) == sort_category) {
+        find_column(d->primitives.size() + 1 + i)->SetSortOrder(sort_order);
       }
     }
+  } else if (sort_cost_col) {
+    find_column(_datamodel->first_cost_column() + sort_cost_col - 1)
+        ->SetSortOrder(sort_order);
   } else {
     _dataview->GetColumn(0)->SetSortOrder(sort_order);
   }
   _datamodel->Resort();
+  sort_phase.finish();
 
-  GetStatusBar()->SetStatusText("Done");
+  update_trend_column();
+  expand_matches();
+  update_status();
+  if (_rank_dialog) {
+    _rank_dialog->set_design(_datamodel->get_design());
+  }
 
   // Delete any parts of the new design that we didn't steal in set_design
   delete d;
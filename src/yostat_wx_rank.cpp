@@ -0,0 +1,126 @@
+#include <cstdio>
+
+#include <yostat/yostat_wx_rank.hpp>
+
+enum RankIds {
+  QUERY_CONTROL = 300,
+  RESULTS,
+};
+
+/* clang-format off */
+BEGIN_EVENT_TABLE(YostatRankDialog, wxDialog)
+EVT_CHOICE(RankIds::QUERY_CONTROL, YostatRankDialog::on_query_changed)
+EVT_SPINCTRL(RankIds::QUERY_CONTROL, YostatRankDialog::on_query_changed)
+EVT_CHECKBOX(RankIds::QUERY_CONTROL, YostatRankDialog::on_query_changed)
+EVT_LIST_ITEM_ACTIVATED(RankIds::RESULTS, YostatRankDialog::on_item_activated)
+EVT_CLOSE(YostatRankDialog::on_close)
+END_EVENT_TABLE()
+/* clang-format on */
+
+YostatRankDialog::YostatRankDialog(wxWindow *parent, Design *design,
+                                   ActivateFn activate)
+    : wxDialog(parent, wxID_ANY, "Top contributors", wxDefaultPosition,
+               wxSize(640, 480), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER),
+      _design(design), _activate(activate) {
+  wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
+
+  // Query controls along the top
+  wxBoxSizer *controls = new wxBoxSizer(wxHORIZONTAL);
+  controls->Add(new wxStaticText(this, wxID_ANY, "Top"), 0,
+                wxALL | wxALIGN_CENTER_VERTICAL, 4);
+  _count = new wxSpinCtrl(this, RankIds::QUERY_CONTROL, "20",
+                          wxDefaultPosition, wxDefaultSize, 0, 1, 10000, 20);
+  controls->Add(_count, 0, wxALL, 4);
+  controls->Add(new wxStaticText(this, wxID_ANY, "by"), 0,
+                wxALL | wxALIGN_CENTER_VERTICAL, 4);
+  _primitive = new wxChoice(this, RankIds::QUERY_CONTROL);
+  controls->Add(_primitive, 1, wxALL, 4);
+  _self = new wxCheckBox(this, RankIds::QUERY_CONTROL, "(self) only");
+  controls->Add(_self, 0, wxALL | wxALIGN_CENTER_VERTICAL, 4);
+  _modules = new wxCheckBox(this, RankIds::QUERY_CONTROL, "Whole modules");
+  controls->Add(_modules, 0, wxALL | wxALIGN_CENTER_VERTICAL, 4);
+  vbox->Add(controls, 0, wxEXPAND);
+
+  // Results below
+  _results = new wxListCtrl(this, RankIds::RESULTS, wxDefaultPosition,
+                            wxDefaultSize, wxLC_REPORT);
+  _results->AppendColumn("Rank", 0, 50);
+  _results->AppendColumn("Instance", 0, 360);
+  _results->AppendColumn("Instances", 0, 80);
+  _results->AppendColumn("Score", 0, 100);
+  vbox->Add(_results, 1, wxEXPAND | wxALL, 4);
+
+  SetSizer(vbox);
+  update_primitives();
+  update_results();
+}
+
+void YostatRankDialog::set_design(Design *design) {
+  _design = design;
+  update_primitives();
+  update_results();
+}
+
+void YostatRankDialog::on_query_changed(wxCommandEvent &evt) {
+  update_results();
+}
+
+void YostatRankDialog::on_item_activated(wxListEvent &evt) {
+  const long index = evt.GetIndex();
+  if (index >= 0 && index < (long)_entries.size() && !_query.modules) {
+    _activate(_entries[index]);
+  }
+}
+
+void YostatRankDialog::on_close(wxCloseEvent &evt) {
+  // Keep the window around so that it opens with the same settings
+  Hide();
+}
+
+void YostatRankDialog::update_primitives() {
+  // Keep the same primitive selected if the design still has it
+  const wxString selected = _primitive->GetStringSelection();
+  _primitive->Clear();
+  _primitive->Append("All primitives");
+  int selection = 0;
+  for (size_t i = 0; i < _design->primitives.size(); i++) {
+    _primitive->Append(_design->primitives[i]);
+    if (_design->primitives[i] == selected.ToStdString()) {
+      selection = i + 1;
+    }
+  }
+  _primitive->SetSelection(selection);
+}
+
+void YostatRankDialog::update_results() {
+  // The first choice ranks by every primitive at once
+  _query.weights.clear();
+  const int selection = _primitive->GetSelection();
+  if (selection > 0) {
+    _query.weights.emplace_back(selection - 1, 1);
+  } else {
+    for (size_t i = 0; i < _design->primitives.size(); i++) {
+      _query.weights.emplace_back(i, 1);
+    }
+  }
+  _query.count = _count->GetValue();
+  _query.self = _self->GetValue();
+  _query.modules = _modules->GetValue();
+  _entries = rank_contributors(*_design, _query);
+
+  _results->DeleteAllItems();
+  for (size_t i = 0; i < _entries.size(); i++) {
+    const RankEntry &entry = _entries[i];
+    std::string name =
+        _query.modules ? entry.path.back()->name : entry.path_name();
+    if (_query.self) {
+      name += " (self)";
+    }
+    char score[32];
+    snprintf(score, sizeof(score), "%g", entry.rank_score(_query));
+    const long item = _results->InsertItem(i, std::to_string(i + 1));
+    _results->SetItem(item, 1, name);
+    _results->SetItem(item, 2, std::to_string(entry.instances));
+    _results->SetItem(item, 3, score);
+  }
+}